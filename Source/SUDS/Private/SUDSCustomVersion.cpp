@@ -0,0 +1,11 @@
+﻿// Copyright Steve Streeting 2022
+// Released under the MIT license https://opensource.org/license/MIT/
+#include "SUDSCustomVersion.h"
+
+#include "Serialization/CustomVersion.h"
+
+const FGuid FSUDSCustomVersion::GUID(0x5B9A4A3E, 0xAD904B20, 0x885E6145, 0x6A0699DD);
+
+static FCustomVersionRegistration GRegisterSUDSCustomVersion(FSUDSCustomVersion::GUID,
+                                                             FSUDSCustomVersion::LatestVersion,
+                                                             TEXT("SUDS"));
@@ -2,6 +2,7 @@
 // Released under the MIT license https://opensource.org/license/MIT/
 #include "SUDSDialogue.h"
 
+#include "SUDSCustomVersion.h"
 #include "SUDSParticipant.h"
 #include "SUDSScript.h"
 #include "SUDSScriptNode.h"
@@ -13,6 +14,8 @@
 #include "Kismet/GameplayStatics.h"
 #include "Sound/DialogueSoundWaveProxy.h"
 #include "Sound/DialogueWave.h"
+#include "Engine/AssetManager.h"
+#include "Internationalization/TextLocalizationManager.h"
 
 DEFINE_LOG_CATEGORY(LogSUDSDialogue);
 
@@ -22,23 +25,63 @@ const FString USUDSDialogue::DummyString = "INVALID";
 
 FArchive& operator<<(FArchive& Ar, FSUDSDialogueState& Value)
 {
+	Ar.UsingCustomVersion(FSUDSCustomVersion::GUID);
+
 	Ar << Value.TextNodeID;
 	Ar << Value.Variables;
 	Ar << Value.ChoicesTaken;
 	Ar << Value.ReturnStack;
+	if (Ar.CustomVer(FSUDSCustomVersion::GUID) >= FSUDSCustomVersion::VisitedBits)
+	{
+		Ar << Value.LinesSeen;
+		Ar << Value.ChoicesTakenBits;
+		Ar << Value.LinesSeenBits;
+		Ar << Value.OrdinalLayoutHash;
+	}
 	
 	return Ar;
 }
 
 void operator<<(FStructuredArchive::FSlot Slot, FSUDSDialogueState& Value)
 {
+	FArchive& Ar = Slot.GetUnderlyingArchive();
+	Ar.UsingCustomVersion(FSUDSCustomVersion::GUID);
+
 	FStructuredArchive::FRecord Record = Slot.EnterRecord();
 	Record
 		<< SA_VALUE(TEXT("TextNodeID"), Value.TextNodeID)
 		<< SA_VALUE(TEXT("Variables"), Value.Variables)
 		<< SA_VALUE(TEXT("ChoicesTaken"), Value.ChoicesTaken)
 		<< SA_VALUE(TEXT("ReturnStack"), Value.ReturnStack);
+	if (Ar.CustomVer(FSUDSCustomVersion::GUID) >= FSUDSCustomVersion::VisitedBits)
+	{
+		Record
+			<< SA_VALUE(TEXT("LinesSeen"), Value.LinesSeen)
+			<< SA_VALUE(TEXT("ChoicesTakenBits"), Value.ChoicesTakenBits)
+			<< SA_VALUE(TEXT("LinesSeenBits"), Value.LinesSeenBits)
+			<< SA_VALUE(TEXT("OrdinalLayoutHash"), Value.OrdinalLayoutHash);
+	}
+}
 
+/// Pack a bit array into words for saving
+static TArray<uint32> PackBits(const TBitArray<>& Bits)
+{
+	TArray<uint32> Words;
+	Words.SetNumZeroed(FMath::DivideAndRoundUp(Bits.Num(), 32));
+	for (TConstSetBitIterator<> It(Bits); It; ++It)
+	{
+		Words[It.GetIndex() / 32] |= 1u << (It.GetIndex() % 32);
+	}
+	return Words;
+}
+
+/// Unpack words saved by PackBits into a bit array which is already the right size
+static void UnpackBits(const TArray<uint32>& Words, TBitArray<>& InOutBits)
+{
+	for (int i = 0; i < InOutBits.Num(); ++i)
+	{
+		InOutBits[i] = Words.IsValidIndex(i / 32) && (Words[i / 32] & (1u << (i % 32))) != 0;
+	}
 }
 
 USUDSDialogue::USUDSDialogue(): BaseScript(nullptr),
@@ -54,16 +97,132 @@ void USUDSDialogue::Initialise(const USUDSScript* Script)
 	BaseScript = Script;
 	CurrentSpeakerNode = nullptr;
 
+	// Must be known before running the header, which can set global variables. Pooled dialogues are owned by the
+	// subsystem, which also covers the case where there's no game world
+	GlobalVariableHost = GetSUDSSubsystem(GetWorld());
+	if (!GlobalVariableHost.IsValid())
+	{
+		GlobalVariableHost = GetTypedOuter<USUDSSubsystem>();
+	}
+
+	// Start compiling text formats the first time the script is actually run
+	BaseScript->EnsureTextFormatsPrewarmed();
+
+	ResetVisited();
 	InitVariables();
 
 	CurrentSpeakerNode = nullptr;
 
 }
 
+void USUDSDialogue::ResetForReuse()
+{
+	// Detach everything external first, so nothing hears about the reset
+	OnSpeakerLine.Clear();
+	OnChoice.Clear();
+	OnProceeding.Clear();
+	OnEvent.Clear();
+	OnVariableChanged.Clear();
+	OnVariableRequested.Clear();
+	OnStarting.Clear();
+	OnFinished.Clear();
+#if WITH_EDITOR
+	InternalOnSpeakerLine.Unbind();
+	InternalOnChoice.Unbind();
+	InternalOnProceeding.Unbind();
+	InternalOnEvent.Unbind();
+	InternalOnSetVar.Unbind();
+	InternalOnSetVarByCode.Unbind();
+	InternalOnSelectEval.Unbind();
+	InternalOnStarting.Unbind();
+	InternalOnFinished.Unbind();
+#endif
+	Participants.Reset();
+	ParticipantDispatch.Reset();
+	bParticipantsHandleEvents = false;
+	EventSubscriptions.Reset();
+
+	// Settings back to defaults; with no prefetch depth, ending also releases any voice assets we were holding
+	bLazyVariableRequests = false;
+	bCacheResolvedText = false;
+	VoicePrefetchDepth = 0;
+	SetCurrentSpeakerNode(nullptr, true);
+	VoicePrefetchStats = FSUDSVoicePrefetchStats();
+
+	GosubReturnStack.Reset();
+	ChoicesTaken.Reset();
+	LinesSeen.Reset();
+	CurrentRequestedParamNames.Reset();
+	VariableSlots.Reset();
+	OverflowVariables.Reset();
+	GlobalVariableHost.Reset();
+	BaseScript = nullptr;
+}
+
+void USUDSDialogue::ResetVisited()
+{
+	ChoicesTaken.Init(false, BaseScript->GetChoiceOrdinalCount());
+	LinesSeen.Init(false, BaseScript->GetLineOrdinalCount());
+}
+
 void USUDSDialogue::InitVariables()
 {
-	VariableState.Empty();
-	// Run header nodes immediately (only set nodes)
+	// Reset rather than Empty, so a reused dialogue keeps its allocation
+	OverflowVariables.Reset();
+	const bool bCopyHeader = BaseScript->HasLiteralHeader() && !HasVariableChangeListeners();
+	// Same result as running the header, and nobody to tell about each variable being set, so just share the
+	// script's copy of the result until we change something
+	// Every variable has changed as far as cached text is concerned
+	++VariableVersionCounter;
+	VariableSlots.Init(bCopyHeader ? BaseScript->GetHeaderDefaultSlots() : nullptr,
+	                   BaseScript->GetVariableSlotCount(),
+	                   VariableVersionCounter);
+	OverflowVariablesVersion = VariableVersionCounter;
+
+	if (bCopyHeader)
+	{
+		// Running the header always ends up here
+		End(true);
+	}
+	else
+	{
+		// Run header nodes immediately (only set nodes)
+		RunHeader();
+	}
+}
+
+bool USUDSDialogue::HasVariableChangeListeners() const
+{
+	bool bListeners = OnVariableChanged.IsBound();
+#if WITH_EDITOR
+	bListeners |= InternalOnSetVar.IsBound();
+#endif
+	for (const auto& P : ParticipantDispatch)
+	{
+		bListeners |= P.Handles(ESUDSParticipantCallback::VariableChanged);
+	}
+	return bListeners;
+}
+
+void USUDSDialogue::RunHeader()
+{
+	if (BaseScript->HasLiteralHeader())
+	{
+		// No need to walk the header or evaluate anything, but still set each variable so that changes are raised
+		for (auto SetNode : BaseScript->GetLiteralHeaderSets())
+		{
+			const FSUDSValue& Value = SetNode->GetExpression().GetLiteralValue();
+			CurrentSourceLineNo = SetNode->GetSourceLineNo();
+			SetVariableImpl(SetNode->GetIdentifier(), SetNode->GetIdentifierSlot(), Value, true, CurrentSourceLineNo);
+#if WITH_EDITOR
+			InternalOnSetVar.ExecuteIfBound(this, SetNode->GetIdentifier(), Value, "", CurrentSourceLineNo);
+#endif
+		}
+		End(true);
+		return;
+	}
+	
+	TGuardValue<bool> HeaderGuard(bRunningHeader, true);
 	RunUntilNextSpeakerNodeOrEnd(BaseScript->GetHeaderNode(), false);
 }
 
@@ -107,22 +266,134 @@ void USUDSDialogue::AddParticipant(UObject* Participant)
 
 void USUDSDialogue::SortParticipants()
 {
-	if (!Participants.IsEmpty())
+	// Work out how to call each participant (and its priority) once, rather than every time we call it
+	ParticipantDispatch.Reset(Participants.Num());
+	for (auto P : Participants)
 	{
-		// We order by ascending priority so that higher priority values are later in the list
-		// Which means they're called last and get to override values set by earlier ones
-		// We'll do a stable sort so that otherwise order is maintained
-		Participants.StableSort([](const UObject& A, const UObject& B)
+		// Participants destroyed since they were added are nulled by GC
+		if (IsValid(P))
 		{
-			if (A.Implements<USUDSParticipant>() && B.Implements<USUDSParticipant>())
+			ParticipantDispatch.Add(ResolveParticipantDispatch(P));
+		}
+	}
+	// We order by ascending priority so that higher priority values are later in the list
+	// Which means they're called last and get to override values set by earlier ones
+	// We'll do a stable sort so that otherwise order is maintained
+	ParticipantDispatch.StableSort([](const FSUDSParticipantDispatch& A, const FSUDSParticipantDispatch& B)
+	{
+		return A.Priority < B.Priority;
+	});
+	bParticipantsHandleEvents = false;
+	Participants.SetNum(ParticipantDispatch.Num());
+	for (int i = 0; i < ParticipantDispatch.Num(); ++i)
+	{
+		Participants[i] = ParticipantDispatch[i].Object.Get();
+		bParticipantsHandleEvents |= ParticipantDispatch[i].Handles(ESUDSParticipantCallback::Event);
+	}
+}
+
+void USUDSDialogue::SubscribeToEvent(FName EventName, FOnSUDSNamedEvent Handler)
+{
+	EventSubscriptions.Subscribe(EventName, Handler);
+}
+
+void USUDSDialogue::UnsubscribeFromEvent(FName EventName, FOnSUDSNamedEvent Handler)
+{
+	EventSubscriptions.Unsubscribe(EventName, Handler);
+}
+
+bool USUDSDialogue::SubscribeFunctionToEvent(FName EventName, UObject* Object, FName FunctionName)
+{
+	if (FunctionName.IsNone())
+	{
+		FunctionName = EventName;
+	}
+	if (!EventSubscriptions.SubscribeFunction(EventName, Object, FunctionName))
+	{
+		UE_LOG(LogSUDSDialogue,
+		       Error,
+		       TEXT("Can't subscribe to event %s: %s has no function %s with parameters (Dialogue, EventName, Arguments)"),
+		       *EventName.ToString(),
+		       *GetNameSafe(Object),
+		       *FunctionName.ToString());
+		return false;
+	}
+	return true;
+}
+
+int USUDSDialogue::SubscribeParticipantsToEvent(FName EventName, FName FunctionName)
+{
+	if (FunctionName.IsNone())
+	{
+		FunctionName = EventName;
+	}
+	int Count = 0;
+	for (auto P : Participants)
+	{
+		// Participants without the function are fine, only those with it are interested
+		if (EventSubscriptions.SubscribeFunction(EventName, P, FunctionName))
+		{
+			++Count;
+		}
+	}
+	return Count;
+}
+
+void USUDSDialogue::UnsubscribeObjectFromEvents(UObject* Object)
+{
+	EventSubscriptions.UnsubscribeAll(Object);
+}
+
+FSUDSParticipantDispatch USUDSDialogue::ResolveParticipantDispatch(UObject* Participant)
+{
+	FSUDSParticipantDispatch Ret;
+	Ret.Object = Participant;
+	if (ISUDSNativeParticipant* Native = Cast<ISUDSNativeParticipant>(Participant))
+	{
+		Ret.Native = Native;
+		Ret.Priority = Native->GetNativeDialogueParticipantPriority();
+		Ret.Callbacks = Native->GetHandledDialogueCallbacks();
+	}
+	else if (Participant->Implements<USUDSParticipant>())
+	{
+		Ret.Priority = ISUDSParticipant::Execute_GetDialogueParticipantPriority(Participant);
+
+		const UClass* Class = Participant->GetClass();
+		const UClass* NativeClass = Class;
+		while (NativeClass && !NativeClass->HasAnyClassFlags(CLASS_Native))
+		{
+			NativeClass = NativeClass->GetSuperClass();
+		}
+		if (NativeClass && NativeClass->ImplementsInterface(USUDSParticipant::StaticClass()))
+		{
+			// We can't tell which _Implementation functions C++ has overridden, so call them all
+			Ret.Callbacks = ESUDSParticipantCallback::All;
+		}
+		else
+		{
+			// Blueprints only have their own version of the functions they implement; calling the others is a no-op
+			static const TPair<FName, ESUDSParticipantCallback> CallbackFunctions[] =
+			{
+				{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueStarting), ESUDSParticipantCallback::Starting },
+				{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueFinished), ESUDSParticipantCallback::Finished },
+				{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueSpeakerLine), ESUDSParticipantCallback::SpeakerLine },
+				{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueChoiceMade), ESUDSParticipantCallback::ChoiceMade },
+				{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueProceeding), ESUDSParticipantCallback::Proceeding },
+				{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueEvent), ESUDSParticipantCallback::Event },
+				{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueVariableChanged), ESUDSParticipantCallback::VariableChanged },
+				{ GET_FUNCTION_NAME_CHECKED(ISUDSParticipant, OnDialogueVariableRequested), ESUDSParticipantCallback::VariableRequested },
+			};
+			for (auto& Pair : CallbackFunctions)
 			{
-				return ISUDSParticipant::Execute_GetDialogueParticipantPriority(&A) <
-					ISUDSParticipant::Execute_GetDialogueParticipantPriority(&B);
+				const UFunction* Func = Class->FindFunctionByName(Pair.Key);
+				if (Func && Func->GetOuter() != USUDSParticipant::StaticClass())
+				{
+					Ret.Callbacks |= Pair.Value;
+				}
 			}
-			// Be deterministic
-			return &A < &B;
-		});
+		}
 	}
+	return Ret;
 }
 
 void USUDSDialogue::RunUntilNextSpeakerNodeOrEnd(USUDSScriptNode* NextNode, bool bRaiseAtEnd)
@@ -195,15 +466,14 @@ USUDSScriptNode* USUDSDialogue::RunSelectNode(USUDSScriptNode* Node)
 		if (Edge.GetCondition().IsValid())
 		{
 			// use the first satisfied edge
-			RaiseExpressionVariablesRequested(Edge.GetCondition(), Edge.GetSourceLineNo());
-			const bool bSuccess = Edge.GetCondition().EvaluateBoolean(VariableState, BaseScript->GetName());
+			const bool bSuccess = EvaluateCondition(Edge.GetCondition(), Edge.GetSourceLineNo());
 #if WITH_EDITOR
 			InternalOnSelectEval.ExecuteIfBound(this, Edge.GetCondition().GetSourceString(), bSuccess, Edge.GetSourceLineNo());
 #endif
 			
 			if (bSuccess)
 			{
-				return Edge.GetTargetNode().Get();
+				return GetEdgeTarget(Edge);
 			}
 		}
 	}
@@ -216,22 +486,52 @@ USUDSScriptNode* USUDSDialogue::RunEventNode(USUDSScriptNode* Node)
 {
 	if (USUDSScriptNodeEvent* EvtNode = Cast<USUDSScriptNodeEvent>(Node))
 	{
+		const FName EventName = EvtNode->GetEventName();
+		// The same subsystem which hosts global variables, so this works for pooled dialogues without a game world too
+		USUDSSubsystem* Sys = GlobalVariableHost.Get();
+		const bool bGlobalSubscribers = Sys && Sys->HasEventSubscribers(EventName);
+		const bool bDialogueSubscribers = EventSubscriptions.HasSubscribers(EventName);
+		bool bListeners = bParticipantsHandleEvents || OnEvent.IsBound();
+#if WITH_EDITOR
+		bListeners |= InternalOnEvent.IsBound();
+#endif
+		if (!bListeners && !bDialogueSubscribers && !bGlobalSubscribers)
+		{
+			// Nothing wants this event, so don't bother evaluating its arguments
+			return GetNextNode(Node);
+		}
+
 		// Build a resolved args list, because we need to evaluate  expressions
 		TArray<FSUDSValue> ArgsResolved;
+		ArgsResolved.Reserve(EvtNode->GetArgs().Num());
 		
 		for (auto& Expr : EvtNode->GetArgs())
 		{
-			RaiseExpressionVariablesRequested(Expr, EvtNode->GetSourceLineNo());
-			ArgsResolved.Add(Expr.Evaluate(VariableState));
+			ArgsResolved.Add(EvaluateExpression(Expr, EvtNode->GetSourceLineNo()));
 		}
 		
-		for (const auto P : Participants)
+		for (const auto& P : ParticipantDispatch)
 		{
-			if (P->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
+			if (P.Handles(ESUDSParticipantCallback::Event))
 			{
-				ISUDSParticipant::Execute_OnDialogueEvent(P, this, EvtNode->GetEventName(), ArgsResolved);
+				if (P.Native)
+				{
+					P.Native->NativeOnDialogueEvent(this, EvtNode->GetEventName(), ArgsResolved);
+				}
+				else
+				{
+					ISUDSParticipant::Execute_OnDialogueEvent(P.Object.Get(), this, EvtNode->GetEventName(), ArgsResolved);
+				}
 			}
 		}
+		if (bDialogueSubscribers)
+		{
+			EventSubscriptions.Dispatch(this, EventName, ArgsResolved);
+		}
+		if (bGlobalSubscribers)
+		{
+			Sys->DispatchEvent(this, EventName, ArgsResolved);
+		}
 		OnEvent.Broadcast(this, EvtNode->GetEventName(), ArgsResolved);
 #if WITH_EDITOR
 		InternalOnEvent.ExecuteIfBound(this, EvtNode->GetEventName(), ArgsResolved, EvtNode->GetSourceLineNo());
@@ -289,9 +589,12 @@ USUDSScriptNode* USUDSDialogue::RunSetVariableNode(USUDSScriptNode* Node)
 	{
 		if (SetNode->GetExpression().IsValid())
 		{
-			RaiseExpressionVariablesRequested(SetNode->GetExpression(), SetNode->GetSourceLineNo());
-			FSUDSValue Value = SetNode->GetExpression().Evaluate(VariableState);
-			SetVariableImpl(SetNode->GetIdentifier(), Value, true, SetNode->GetSourceLineNo());
+			FSUDSValue Value = EvaluateExpression(SetNode->GetExpression(), SetNode->GetSourceLineNo());
+			SetVariableImpl(SetNode->GetIdentifier(),
+			                SetNode->GetIdentifierSlot(),
+			                Value,
+			                true,
+			                SetNode->GetSourceLineNo());
 #if WITH_EDITOR
 			// We do this here so that we have access to the expression
 			InternalOnSetVar.ExecuteIfBound(this,
@@ -312,11 +615,18 @@ USUDSScriptNode* USUDSDialogue::RunSetVariableNode(USUDSScriptNode* Node)
 
 void USUDSDialogue::RaiseVariableChange(const FName& VarName, const FSUDSValue& Value, bool bFromScript, int LineNo)
 {
-	for (const auto P : Participants)
+	for (const auto& P : ParticipantDispatch)
 	{
-		if (P->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
+		if (P.Handles(ESUDSParticipantCallback::VariableChanged))
 		{
-			ISUDSParticipant::Execute_OnDialogueVariableChanged(P, this, VarName, Value, bFromScript);
+			if (P.Native)
+			{
+				P.Native->NativeOnDialogueVariableChanged(this, VarName, Value, bFromScript);
+			}
+			else
+			{
+				ISUDSParticipant::Execute_OnDialogueVariableChanged(P.Object.Get(), this, VarName, Value, bFromScript);
+			}
 		}
 	}
 	OnVariableChanged.Broadcast(this, VarName, Value, bFromScript);
@@ -332,13 +642,25 @@ void USUDSDialogue::RaiseVariableChange(const FName& VarName, const FSUDSValue&
 
 void USUDSDialogue::RaiseVariableRequested(const FName& VarName, int LineNo)
 {
+	// Global variables are read straight from the subsystem, nobody needs to supply them
+	if (GlobalVariableHost.IsValid() && IsSUDSGlobalVariableName(VarName))
+	{
+		return;
+	}
 	// Because variables set by participants should "win", raise event first
 	OnVariableRequested.Broadcast(this, VarName);
-	for (const auto P : Participants)
+	for (const auto& P : ParticipantDispatch)
 	{
-		if (P->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
+		if (P.Handles(ESUDSParticipantCallback::VariableRequested))
 		{
-			ISUDSParticipant::Execute_OnDialogueVariableRequested(P, this, VarName);
+			if (P.Native)
+			{
+				P.Native->NativeOnDialogueVariableRequested(this, VarName);
+			}
+			else
+			{
+				ISUDSParticipant::Execute_OnDialogueVariableRequested(P.Object.Get(), this, VarName);
+			}
 		}
 	}
 }
@@ -351,11 +673,49 @@ void USUDSDialogue::RaiseExpressionVariablesRequested(const FSUDSExpression& Exp
 	}
 }
 
+FSUDSValue USUDSDialogue::EvaluateExpression(const FSUDSExpression& Expression, int LineNo)
+{
+	// Literals (including expressions constant-folded at import) need no variables and no evaluation
+	if (Expression.IsLiteral())
+	{
+		return Expression.GetLiteralValue();
+	}
+	if (bLazyVariableRequests)
+	{
+		return Expression.Evaluate(GetExpressionVariables(), [this, LineNo](const FName& VarName)
+		{
+			RaiseVariableRequested(VarName, LineNo);
+		});
+	}
+	RaiseExpressionVariablesRequested(Expression, LineNo);
+	return Expression.Evaluate(GetExpressionVariables());
+}
+
+bool USUDSDialogue::EvaluateCondition(const FSUDSExpression& Expression, int LineNo)
+{
+	if (Expression.IsLiteral() && Expression.GetLiteralValue().GetType() == ESUDSValueType::Boolean)
+	{
+		return Expression.GetBooleanLiteralValue();
+	}
+	if (bLazyVariableRequests)
+	{
+		return Expression.EvaluateBoolean(GetExpressionVariables(),
+		                                  [this, LineNo](const FName& VarName)
+		                                  {
+			                                  RaiseVariableRequested(VarName, LineNo);
+		                                  },
+		                                  BaseScript->GetName());
+	}
+	RaiseExpressionVariablesRequested(Expression, LineNo);
+	return Expression.EvaluateBoolean(GetExpressionVariables(), BaseScript->GetName());
+}
+
 void USUDSDialogue::SetCurrentSpeakerNode(USUDSScriptNodeText* Node, bool bQuietly)
 {
 	CurrentSpeakerNode = Node;
 
 	CurrentSpeakerDisplayName = FText::GetEmpty();
+	CurrentTextCache = FSUDSResolvedTextCacheEntry();
 	bParamNamesExtracted = false;
 	if (Node)
 	{
@@ -365,7 +725,15 @@ void USUDSDialogue::SetCurrentSpeakerNode(USUDSScriptNodeText* Node, bool bQuiet
 	{
 		CurrentSourceLineNo = 0;
 	}
+	// Restoring state or resetting doesn't count as seeing the line
+	bCurrentLineSeenBefore = HasSpeakerLineNodeBeenSeen(Node);
+	if (Node && !bQuietly && LinesSeen.IsValidIndex(Node->GetLineOrdinal()))
+	{
+		LinesSeen[Node->GetLineOrdinal()] = true;
+	}
 	UpdateChoices();
+	RequestVoiceAssetsForCurrentLine();
+	UpdateVoicePrefetch(true);
 
 	if (!bQuietly)
 	{
@@ -377,28 +745,106 @@ void USUDSDialogue::SetCurrentSpeakerNode(USUDSScriptNodeText* Node, bool bQuiet
 
 }
 
-FText USUDSDialogue::ResolveParameterisedText(const TArray<FName> Params, const FTextFormat& TextFormat, int LineNo)
+template <typename TextSource>
+FText USUDSDialogue::ResolveParameterisedText(const TextSource& Source, FSUDSResolvedTextCacheEntry& Cache)
 {
+	const TArray<FName>& Params = Source.GetParameterNames();
+	const TArray<int>& Slots = Source.GetParameterSlots();
+	const int TextRevision = FTextLocalizationManager::Get().GetTextRevision();
+	if (bCacheResolvedText &&
+		Cache.bValid &&
+		Cache.TextRevision == TextRevision &&
+		Cache.VariablesVersion == GetVariablesVersion(Params, Slots))
+	{
+		return Cache.Text;
+	}
+
 	for (const auto& P : Params)
 	{
-		RaiseVariableRequested(P, LineNo);
+		RaiseVariableRequested(P, Source.GetSourceLineNo());
 	}
-	// Need to make a temp arg list for compatibility
-	// Also lets us just set the ones we need to
-	FFormatNamedArguments Args;
-	GetTextFormatArgs(Params, Args);
-	return FText::Format(TextFormat, Args);
+	// Only the arguments we need, with keys prepared in advance and values replaced in place when reformatting
+	GetTextFormatArgs(Params, Source.GetParameterKeys(), Slots, Cache.Args);
+	FText Result = FText::Format(Source.GetTextFormat(), Cache.Args);
+
+	if (bCacheResolvedText)
+	{
+		// Version taken after requests, since responding to them may have set variables
+		Cache.Text = Result;
+		Cache.VariablesVersion = GetVariablesVersion(Params, Slots);
+		Cache.TextRevision = TextRevision;
+		Cache.bValid = true;
+	}
+	return Result;
 	
 }
 
-void USUDSDialogue::GetTextFormatArgs(const TArray<FName>& ArgNames, FFormatNamedArguments& OutArgs) const
+uint32 USUDSDialogue::GetVariablesVersion(const TArray<FName>& Names, const TArray<int>& Slots) const
+{
+	// Versions only increase, so the highest changes if any of these variables change
+	uint32 Version = 0;
+	uint32 GlobalVersion = 0;
+	for (int i = 0; i < Names.Num(); ++i)
+	{
+		const int Slot = Slots.IsValidIndex(i) ? Slots[i] : GetVariableSlot(Names[i]);
+		if (Slot == SUDS_GLOBAL_VARIABLE_SLOT && GlobalVariableHost.IsValid())
+		{
+			GlobalVersion = GlobalVariableHost->GetGlobalVariablesVersion();
+			continue;
+		}
+		Version = FMath::Max(Version, VariableSlots.IsValidIndex(Slot) ? VariableSlots.GetVersion(Slot) : OverflowVariablesVersion);
+	}
+	// Global versions are counted separately, but also only increase, so the sum changes if either does
+	return Version + GlobalVersion;
+}
+
+const FSUDSValue* USUDSDialogue::FindGlobalVariable(const FName& Name) const
+{
+	return GlobalVariableHost->FindGlobalVariable(Name);
+}
+
+void USUDSDialogue::StoreGlobalVariable(const FName& Name, const FSUDSValue& Value)
+{
+	GlobalVariableHost->SetGlobalVariableImpl(Name, Value, this);
+}
+
+const USUDSDialogue::FSUDSValueMap* USUDSDialogue::GetGlobalVariableMap() const
+{
+	const USUDSSubsystem* Sys = GlobalVariableHost.Get();
+	return Sys ? &Sys->GetGlobalVariables() : nullptr;
+}
+
+void USUDSDialogue::SetResolvedTextCaching(bool bCache)
+{
+	bCacheResolvedText = bCache;
+	CurrentTextCache = FSUDSResolvedTextCacheEntry();
+	ChoiceTextCache.Reset();
+}
+
+void USUDSDialogue::GetTextFormatArgs(const TArray<FName>& ArgNames,
+                                      const TArray<FString>& ArgKeys,
+                                      const TArray<int>& ArgSlots,
+                                      FFormatNamedArguments& InOutArgs) const
 {
-	for (auto& Name : ArgNames)
+	for (int i = 0; i < ArgNames.Num(); ++i)
 	{
-		if (const FSUDSValue* Value = VariableState.Find(Name))
+		// Slots are resolved at import, but older assets may not have them
+		const int Slot = ArgSlots.IsValidIndex(i) ? ArgSlots[i] : GetVariableSlot(ArgNames[i]);
+		if (const FSUDSValue* Value = FindVariableInSlot(ArgNames[i], Slot))
 		{
 			// Use the operator conversion
-			OutArgs.Add(Name.ToString(), Value->ToFormatArg());
+			if (FFormatArgumentValue* Existing = InOutArgs.Find(ArgKeys[i]))
+			{
+				*Existing = Value->ToFormatArg();
+			}
+			else
+			{
+				InOutArgs.Add(ArgKeys[i], Value->ToFormatArg());
+			}
+		}
+		else
+		{
+			InOutArgs.Remove(ArgKeys[i]);
 		}
 	}
 }
@@ -409,9 +855,7 @@ FText USUDSDialogue::GetText()
 	{
 		if (CurrentSpeakerNode->HasParameters())
 		{
-			return ResolveParameterisedText(CurrentSpeakerNode->GetParameterNames(),
-			                                CurrentSpeakerNode->GetTextFormat(),
-			                                CurrentSpeakerNode->GetSourceLineNo());
+			return ResolveParameterisedText(*CurrentSpeakerNode, CurrentTextCache);
 		}
 		else
 		{
@@ -425,7 +869,7 @@ UDialogueWave* USUDSDialogue::GetWave() const
 {
 	if (CurrentSpeakerNode)
 	{
-		return CurrentSpeakerNode->GetWave();
+		return CurrentSpeakerNode->GetWave().LoadSynchronous();
 	}
 
 	return nullptr;
@@ -435,7 +879,7 @@ bool USUDSDialogue::IsCurrentLineVoiced() const
 {
 	if (CurrentSpeakerNode)
 	{
-		return IsValid(CurrentSpeakerNode->GetWave());
+		return !CurrentSpeakerNode->GetWave().IsNull();
 	}
 
 	return false;
@@ -456,9 +900,9 @@ FText USUDSDialogue::GetSpeakerDisplayName() const
 		// Derive speaker display name
 		// Is just a special variable "SpeakerName.SpeakerID"
 		// or just the SpeakerID if none specified
-		static const FString SpeakerIDPrefix = "SpeakerName.";
-		FName Key(SpeakerIDPrefix + GetSpeakerID());
-		if (auto Arg = VariableState.Find(Key))
+		// The variable name is precomputed in the script's speaker table
+		const FName Key = CurrentSpeakerNode ? BaseScript->GetSpeakerDisplayNameKey(CurrentSpeakerNode->GetSpeakerIndex()) : NAME_None;
+		if (auto Arg = Key.IsNone() ? nullptr : FindVariable(Key))
 		{
 			if (Arg->GetType() == ESUDSValueType::Text)
 			{
@@ -486,7 +930,7 @@ UDialogueVoice* USUDSDialogue::GetSpeakerVoice() const
 {
 	if (CurrentSpeakerNode)
 	{
-		return GetVoice(CurrentSpeakerNode->GetSpeakerID());
+		return BaseScript->GetSpeakerVoiceByIndex(CurrentSpeakerNode->GetSpeakerIndex());
 	}
 	return nullptr;
 }
@@ -501,13 +945,9 @@ UDialogueVoice* USUDSDialogue::GetTargetVoice() const
 	if (CurrentSpeakerNode)
 	{
 		// Assume that target is the first party that's NOT speaking
-		for (auto& Name : BaseScript->GetSpeakers())
-		{
-			if (Name != CurrentSpeakerNode->GetSpeakerID())
-			{
-				return BaseScript->GetSpeakerVoice(Name);
-			}
-		}
+		// Speakers are unique, so that's the first speaker unless it's the current one
+		const int TargetIndex = CurrentSpeakerNode->GetSpeakerIndex() == 0 ? 1 : 0;
+		return BaseScript->GetSpeakerVoiceByIndex(TargetIndex);
 	}
 	return nullptr;
 	
@@ -520,41 +960,209 @@ USoundBase* USUDSDialogue::GetSound(bool bAllowAnyTarget) const
 
 USoundBase* USUDSDialogue::GetSoundForCurrentLine(bool bAllowAnyTarget) const
 {
-	// UDialogueWave's contexts have both speakers and targets, but the GetWaveFromContext method is too restrictive
-	// Instead we'll search the contexts ourselves and be more fuzzy
+	// The line caches which context matches, so this only searches the wave's contexts the first time
 	if (auto Wave = GetWave())
 	{
-		auto SpeakerVoice = GetSpeakerVoice();
-		auto TargetVoice = GetTargetVoice();
-		for (auto& Ctx : Wave->ContextMappings)
+		return CurrentSpeakerNode->GetVoiceSound(Wave, GetSpeakerVoice(), GetTargetVoice(), bAllowAnyTarget);
+	}
+
+	return nullptr;
+}
+
+void USUDSDialogue::RequestVoiceAssetsForCurrentLine()
+{
+	// Start streaming the wave for this line, plus the voices needed to pick a sound from it, so that it's ready
+	// (or nearly) when the line is played
+	TArray<FSoftObjectPath> Paths;
+	if (CurrentSpeakerNode && !CurrentSpeakerNode->GetWave().IsNull())
+	{
+		Paths.Add(CurrentSpeakerNode->GetWave().ToSoftObjectPath());
+		for (auto& Pair : BaseScript->GetSpeakerVoices())
 		{
-			// Match specific target voice first, and unspecified targets
-			if (Ctx.Context.Speaker == SpeakerVoice)
+			if (!Pair.Value.IsNull())
 			{
-				if (Ctx.Context.Targets.Contains(TargetVoice))
-				{
-					// Need to use the proxy according to DialogueWave
-					return Ctx.Proxy;
-				}
+				Paths.AddUnique(Pair.Value.ToSoftObjectPath());
+			}
+		}
+	}
+
+	// Request the new assets before releasing the previous ones, so voices used by both stay loaded
+	TSharedPtr<FStreamableHandle> PrevHandle = MoveTemp(VoiceAssetsHandle);
+	if (Paths.Num() > 0 && UAssetManager::IsInitialized())
+	{
+		VoiceAssetsHandle = UAssetManager::GetStreamableManager().RequestAsyncLoad(Paths,
+			FStreamableDelegate(),
+			FStreamableManager::AsyncLoadHighPriority);
+	}
+	if (PrevHandle.IsValid())
+	{
+		PrevHandle->ReleaseHandle();
+	}
+}
+
+void USUDSDialogue::SetVoicePrefetchDepth(int Depth)
+{
+	VoicePrefetchDepth = FMath::Max(Depth, 0);
+	// No line has been reached, so just request for the new depth
+	UpdateVoicePrefetch(false);
+}
+
+void USUDSDialogue::UpdateVoicePrefetch(bool bLineReached)
+{
+	if (bLineReached && VoicePrefetchDepth > 0 && CurrentSpeakerNode && !CurrentSpeakerNode->GetWave().IsNull())
+	{
+		if (PrefetchedLines.Contains(CurrentSpeakerNode) && CurrentSpeakerNode->GetWave().Get())
+		{
+			++VoicePrefetchStats.Hits;
+		}
+		else
+		{
+			++VoicePrefetchStats.Misses;
+		}
+	}
+
+	TSet<const USUDSScriptNodeText*> UpcomingLines;
+	if (VoicePrefetchDepth > 0 && CurrentSpeakerNode)
+	{
+		// Bound the walk in case of loops with no speaker lines
+		int StepsLeft = 256;
+		if (CurrentNodeHasChoices())
+		{
+			// Choices have already been filtered by their conditions
+			for (auto& Choice : CurrentChoices)
+			{
+				GatherUpcomingVoicedLines(GetEdgeTarget(Choice), VoicePrefetchDepth, StepsLeft, UpcomingLines);
+			}
+		}
+		else if (auto Edge = CurrentSpeakerNode->GetEdge(0))
+		{
+			GatherUpcomingVoicedLines(GetEdgeTarget(*Edge), VoicePrefetchDepth, StepsLeft, UpcomingLines);
+		}
+	}
+
+	if (bLineReached)
+	{
+		for (auto Line : PrefetchedLines)
+		{
+			if (Line != CurrentSpeakerNode && !UpcomingLines.Contains(Line))
+			{
+				++VoicePrefetchStats.Wasted;
 			}
 		}
-		// If we got here, match more leniently
-		if (bAllowAnyTarget)
+	}
+
+	TArray<FSoftObjectPath> Paths;
+	TArray<TSoftObjectPtr<UDialogueWave>> Waves;
+	for (auto Line : UpcomingLines)
+	{
+		Paths.Add(Line->GetWave().ToSoftObjectPath());
+		Waves.Add(Line->GetWave());
+	}
+
+	// As with the current line, request before releasing so anything still needed stays loaded
+	TSharedPtr<FStreamableHandle> PrevHandle = MoveTemp(PrefetchHandle);
+	PrefetchedLines = MoveTemp(UpcomingLines);
+	if (Paths.Num() > 0 && UAssetManager::IsInitialized())
+	{
+		PrefetchHandle = UAssetManager::GetStreamableManager().RequestAsyncLoad(Paths,
+			FStreamableDelegate::CreateWeakLambda(this, [Waves]()
+			{
+				for (auto& Wave : Waves)
+				{
+					PrimeWaveSounds(Wave.Get());
+				}
+			}));
+	}
+	if (PrevHandle.IsValid())
+	{
+		PrevHandle->ReleaseHandle();
+	}
+}
+
+void USUDSDialogue::GatherUpcomingVoicedLines(const USUDSScriptNode* FromNode,
+                                              int DepthLeft,
+                                              int& StepsLeft,
+                                              TSet<const USUDSScriptNodeText*>& OutLines) const
+{
+	// Like RecurseWalkToNextChoiceOrTextNode but without running anything; we only follow paths we can predict
+	const USUDSScriptNode* Node = FromNode;
+	while (Node && DepthLeft > 0 && StepsLeft-- > 0)
+	{
+		switch (Node->GetNodeType())
 		{
-			for (auto& Ctx : Wave->ContextMappings)
+		case ESUDSScriptNodeType::Text:
 			{
-				// Match specific target voice first, and unspecified targets
-				if (Ctx.Context.Speaker == SpeakerVoice)
+				const USUDSScriptNodeText* TextNode = static_cast<const USUDSScriptNodeText*>(Node);
+				bool bAlreadyVisited = false;
+				if (!TextNode->GetWave().IsNull())
 				{
-					// Need to use the proxy according to DialogueWave
-					return Ctx.Proxy;
+					OutLines.Add(TextNode, &bAlreadyVisited);
 				}
+				if (bAlreadyVisited || --DepthLeft == 0)
+				{
+					return;
+				}
+				Node = Node->GetEdgeCount() == 1 ? GetEdgeTarget(*Node->GetEdge(0)) : nullptr;
+				break;
 			}
-			
+		case ESUDSScriptNodeType::Choice:
+			// Any choice could be picked
+			for (auto& Edge : Node->GetEdges())
+			{
+				GatherUpcomingVoicedLines(GetEdgeTarget(Edge), DepthLeft, StepsLeft, OutLines);
+			}
+			return;
+		case ESUDSScriptNodeType::Select:
+			{
+				// Resolve using the current variable state, without raising variable requests
+				const USUDSScriptNode* Selected = nullptr;
+				for (auto& Edge : Node->GetEdges())
+				{
+					if (Edge.GetCondition().IsValid())
+					{
+						const FSUDSValue Result = Edge.GetCondition().Evaluate(GetExpressionVariables());
+						if (Result.GetType() == ESUDSValueType::Boolean && Result.GetBooleanValue())
+						{
+							Selected = GetEdgeTarget(Edge);
+							break;
+						}
+					}
+				}
+				Node = Selected;
+				break;
+			}
+		case ESUDSScriptNodeType::SetVariable:
+		case ESUDSScriptNodeType::Event:
+			Node = Node->GetEdgeCount() == 1 ? GetEdgeTarget(*Node->GetEdge(0)) : nullptr;
+			break;
+		case ESUDSScriptNodeType::Gosub:
+			if (auto GosubNode = Cast<USUDSScriptNodeGosub>(Node))
+			{
+				Node = BaseScript->GetNodeByLabel(GosubNode->GetLabelName());
+				break;
+			}
+			return;
+		default:
+		case ESUDSScriptNodeType::Return:
+			// Where we return to isn't known without the gosub stack at that point
+			return;
 		}
 	}
+}
 
-	return nullptr;
+void USUDSDialogue::PrimeWaveSounds(const UDialogueWave* Wave)
+{
+	if (Wave)
+	{
+		// Load the first chunk of streamed audio so that playback can start immediately
+		for (auto& Ctx : Wave->ContextMappings)
+		{
+			if (Ctx.SoundWave)
+			{
+				UGameplayStatics::PrimeSound(Ctx.SoundWave);
+			}
+		}
+	}
 }
 
 USoundConcurrency* USUDSDialogue::GetVoiceSoundConcurrency() const
@@ -637,10 +1245,24 @@ USUDSScriptNode* USUDSDialogue::GetNextNode(USUDSScriptNode* Node)
 	}
 	else
 	{
-		return BaseScript->GetNextNode(Node);
+		switch (Node->GetEdgeCount())
+		{
+		case 0:
+			return nullptr;
+		case 1:
+			return GetEdgeTarget(*Node->GetEdge(0));
+		default:
+			UE_LOG(LogSUDSDialogue, Error, TEXT("Called GetNextNode on a node with more than one edge"));
+			return nullptr;
+		}
 	}
 }
 
+USUDSScriptNode* USUDSDialogue::GetEdgeTarget(const FSUDSScriptEdge& Edge) const
+{
+	return BaseScript->GetEdgeTargetNode(Edge, bRunningHeader);
+}
+
 bool USUDSDialogue::IsChoiceOrTextNode(ESUDSScriptNodeType Type)
 {
 	return Type == ESUDSScriptNodeType::Text || Type == ESUDSScriptNodeType::Choice;
@@ -749,23 +1371,27 @@ void USUDSDialogue::RecurseAppendChoices(const USUDSScriptNode* Node, TArray<FSU
 		switch (Edge.GetType())
 		{
 		case ESUDSEdgeType::Decision:
+			// Make sure the script's own format is compiled, so the copy shares it rather than compiling its own
+			if (Edge.HasParameters())
+			{
+				Edge.GetTextFormat();
+			}
 			OutChoices.Add(Edge);
 			break;
 		case ESUDSEdgeType::Condition:
 			// Conditional edges are under selects
 			if (Edge.GetCondition().IsValid())
 			{
-				RaiseExpressionVariablesRequested(Edge.GetCondition(), Edge.GetSourceLineNo());
-				if (Edge.GetCondition().EvaluateBoolean(VariableState, BaseScript->GetName()))
+				if (EvaluateCondition(Edge.GetCondition(), Edge.GetSourceLineNo()))
 				{
-					RecurseAppendChoices(Edge.GetTargetNode().Get(), OutChoices);
+					RecurseAppendChoices(GetEdgeTarget(Edge), OutChoices);
 					// When we choose a path on a select, we don't check the other paths, we can only go down one
 					return;
 				}
 			}
 			break;
 		case ESUDSEdgeType::Chained:
-			RecurseAppendChoices(Edge.GetTargetNode().Get(), OutChoices);
+			RecurseAppendChoices(GetEdgeTarget(Edge), OutChoices);
 			break;
 		default:
 		case ESUDSEdgeType::Continue:
@@ -779,12 +1405,26 @@ void USUDSDialogue::RecurseAppendChoices(const USUDSScriptNode* Node, TArray<FSU
 void USUDSDialogue::UpdateChoices()
 {
 	CurrentChoices.Reset();
+	ChoiceTextCache.Reset();
 	CurrentRootChoiceNode = nullptr;
 	if (CurrentSpeakerNode)
 	{
+		if (CurrentSpeakerNode->GetRootChoiceNodeIndex() != INDEX_NONE)
+		{
+			// The path to the choices was resolved at import; just run any set/event nodes before them
+			for (const int NodeIndex : CurrentSpeakerNode->GetPreChoiceNodeIndices())
+			{
+				if (auto Node = BaseScript->GetNodeByIndex(NodeIndex))
+				{
+					RunNode(Node);
+				}
+			}
+			CurrentRootChoiceNode = BaseScript->GetNodeByIndex(CurrentSpeakerNode->GetRootChoiceNodeIndex());
+			RecurseAppendChoices(CurrentRootChoiceNode, CurrentChoices);
+		}
 		// If we've either found choices through static checking (on one or other select paths), we look for them now
 		// We also check if we're inside a gosub, since the call site changes whether there may be choices or not
-		if (CurrentSpeakerNode->MayHaveChoices() ||
+		else if (CurrentSpeakerNode->MayHaveChoices() ||
 			GosubReturnStack.Num() > 0)
 		{
 			// We MIGHT have a choice; conditionals can result in HasChoices() being true but the current state not actually
@@ -833,7 +1473,11 @@ FText USUDSDialogue::GetChoiceText(int Index)
 		auto& Choice = CurrentChoices[Index];
 		if (Choice.HasParameters())
 		{
-			return ResolveParameterisedText(Choice.GetParameterNames(), Choice.GetTextFormat(), Choice.GetSourceLineNo());
+			if (ChoiceTextCache.Num() != CurrentChoices.Num())
+			{
+				ChoiceTextCache.SetNum(CurrentChoices.Num());
+			}
+			return ResolveParameterisedText(Choice, ChoiceTextCache[Index]);
 		}
 		else
 		{
@@ -859,7 +1503,24 @@ bool USUDSDialogue::HasChoiceIndexBeenTakenPreviously(int Index)
 
 bool USUDSDialogue::HasChoiceBeenTakenPreviously(const FSUDSScriptEdge& Choice)
 {
-	return ChoicesTaken.Contains(Choice.GetTextID());
+	int Ordinal = Choice.GetChoiceOrdinal();
+	if (Ordinal == INDEX_NONE && BaseScript)
+	{
+		// Not one of the script's own edges
+		Ordinal = BaseScript->GetChoiceOrdinalByTextID(Choice.GetTextID());
+	}
+	return ChoicesTaken.IsValidIndex(Ordinal) && ChoicesTaken[Ordinal];
+}
+
+bool USUDSDialogue::HasSpeakerLineBeenSeen(const FString& TextID) const
+{
+	const int Ordinal = BaseScript ? BaseScript->GetLineOrdinalByTextID(TextID) : INDEX_NONE;
+	return LinesSeen.IsValidIndex(Ordinal) && LinesSeen[Ordinal];
+}
+
+bool USUDSDialogue::HasSpeakerLineNodeBeenSeen(const USUDSScriptNodeText* Node) const
+{
+	return Node && LinesSeen.IsValidIndex(Node->GetLineOrdinal()) && LinesSeen[Node->GetLineOrdinal()];
 }
 
 bool USUDSDialogue::Continue()
@@ -880,7 +1541,10 @@ bool USUDSDialogue::Choose(int Index)
 		if (CurrentNodeHasChoices())
 		{
 			const auto& Choice = CurrentChoices[Index]; 
-			ChoicesTaken.Add(Choice.GetTextID());
+			if (ChoicesTaken.IsValidIndex(Choice.GetChoiceOrdinal()))
+			{
+				ChoicesTaken[Choice.GetChoiceOrdinal()] = true;
+			}
 			
 			RaiseChoiceMade(Index, Choice.GetSourceLineNo());
 			RaiseProceeding();
@@ -890,7 +1554,7 @@ bool USUDSDialogue::Choose(int Index)
 			RaiseProceeding();
 		}
 		// Then choose path
-		RunUntilNextSpeakerNodeOrEnd(CurrentChoices[Index].GetTargetNode().Get(), true);
+		RunUntilNextSpeakerNodeOrEnd(GetEdgeTarget(CurrentChoices[Index]), true);
 		return !IsEnded();
 	}
 	else
@@ -927,7 +1591,7 @@ void USUDSDialogue::ResetState(bool bResetVariables, bool bResetPosition, bool b
 	if (bResetPosition)
 		SetCurrentSpeakerNode(nullptr, true);
 	if (bResetVisited)
-		ChoicesTaken.Reset();
+		ResetVisited();
 }
 
 FSUDSDialogueState USUDSDialogue::GetSavedState() const
@@ -945,7 +1609,25 @@ FSUDSDialogueState USUDSDialogue::GetSavedState() const
 		}
 		
 	}
-	return FSUDSDialogueState(CurrentNodeId, VariableState, ChoicesTaken, ExportReturnStack);
+	// Text IDs as well as bits, so that state can still be restored if the script is edited
+	TArray<FString> ChoiceIDs;
+	for (TConstSetBitIterator<> It(ChoicesTaken); It; ++It)
+	{
+		ChoiceIDs.Add(BaseScript->GetChoiceTextID(It.GetIndex()));
+	}
+	TArray<FString> LineIDs;
+	for (TConstSetBitIterator<> It(LinesSeen); It; ++It)
+	{
+		LineIDs.Add(BaseScript->GetLineTextID(It.GetIndex()));
+	}
+	return FSUDSDialogueState(CurrentNodeId,
+	                          GetVariables(),
+	                          ChoiceIDs,
+	                          LineIDs,
+	                          PackBits(ChoicesTaken),
+	                          PackBits(LinesSeen),
+	                          BaseScript->GetOrdinalLayoutHash(),
+	                          ExportReturnStack);
 		  
 }
 
@@ -954,9 +1636,51 @@ void USUDSDialogue::RestoreSavedState(const FSUDSDialogueState& State)
 	// Don't just empty variables
 	// Re-run init to ensure header state is initialised then merge; important for it script is altered since state saved
 	InitVariables();
-	VariableState.Append(State.GetVariables());
-	ChoicesTaken.Empty();
-	ChoicesTaken.Append(State.GetChoicesTaken());
+	for (auto& Pair : State.GetVariables())
+	{
+		const int Slot = GetVariableSlot(Pair.Key);
+		if (Slot == SUDS_GLOBAL_VARIABLE_SLOT && GlobalVariableHost.IsValid())
+		{
+			// Global variables are saved & restored with the subsystem, see USUDSSubsystem::GetGlobalVariablesState
+			continue;
+		}
+		if (VariableSlots.IsValidIndex(Slot))
+		{
+			// Saved state includes header defaults, don't take our own copy of those
+			const FSUDSValue& Current = VariableSlots.Get(Slot);
+			if (Current.GetType() == Pair.Value.GetType() && !(Current != Pair.Value).GetBooleanValue())
+			{
+				continue;
+			}
+		}
+		StoreVariable(Pair.Key, Slot, Pair.Value);
+	}
+	ResetVisited();
+	if (State.GetOrdinalLayoutHash() != 0 && State.GetOrdinalLayoutHash() == BaseScript->GetOrdinalLayoutHash())
+	{
+		UnpackBits(State.GetChoicesTakenBits(), ChoicesTaken);
+		UnpackBits(State.GetLinesSeenBits(), LinesSeen);
+	}
+	else
+	{
+		// Saved before ordinals existed, or the script has changed since
+		for (const FString& ID : State.GetChoicesTaken())
+		{
+			const int Ordinal = BaseScript->GetChoiceOrdinalByTextID(ID);
+			if (ChoicesTaken.IsValidIndex(Ordinal))
+			{
+				ChoicesTaken[Ordinal] = true;
+			}
+		}
+		for (const FString& ID : State.GetLinesSeen())
+		{
+			const int Ordinal = BaseScript->GetLineOrdinalByTextID(ID);
+			if (LinesSeen.IsValidIndex(Ordinal))
+			{
+				LinesSeen[Ordinal] = true;
+			}
+		}
+	}
 	GosubReturnStack.Empty();
 	for (auto ID : State.GetReturnStack())
 	{
@@ -995,7 +1719,7 @@ void USUDSDialogue::Restart(bool bResetState, FName StartLabel, bool bReRunHeade
 	if (!bResetState && bReRunHeader)
 	{
 		// Run header nodes but don't re-init
-		RunUntilNextSpeakerNodeOrEnd(BaseScript->GetHeaderNode(), false);
+		RunHeader();
 	}
 
 	if (StartLabel != NAME_None)
@@ -1053,11 +1777,18 @@ TSet<FName> USUDSDialogue::GetParametersInUse()
 
 void USUDSDialogue::RaiseStarting(FName StartLabel)
 {
-	for (const auto P : Participants)
+	for (const auto& P : ParticipantDispatch)
 	{
-		if (P->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
+		if (P.Handles(ESUDSParticipantCallback::Starting))
 		{
-			ISUDSParticipant::Execute_OnDialogueStarting(P, this, StartLabel);
+			if (P.Native)
+			{
+				P.Native->NativeOnDialogueStarting(this, StartLabel);
+			}
+			else
+			{
+				ISUDSParticipant::Execute_OnDialogueStarting(P.Object.Get(), this, StartLabel);
+			}
 		}
 	}
 	OnStarting.Broadcast(this, StartLabel);
@@ -1068,11 +1799,18 @@ void USUDSDialogue::RaiseStarting(FName StartLabel)
 
 void USUDSDialogue::RaiseFinished()
 {
-	for (const auto P : Participants)
+	for (const auto& P : ParticipantDispatch)
 	{
-		if (P->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
+		if (P.Handles(ESUDSParticipantCallback::Finished))
 		{
-			ISUDSParticipant::Execute_OnDialogueFinished(P, this);
+			if (P.Native)
+			{
+				P.Native->NativeOnDialogueFinished(this);
+			}
+			else
+			{
+				ISUDSParticipant::Execute_OnDialogueFinished(P.Object.Get(), this);
+			}
 		}
 	}
 	OnFinished.Broadcast(this);
@@ -1084,11 +1822,18 @@ void USUDSDialogue::RaiseFinished()
 
 void USUDSDialogue::RaiseNewSpeakerLine()
 {
-	for (const auto P : Participants)
+	for (const auto& P : ParticipantDispatch)
 	{
-		if (P->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
+		if (P.Handles(ESUDSParticipantCallback::SpeakerLine))
 		{
-			ISUDSParticipant::Execute_OnDialogueSpeakerLine(P, this);
+			if (P.Native)
+			{
+				P.Native->NativeOnDialogueSpeakerLine(this);
+			}
+			else
+			{
+				ISUDSParticipant::Execute_OnDialogueSpeakerLine(P.Object.Get(), this);
+			}
 		}
 	}
 	
@@ -1101,11 +1846,18 @@ void USUDSDialogue::RaiseNewSpeakerLine()
 
 void USUDSDialogue::RaiseChoiceMade(int Index, int LineNo)
 {
-	for (const auto P : Participants)
+	for (const auto& P : ParticipantDispatch)
 	{
-		if (P->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
+		if (P.Handles(ESUDSParticipantCallback::ChoiceMade))
 		{
-			ISUDSParticipant::Execute_OnDialogueChoiceMade(P, this, Index);
+			if (P.Native)
+			{
+				P.Native->NativeOnDialogueChoiceMade(this, Index);
+			}
+			else
+			{
+				ISUDSParticipant::Execute_OnDialogueChoiceMade(P.Object.Get(), this, Index);
+			}
 		}
 	}
 	// Event listeners get it after
@@ -1117,11 +1869,18 @@ void USUDSDialogue::RaiseChoiceMade(int Index, int LineNo)
 
 void USUDSDialogue::RaiseProceeding()
 {
-	for (const auto P : Participants)
+	for (const auto& P : ParticipantDispatch)
 	{
-		if (P->GetClass()->ImplementsInterface(USUDSParticipant::StaticClass()))
+		if (P.Handles(ESUDSParticipantCallback::Proceeding))
 		{
-			ISUDSParticipant::Execute_OnDialogueProceeding(P, this);
+			if (P.Native)
+			{
+				P.Native->NativeOnDialogueProceeding(this);
+			}
+			else
+			{
+				ISUDSParticipant::Execute_OnDialogueProceeding(P.Object.Get(), this);
+			}
 		}
 	}
 	// Event listeners get it after
@@ -1133,7 +1892,7 @@ void USUDSDialogue::RaiseProceeding()
 
 FText USUDSDialogue::GetVariableText(FName Name) const
 {
-	if (const auto Arg = VariableState.Find(Name))
+	if (const auto Arg = FindVariable(Name))
 	{
 		if (Arg->GetType() == ESUDSValueType::Text)
 		{
@@ -1154,7 +1913,7 @@ void USUDSDialogue::SetVariableInt(FName Name, int32 Value)
 
 int USUDSDialogue::GetVariableInt(FName Name) const
 {
-	if (const auto Arg = VariableState.Find(Name))
+	if (const auto Arg = FindVariable(Name))
 	{
 		switch (Arg->GetType())
 		{
@@ -1179,7 +1938,7 @@ void USUDSDialogue::SetVariableFloat(FName Name, float Value)
 
 float USUDSDialogue::GetVariableFloat(FName Name) const
 {
-	if (const auto Arg = VariableState.Find(Name))
+	if (const auto Arg = FindVariable(Name))
 	{
 		switch (Arg->GetType())
 		{
@@ -1203,7 +1962,7 @@ void USUDSDialogue::SetVariableGender(FName Name, ETextGender Value)
 
 ETextGender USUDSDialogue::GetVariableGender(FName Name) const
 {
-	if (const auto Arg = VariableState.Find(Name))
+	if (const auto Arg = FindVariable(Name))
 	{
 		switch (Arg->GetType())
 		{
@@ -1227,7 +1986,7 @@ void USUDSDialogue::SetVariableBoolean(FName Name, bool Value)
 
 bool USUDSDialogue::GetVariableBoolean(FName Name) const
 {
-	if (const auto Arg = VariableState.Find(Name))
+	if (const auto Arg = FindVariable(Name))
 	{
 		switch (Arg->GetType())
 		{
@@ -1252,7 +2011,7 @@ void USUDSDialogue::SetVariableName(FName Name, FName Value)
 
 FName USUDSDialogue::GetVariableName(FName Name) const
 {
-	if (const auto Arg = VariableState.Find(Name))
+	if (const auto Arg = FindVariable(Name))
 	{
 		if (Arg->GetType() == ESUDSValueType::Name)
 		{
@@ -1266,7 +2025,27 @@ FName USUDSDialogue::GetVariableName(FName Name) const
 	return NAME_None;
 }
 
+TMap<FName, FSUDSValue> USUDSDialogue::GetVariables() const
+{
+	FSUDSValueMap Ret(OverflowVariables);
+	const TArray<FName>& SlotNames = BaseScript->GetVariableSlotNames();
+	for (int i = 0; i < VariableSlots.Num(); ++i)
+	{
+		const FSUDSValue& Value = VariableSlots.Get(i);
+		if (!Value.IsEmpty())
+		{
+			Ret.Add(SlotNames[i], Value);
+		}
+	}
+	return Ret;
+}
+
+int USUDSDialogue::GetVariableSlot(const FName& Name) const
+{
+	return BaseScript ? BaseScript->GetVariableSlot(Name) : INDEX_NONE;
+}
+
 void USUDSDialogue::UnSetVariable(FName Name)
 {
-	VariableState.Remove(Name);
+	StoreVariable(Name, GetVariableSlot(Name), FSUDSValue());
 }
@@ -0,0 +1,74 @@
+﻿// Copyright Steve Streeting 2022
+// Released under the MIT license https://opensource.org/license/MIT/
+#include "SUDSEventSubscriptions.h"
+
+void FSUDSEventSubscriptions::Subscribe(FName EventName, const FOnSUDSNamedEvent& Handler)
+{
+	if (Handler.IsBound())
+	{
+		Handlers.FindOrAdd(EventName).AddUnique(Handler);
+	}
+}
+
+/// The signature function generated for FOnSUDSNamedEvent
+static const UFunction* GetNamedEventSignature()
+{
+	static const UFunction* Signature = FindObject<UFunction>(nullptr, TEXT("/Script/SUDS.OnSUDSNamedEvent__DelegateSignature"));
+	return Signature;
+}
+
+bool FSUDSEventSubscriptions::SubscribeFunction(FName EventName, UObject* Object, FName FunctionName)
+{
+	const UFunction* Func = IsValid(Object) ? Object->FindFunction(FunctionName) : nullptr;
+	const UFunction* Signature = GetNamedEventSignature();
+	if (!Func || !Signature || !Func->IsSignatureCompatibleWith(Signature))
+	{
+		return false;
+	}
+
+	FOnSUDSNamedEvent Handler;
+	Handler.BindUFunction(Object, FunctionName);
+	Subscribe(EventName, Handler);
+	return true;
+}
+
+void FSUDSEventSubscriptions::Unsubscribe(FName EventName, const FOnSUDSNamedEvent& Handler)
+{
+	if (TArray<FOnSUDSNamedEvent>* pHandlers = Handlers.Find(EventName))
+	{
+		pHandlers->Remove(Handler);
+		// Remove empty lists so that HasSubscribers stays accurate
+		if (pHandlers->IsEmpty())
+		{
+			Handlers.Remove(EventName);
+		}
+	}
+}
+
+void FSUDSEventSubscriptions::UnsubscribeAll(const UObject* Object)
+{
+	for (auto It = Handlers.CreateIterator(); It; ++It)
+	{
+		It.Value().RemoveAll([Object](const FOnSUDSNamedEvent& Handler)
+		{
+			return Handler.IsBoundToObject(Object);
+		});
+		if (It.Value().IsEmpty())
+		{
+			It.RemoveCurrent();
+		}
+	}
+}
+
+void FSUDSEventSubscriptions::Dispatch(USUDSDialogue* Dialogue, FName EventName, const TArray<FSUDSValue>& Arguments) const
+{
+	if (const TArray<FOnSUDSNamedEvent>* pHandlers = Handlers.Find(EventName))
+	{
+		// Copy in case handlers subscribe / unsubscribe while we're calling them
+		const TArray<FOnSUDSNamedEvent, TInlineAllocator<4>> HandlersToCall(*pHandlers);
+		for (auto& Handler : HandlersToCall)
+		{
+			Handler.ExecuteIfBound(Dialogue, EventName, Arguments);
+		}
+	}
+}
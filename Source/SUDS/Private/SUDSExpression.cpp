@@ -2,8 +2,8 @@
 // Released under the MIT license https://opensource.org/license/MIT/
 #include "SUDSExpression.h"
 
+#include "SUDSExpressionLexer.h"
 #include "Misc/DefaultValueHelper.h"
-#include "Internationalization/Regex.h"
 
 bool FSUDSExpression::ParseFromString(const FString& Expression, FString* OutParseError)
 {
@@ -11,6 +11,9 @@ bool FSUDSExpression::ParseFromString(const FString& Expression, FString* OutPar
 	bIsValid = false;
 	Queue.Empty();
 	VariableNames.Empty();
+	ByteCode.Empty();
+	Literals.Empty();
+	MaxStackDepth = 0;
 	SourceString = Expression;
 	
 	// Shunting-yard algorithm
@@ -19,25 +22,16 @@ bool FSUDSExpression::ParseFromString(const FString& Expression, FString* OutPar
 	// expressed in Reverse Polish Notation, which can be easily executed later
 	// Variables are not resolved at this point, only at execution time.
 	
-	// Split into individual tokens; sections of the regex are:
-	// - {Variable}
-	// - Literal numbers (with or without decimal point, with or without preceding negation)
-	// - Arithmetic operators & parentheses
-	// - Boolean operators & comparisons
-	// - Predefined constants (Masculine, feminine, true, false etc)
-	// - Quoted strings "string"
-	// - Quoted names `name`
-	const FRegexPattern Pattern(TEXT("(\\{[\\w\\.]+\\}|-?\\d+(?:\\.\\d*)?|[-+*\\/\\(\\)]|and|&&|\\|\\||or|not|\\<\\>|!=|!|\\<=?|\\>=?|==?|[mM]asculine|[fF]eminine|[nN]euter|[tT]rue|[fF]alse|\\\"([^\\\"]*)\\\"|`([^`]*)`)"));
-	FRegexMatcher Regex(Pattern, Expression);
+	FSUDSExpressionLexer Lexer(Expression);
 	// Stacks that we use to construct
 	TArray<ESUDSExpressionItemType> OperatorStack;
 	bool bParsedSomething = false;
 	bool bErrors = false;
-	while (Regex.FindNext())
+	ESUDSExpressionItemType OpType;
+	FSUDSValue Operand;
+	while (Lexer.Next(OpType, Operand))
 	{
-		FString Str = Regex.GetCaptureGroup(1);
-		ESUDSExpressionItemType OpType = ParseOperator(Str);
-		if (OpType != ESUDSExpressionItemType::Null)
+		if (OpType != ESUDSExpressionItemType::Operand)
 		{
 			bParsedSomething = true;
 
@@ -92,19 +86,8 @@ bool FSUDSExpression::ParseFromString(const FString& Expression, FString* OutPar
 		}
 		else
 		{
-			// Attempt to parse operand
-			FSUDSValue Operand;
-			if (ParseOperand(Str, Operand))
-			{
-				bParsedSomething = true;
-				Queue.Add(FSUDSExpressionItem(Operand));
-			}
-			else
-			{
-				if (OutParseError)
-					*OutParseError = FString::Printf(TEXT("Unrecognised token %s"), *Str);
-				bErrors = true;
-			}
+			bParsedSomething = true;
+			Queue.Add(FSUDSExpressionItem(Operand));
 		}
 	}
 	// finish up
@@ -132,17 +115,17 @@ bool FSUDSExpression::ParseFromString(const FString& Expression, FString* OutPar
 
 	bIsValid = bParsedSomething && !bErrors;
 
-	// Build list of variables
 	if (bIsValid)
 	{
-		for (auto& Item : Queue)
-		{
-			if (Item.IsOperand() && Item.GetOperandValue().IsVariable())
-			{
-				VariableNames.AddUnique(Item.GetOperandValue().GetVariableNameValue());
-			}
-		}
+		Optimise();
+	}
 
+	// Lower to byte code, this also builds the list of variables
+	if (bIsValid && !Compile())
+	{
+		bIsValid = false;
+		if (OutParseError)
+			*OutParseError = FString::Printf(TEXT("Expression '%s' is too complex"), *Expression);
 	}
 
 	return bIsValid;
@@ -218,36 +201,26 @@ bool FSUDSExpression::ParseOperand(const FString& ValueStr, FSUDSValue& OutVal)
 			return true;
 		}
 	}
-	// Try quoted text (will be localised later in asset conversion)
+	// Try quoted text (will be localised later in asset conversion), names and variables
+	if (ValueStr.Len() >= 2)
 	{
-		const FRegexPattern Pattern(TEXT("^\\\"([^\\\"]*)\\\"$"));
-		FRegexMatcher Regex(Pattern, ValueStr);
-		if (Regex.FindNext())
+		const TCHAR First = ValueStr[0];
+		const TCHAR Last = ValueStr[ValueStr.Len() - 1];
+		const FStringView Contents = FStringView(ValueStr).Mid(1, ValueStr.Len() - 2);
+		int32 Unused;
+		if (First == '"' && Last == '"' && !Contents.FindChar('"', Unused))
 		{
-			const FString Val = Regex.GetCaptureGroup(1);
-			OutVal = FSUDSValue(FText::FromString(Val));
+			OutVal = FSUDSValue(FText::FromString(FString(Contents)));
 			return true;
 		}
-	}
-	// Try FName
-	{
-		const FRegexPattern Pattern(TEXT("^`([^`]*)`$"));
-		FRegexMatcher Regex(Pattern, ValueStr);
-		if (Regex.FindNext())
+		if (First == '`' && Last == '`' && !Contents.FindChar('`', Unused))
 		{
-			const FString Name = Regex.GetCaptureGroup(1);
-			OutVal = FSUDSValue(FName(Name), false);
+			OutVal = FSUDSValue(FName(Contents.Len(), Contents.GetData()), false);
 			return true;
 		}
-	}
-	// Try variable name
-	{
-		const FRegexPattern Pattern(TEXT("^\\{([^\\}]*)\\}$"));
-		FRegexMatcher Regex(Pattern, ValueStr);
-		if (Regex.FindNext())
+		if (First == '{' && Last == '}' && !Contents.FindChar('}', Unused))
 		{
-			const FName VariableName(Regex.GetCaptureGroup(1));
-			OutVal = FSUDSValue(VariableName, true);
+			OutVal = FSUDSValue(FName(Contents.Len(), Contents.GetData()), true);
 			return true;
 		}
 	}
@@ -278,151 +251,465 @@ bool FSUDSExpression::Validate()
 	if (Queue.IsEmpty())
 		return true;
 
-	// Same algorithm as Execute, we just don't execute
-	TArray<FSUDSExpressionItem> EvalStack;
-	const TMap<FName, FSUDSValue> TempVariables;
+	// Same stack behaviour as Evaluate, we just track the depth rather than values
+	int Depth = 0;
 	for (auto& Item : Queue)
 	{
 		if (Item.IsOperator())
 		{
-			FSUDSExpressionItem Arg1, Arg2;
-			if (Item.IsBinaryOperator())
-			{
-				if (EvalStack.IsEmpty())
-					return false;
-				Arg2 = EvalStack.Pop();
-			}
-			if (EvalStack.IsEmpty())
+			const int NumArgs = Item.IsBinaryOperator() ? 2 : 1;
+			if (Depth < NumArgs)
 				return false;
-			Arg1 = EvalStack.Pop();
-
-			EvalStack.Push(EvaluateOperator(Item.GetType(), Arg1, Arg2, TempVariables));
+			// Pops args, pushes result
+			Depth -= NumArgs - 1;
 		}
 		else
 		{
-			EvalStack.Push(Item);
+			++Depth;
 		}
 	}
 
-	// Must be one item left and must be an operand
-	return EvalStack.Num() == 1 && EvalStack[0].IsOperand();
+	// Must be one item left
+	return Depth == 1;
 	
 }
 
-FSUDSValue FSUDSExpression::Evaluate(const TMap<FName, FSUDSValue>& Variables) const
+void FSUDSExpression::Optimise()
 {
-	checkf(bIsValid, TEXT("Cannot execute an invalid expression tree"));
-
-	// Blanks are mostly used for conditionals, for simplicity always return true
-	if (Queue.IsEmpty())
-		return FSUDSValue(true);
+	// Fold every operator whose arguments are all literals into a single literal, and drop identity operations
+	// (x and true, x * 1 etc). An expression which folds all the way down becomes a single literal, so IsLiteral()
+	// lets the runtime skip evaluation entirely.
+	// Rather than building a tree, we replay the RPN queue tracking for each would-be stack entry where its
+	// sub-expression starts in the output queue. Because literals are always folded as soon as possible, a literal
+	// sub-expression is always exactly one item.
+	enum class ESubExpressionKind : uint8
+	{
+		Literal,
+		Variable,
+		Numeric,
+		Boolean
+	};
+	struct FSubExpression
+	{
+		int Start;
+		ESubExpressionKind Kind;
+	};
+	TArray<FSUDSExpressionItem> Output;
+	TArray<FSubExpression> Stack;
+	Output.Reserve(Queue.Num());
 
-	TArray<FSUDSExpressionItem> EvalStack;
-	// We could pre-optimise all literal expressions, but let's not for now
 	for (auto& Item : Queue)
 	{
-		if (Item.IsOperator())
+		if (Item.IsOperand())
 		{
-			FSUDSExpressionItem Arg1, Arg2;
-			// Arg2 (RHS) has to be popped first
-			if (Item.IsBinaryOperator())
+			Stack.Push(FSubExpression { Output.Num(),
+				Item.GetOperandValue().IsVariable() ? ESubExpressionKind::Variable : ESubExpressionKind::Literal });
+			Output.Add(Item);
+		}
+		else if (!Item.IsBinaryOperator())
+		{
+			// Not; sub-expression start is unchanged
+			FSubExpression& Arg = Stack.Top();
+			if (Arg.Kind == ESubExpressionKind::Literal && Output.Last().GetOperandValue().GetType() == ESUDSValueType::Boolean)
 			{
-				checkf(!EvalStack.IsEmpty(), TEXT("Args missing before operator, bad expression"));
-				Arg2 = EvalStack.Pop();
+				Output.Last().SetOperandValue(!Output.Last().GetOperandValue());
+			}
+			else
+			{
+				Output.Add(Item);
+				Arg.Kind = ESubExpressionKind::Boolean;
 			}
-			checkf(!EvalStack.IsEmpty(), TEXT("Args missing before operator, bad expression"));
-			Arg1 = EvalStack.Pop();
-			EvalStack.Push(EvaluateOperator(Item.GetType(), Arg1, Arg2, Variables));
 		}
 		else
 		{
-			EvalStack.Push(Item);
+			const FSubExpression Arg2 = Stack.Pop();
+			const FSubExpression Arg1 = Stack.Pop();
+			const ESUDSExpressionItemType Op = Item.GetType();
+			const bool bIsLogical = Op == ESUDSExpressionItemType::And || Op == ESUDSExpressionItemType::Or;
+			const bool bIsArithmetic = static_cast<int>(Op) < static_cast<int>(ESUDSExpressionItemType::Less);
+			// Identities can only be removed when the other side is already the type the operator would have
+			// produced; a lone variable in particular might be unset, or the wrong type
+			const ESubExpressionKind IdentityKind = bIsLogical ? ESubExpressionKind::Boolean : ESubExpressionKind::Numeric;
+			const bool bCanRemoveIdentity = bIsLogical || bIsArithmetic;
+
+			if (Arg1.Kind == ESubExpressionKind::Literal && Arg2.Kind == ESubExpressionKind::Literal &&
+				CanFoldOperator(Op, Output[Arg1.Start].GetOperandValue(), Output[Arg2.Start].GetOperandValue()))
+			{
+				const FSUDSValue Result = EvaluateBinaryOperator(static_cast<ESUDSExpressionOpCode>(Op),
+				                                                 Output[Arg1.Start].GetOperandValue(),
+				                                                 Output[Arg2.Start].GetOperandValue());
+				Output.SetNum(Arg1.Start);
+				Output.Add(FSUDSExpressionItem(Result));
+				Stack.Push(FSubExpression { Arg1.Start, ESubExpressionKind::Literal });
+			}
+			else if (bCanRemoveIdentity && Arg2.Kind == ESubExpressionKind::Literal && Arg1.Kind == IdentityKind &&
+				IsIdentityOperand(Op, Output[Arg2.Start].GetOperandValue(), false))
+			{
+				Output.SetNum(Arg2.Start);
+				Stack.Push(Arg1);
+			}
+			else if (bCanRemoveIdentity && Arg1.Kind == ESubExpressionKind::Literal && Arg2.Kind == IdentityKind &&
+				IsIdentityOperand(Op, Output[Arg1.Start].GetOperandValue(), true))
+			{
+				Output.RemoveAt(Arg1.Start);
+				Stack.Push(FSubExpression { Arg1.Start, Arg2.Kind });
+			}
+			else
+			{
+				Output.Add(Item);
+				Stack.Push(FSubExpression { Arg1.Start, bIsArithmetic ? ESubExpressionKind::Numeric : ESubExpressionKind::Boolean });
+			}
 		}
 	}
-	
-	checkf(EvalStack.Num() == 1, TEXT("We should end with a single item in the eval stack and it should be an operand"));
 
-	return EvaluateOperand(EvalStack.Top().GetOperandValue(), Variables);
+	Queue = MoveTemp(Output);
 }
 
-bool FSUDSExpression::EvaluateBoolean(const TMap<FName, FSUDSValue>& Variables, const FString& ErrorContext) const
+bool FSUDSExpression::CanFoldOperator(ESUDSExpressionItemType Op, const FSUDSValue& Arg1, const FSUDSValue& Arg2)
 {
-	const auto Result = Evaluate(Variables);
-
-	if (Result.GetType() != ESUDSValueType::Boolean &&
-		Result.GetType() != ESUDSValueType::Variable) // Allow unresolved variable, will assume false
+	switch (Op)
 	{
-		UE_LOG(LogSUDS, Error, TEXT("%s: Condition '%s' did not return a boolean result"), *ErrorContext, *SourceString)
+	case ESUDSExpressionItemType::And:
+	case ESUDSExpressionItemType::Or:
+		// These assert on non-boolean args, leave that for runtime
+		return Arg1.GetType() == ESUDSValueType::Boolean && Arg2.GetType() == ESUDSValueType::Boolean;
+	case ESUDSExpressionItemType::Divide:
+		// Don't divide by zero during import
+		return Arg1.IsNumeric() && Arg2.IsNumeric() &&
+			(Arg2.GetType() == ESUDSValueType::Int ? Arg2.GetIntValue() != 0 : Arg2.GetFloatValue() != 0.f);
+	case ESUDSExpressionItemType::Equal:
+	case ESUDSExpressionItemType::NotEqual:
+		return true;
+	default:
+		// Arithmetic & ordering; leave type mismatches to warn at runtime as they always have
+		return Arg1.IsNumeric() && Arg2.IsNumeric();
 	}
-
-	return Result.GetBooleanValue();
 }
 
-FSUDSExpressionItem FSUDSExpression::EvaluateOperator(ESUDSExpressionItemType Op,
-                                                      const FSUDSExpressionItem& Arg1,
-                                                      const FSUDSExpressionItem& Arg2,
-                                                      const TMap<FName, FSUDSValue>& Variables) const
+bool FSUDSExpression::IsIdentityOperand(ESUDSExpressionItemType Op, const FSUDSValue& Operand, bool bIsLeft)
 {
-	const FSUDSValue Val1 = EvaluateOperand(Arg1.GetOperandValue(), Variables);
-	FSUDSValue Val2;
-	if (Arg1.IsBinaryOperator())
-	{
-		Val2 = EvaluateOperand(Arg2.GetOperandValue(), Variables);
-	}
-
+	// Only int identities for arithmetic, since float literals would widen the result type
+	const bool bIsInt = Operand.GetType() == ESUDSValueType::Int;
+	const bool bIsBool = Operand.GetType() == ESUDSValueType::Boolean;
 	switch (Op)
 	{
-	case ESUDSExpressionItemType::Not:
-		return FSUDSExpressionItem(!Val1);
 	case ESUDSExpressionItemType::Multiply:
-		return FSUDSExpressionItem(Val1 * Val2);
+		return bIsInt && Operand.GetIntValue() == 1;
 	case ESUDSExpressionItemType::Divide:
-		return FSUDSExpressionItem(Val1 / Val2);
+		return !bIsLeft && bIsInt && Operand.GetIntValue() == 1;
 	case ESUDSExpressionItemType::Add:
-		return FSUDSExpressionItem(Val1 + Val2);
+		return bIsInt && Operand.GetIntValue() == 0;
 	case ESUDSExpressionItemType::Subtract:
-		return FSUDSExpressionItem(Val1 - Val2);
-	case ESUDSExpressionItemType::Less:
-		return FSUDSExpressionItem(Val1 < Val2);
-	case ESUDSExpressionItemType::LessEqual:
-		return FSUDSExpressionItem(Val1 <= Val2);
-	case ESUDSExpressionItemType::Greater:
-		return FSUDSExpressionItem(Val1 > Val2);
-	case ESUDSExpressionItemType::GreaterEqual:
-		return FSUDSExpressionItem(Val1 >= Val2);
-	case ESUDSExpressionItemType::Equal:
-		return FSUDSExpressionItem(Val1 == Val2);
-	case ESUDSExpressionItemType::NotEqual:
-		return FSUDSExpressionItem(Val1 != Val2);
+		return !bIsLeft && bIsInt && Operand.GetIntValue() == 0;
 	case ESUDSExpressionItemType::And:
-		return FSUDSExpressionItem(Val1 && Val2);
+		return bIsBool && Operand.GetBooleanValue();
 	case ESUDSExpressionItemType::Or:
-		return FSUDSExpressionItem(Val1 || Val2);
+		return bIsBool && !Operand.GetBooleanValue();
+	default:
+		return false;
+	}
+}
 
-		
-	default: // these won't occur
-	case ESUDSExpressionItemType::Null:
-	case ESUDSExpressionItemType::Operand:
-	case ESUDSExpressionItemType::LParens:
-	case ESUDSExpressionItemType::RParens:
-		return FSUDSExpressionItem();
-	};
+bool FSUDSExpression::Compile()
+{
+	// Convert the RPN queue into a flat byte code stream; operands become typed push instructions referencing either
+	// the literal table or the variable table, and we precompute the stack depth so Evaluate never has to grow it
+	ByteCode.Reset();
+	Literals.Reset();
+	VariableNames.Reset();
+	VariableSlots.Reset();
+	MaxStackDepth = 0;
+
+	int Depth = 0;
+	// Byte code offset where each entry currently on the stack started, so that and/or can insert a jump after their LHS
+	TArray<int, TInlineAllocator<InlineStackSize>> StartStack;
+	for (auto& Item : Queue)
+	{
+		if (Item.IsOperand())
+		{
+			StartStack.Push(ByteCode.Num());
+			const FSUDSValue& Operand = Item.GetOperandValue();
+			int Index;
+			if (Operand.IsVariable())
+			{
+				ByteCode.Add(static_cast<uint8>(ESUDSExpressionOpCode::LoadVariable));
+				Index = VariableNames.AddUnique(Operand.GetVariableNameValue());
+			}
+			else
+			{
+				ByteCode.Add(static_cast<uint8>(ESUDSExpressionOpCode::PushLiteral));
+				Index = Literals.Add(Operand);
+			}
+			if (Index > MAX_uint8)
+			{
+				ByteCode.Reset();
+				return false;
+			}
+			ByteCode.Add(static_cast<uint8>(Index));
+			MaxStackDepth = FMath::Max(MaxStackDepth, ++Depth);
+		}
+		else
+		{
+			if (Item.GetType() == ESUDSExpressionItemType::And || Item.GetType() == ESUDSExpressionItemType::Or)
+			{
+				// Jump over the RHS and the operator itself. Offsets are relative so inserting this doesn't invalidate
+				// any jumps already emitted in the RHS
+				const int RHSStart = StartStack.Top();
+				const int Offset = ByteCode.Num() - RHSStart + 1;
+				if (Offset > MAX_uint16)
+				{
+					ByteCode.Reset();
+					return false;
+				}
+				const uint8 Jump[3] = {
+					static_cast<uint8>(Item.GetType() == ESUDSExpressionItemType::And
+						                   ? ESUDSExpressionOpCode::JumpIfFalse
+						                   : ESUDSExpressionOpCode::JumpIfTrue),
+					static_cast<uint8>(Offset & 0xFF),
+					static_cast<uint8>(Offset >> 8)
+				};
+				ByteCode.Insert(Jump, 3, RHSStart);
+			}
+			// Operator values are shared with op codes
+			ByteCode.Add(static_cast<uint8>(Item.GetType()));
+			if (Item.IsBinaryOperator())
+			{
+				--Depth;
+				StartStack.Pop();
+			}
+		}
+	}
+
+	return true;
+}
+
+void FSUDSExpression::ResolveVariableSlots(const TMap<FName, int>& SlotMap)
+{
+	VariableSlots.SetNumUninitialized(VariableNames.Num());
+	for (int i = 0; i < VariableNames.Num(); ++i)
+	{
+		const int* pSlot = SlotMap.Find(VariableNames[i]);
+		VariableSlots[i] = pSlot ? *pSlot : INDEX_NONE;
+	}
+}
+
+bool FSUDSExpression::Serialize(FArchive& Ar)
+{
+	// Editor-only data is filtered when cooking and when loading cooked packages, so this matches up on both sides
+	if (!Ar.IsFilterEditorOnly())
+	{
+		return false;
+	}
+
+	uint8 Version = CompactFormatVersion;
+	Ar << Version;
+	if (Ar.IsLoading() && Version != CompactFormatVersion)
+	{
+		UE_LOG(LogSUDS, Error, TEXT("Unsupported compact expression format version %d"), Version);
+		Ar.SetError();
+		return true;
+	}
 	
+	Ar << bIsValid;
+	Ar << ByteCode;
+	Ar << Literals;
+	Ar << VariableNames;
+	Ar << VariableSlots;
+	Ar << MaxStackDepth;
+	Ar << SourceString;
+
+	if (Ar.IsLoading())
+	{
+		Queue.Empty();
+	}
+	return true;
+}
+
+void FSUDSExpression::PostSerialize(const FArchive& Ar)
+{
+	if (Ar.IsLoading() && bIsValid && ByteCode.IsEmpty() && !Queue.IsEmpty())
+	{
+		// Saved before we compiled expressions
+		bIsValid = Compile();
+	}
+}
+
+FSUDSValue FSUDSExpression::Evaluate(const FSUDSExpressionVariables& Variables) const
+{
+	return EvaluateImpl(Variables, nullptr);
+}
+
+FSUDSValue FSUDSExpression::Evaluate(const FSUDSExpressionVariables& Variables,
+                                     TFunctionRef<void(const FName&)> OnFirstRead) const
+{
+	return EvaluateImpl(Variables, &OnFirstRead);
 }
 
-FSUDSValue FSUDSExpression::EvaluateOperand(const FSUDSValue& Operand,
-	const TMap<FName, FSUDSValue>& Variables) const
+FSUDSValue FSUDSExpression::EvaluateImpl(const FSUDSExpressionVariables& Variables,
+                                         const TFunctionRef<void(const FName&)>* OnFirstRead) const
 {
-	// Simplify conversion to variable values
-	if (Operand.IsVariable())
+	checkf(bIsValid, TEXT("Cannot execute an invalid expression tree"));
+
+	// Blanks are mostly used for conditionals, for simplicity always return true
+	if (ByteCode.IsEmpty())
+		return FSUDSValue(true);
+
+	// Only expressions deeper than the inline size will allocate, which is rare
+	TArray<FSUDSValue, TInlineAllocator<InlineStackSize>> EvalStack;
+	EvalStack.Reserve(MaxStackDepth);
+	// Only needed when reporting reads, variables are indexed so a bit each covers it
+	TBitArray<> VariablesRead;
+	if (OnFirstRead)
+	{
+		VariablesRead.Init(false, VariableNames.Num());
+	}
+
+	int PC = 0;
+	while (PC < ByteCode.Num())
 	{
-		if (const auto Var = Variables.Find(Operand.GetVariableNameValue()))
+		const ESUDSExpressionOpCode Op = static_cast<ESUDSExpressionOpCode>(ByteCode[PC++]);
+		switch (Op)
 		{
-			return *Var;
+		case ESUDSExpressionOpCode::PushLiteral:
+			EvalStack.Add(Literals[ByteCode[PC++]]);
+			break;
+		case ESUDSExpressionOpCode::LoadVariable:
+			{
+				const int VarIndex = ByteCode[PC++];
+				const FName& VarName = VariableNames[VarIndex];
+				if (OnFirstRead && !VariablesRead[VarIndex])
+				{
+					VariablesRead[VarIndex] = true;
+					(*OnFirstRead)(VarName);
+				}
+				const FSUDSValue* Var;
+				const int Slot = VariableSlots.IsValidIndex(VarIndex) ? VariableSlots[VarIndex] : INDEX_NONE;
+				if (Variables.Slots && Variables.Slots->IsValidIndex(Slot))
+				{
+					const FSUDSValue& SlotValue = Variables.Slots->Get(Slot);
+					Var = SlotValue.IsEmpty() ? nullptr : &SlotValue;
+				}
+				else if (Slot == SUDS_GLOBAL_VARIABLE_SLOT && Variables.Globals)
+				{
+					Var = Variables.Globals->Find(VarName);
+				}
+				else
+				{
+					Var = Variables.Named.Find(VarName);
+				}
+				if (Var)
+				{
+					EvalStack.Add(*Var);
+				}
+				else
+				{
+					// Note: we're NOT warning about unset variables here, and just defaulting to initial values (false, 0 etc)
+					// This is more usable in practice than complaining about it. Leaving it as a variable reference
+					// lets operators know it was unset
+					EvalStack.Add(FSUDSValue(VarName, true));
+				}
+				break;
+			}
+		case ESUDSExpressionOpCode::Not:
+			checkf(!EvalStack.IsEmpty(), TEXT("Args missing before operator, bad expression"));
+			EvalStack.Top() = !EvalStack.Top();
+			break;
+		case ESUDSExpressionOpCode::JumpIfFalse:
+		case ESUDSExpressionOpCode::JumpIfTrue:
+			{
+				checkf(!EvalStack.IsEmpty(), TEXT("Args missing before operator, bad expression"));
+				const int Offset = ByteCode[PC] | (ByteCode[PC + 1] << 8);
+				PC += 2;
+				FSUDSValue& LHS = EvalStack.Top();
+				// Non-boolean args aren't short-circuited so that the operator can complain about them as before
+				if (LHS.GetType() == ESUDSValueType::Boolean || LHS.GetType() == ESUDSValueType::Variable)
+				{
+					const bool bShortCircuitValue = Op == ESUDSExpressionOpCode::JumpIfTrue;
+					if (LHS.GetBooleanValue() == bShortCircuitValue)
+					{
+						LHS = FSUDSValue(bShortCircuitValue);
+						PC += Offset;
+					}
+				}
+				break;
+			}
+		default:
+			{
+				checkf(EvalStack.Num() >= 2, TEXT("Args missing before operator, bad expression"));
+				// Arg2 (RHS) is on top; result replaces Arg1
+				const FSUDSValue Arg2 = EvalStack.Pop();
+				FSUDSValue& Arg1 = EvalStack.Top();
+				Arg1 = EvaluateBinaryOperator(Op, Arg1, Arg2);
+				break;
+			}
 		}
-		// Note: we're NOT warning about unset variables here, and just defaulting to initial values (false, 0 etc)
-		// This is more usable in practice than complaining about it
 	}
+	
+	checkf(EvalStack.Num() == 1, TEXT("We should end with a single item in the eval stack"));
 
-	return Operand;
+	return EvalStack[0];
+}
+
+bool FSUDSExpression::EvaluateBoolean(const FSUDSExpressionVariables& Variables, const FString& ErrorContext) const
+{
+	return EvaluateBooleanResult(EvaluateImpl(Variables, nullptr), ErrorContext);
+}
+
+bool FSUDSExpression::EvaluateBoolean(const FSUDSExpressionVariables& Variables,
+                                      TFunctionRef<void(const FName&)> OnFirstRead,
+                                      const FString& ErrorContext) const
+{
+	return EvaluateBooleanResult(EvaluateImpl(Variables, &OnFirstRead), ErrorContext);
+}
+
+bool FSUDSExpression::EvaluateBooleanResult(const FSUDSValue& Result, const FString& ErrorContext) const
+{
+	if (Result.GetType() != ESUDSValueType::Boolean &&
+		Result.GetType() != ESUDSValueType::Variable) // Allow unresolved variable, will assume false
+	{
+		UE_LOG(LogSUDS, Error, TEXT("%s: Condition '%s' did not return a boolean result"), *ErrorContext, *SourceString)
+	}
+
+	return Result.GetBooleanValue();
+}
+
+FSUDSValue FSUDSExpression::EvaluateBinaryOperator(ESUDSExpressionOpCode Op,
+                                                   const FSUDSValue& Arg1,
+                                                   const FSUDSValue& Arg2)
+{
+	switch (Op)
+	{
+	case ESUDSExpressionOpCode::Multiply:
+		return Arg1 * Arg2;
+	case ESUDSExpressionOpCode::Divide:
+		return Arg1 / Arg2;
+	case ESUDSExpressionOpCode::Add:
+		return Arg1 + Arg2;
+	case ESUDSExpressionOpCode::Subtract:
+		return Arg1 - Arg2;
+	case ESUDSExpressionOpCode::Less:
+		return Arg1 < Arg2;
+	case ESUDSExpressionOpCode::LessEqual:
+		return Arg1 <= Arg2;
+	case ESUDSExpressionOpCode::Greater:
+		return Arg1 > Arg2;
+	case ESUDSExpressionOpCode::GreaterEqual:
+		return Arg1 >= Arg2;
+	case ESUDSExpressionOpCode::Equal:
+		return Arg1 == Arg2;
+	case ESUDSExpressionOpCode::NotEqual:
+		return Arg1 != Arg2;
+	case ESUDSExpressionOpCode::And:
+		return Arg1 && Arg2;
+	case ESUDSExpressionOpCode::Or:
+		return Arg1 || Arg2;
+
+		
+	default: // these won't occur
+	case ESUDSExpressionOpCode::Not:
+	case ESUDSExpressionOpCode::PushLiteral:
+	case ESUDSExpressionOpCode::LoadVariable:
+		return FSUDSValue();
+	};
+	
 }
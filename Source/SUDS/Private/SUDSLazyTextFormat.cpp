@@ -0,0 +1,65 @@
+﻿// Copyright Steve Streeting 2022
+// Released under the MIT license https://opensource.org/license/MIT/
+#include "SUDSLazyTextFormat.h"
+
+#include "Internationalization/TextLocalizationManager.h"
+
+FSUDSLazyTextFormat& FSUDSLazyTextFormat::operator=(const FSUDSLazyTextFormat& Other)
+{
+	if (this != &Other)
+	{
+		// Only take formats which are compiled for the current culture; nothing will recompile those while we copy
+		const int TextRevision = FTextLocalizationManager::Get().GetTextRevision();
+		if (Other.State.load(std::memory_order_acquire) == Compiled &&
+			Other.CompiledRevision.load(std::memory_order_relaxed) >= TextRevision)
+		{
+			Format = Other.Format;
+			CompiledRevision.store(Other.CompiledRevision.load(std::memory_order_relaxed), std::memory_order_relaxed);
+			State.store(Compiled, std::memory_order_release);
+		}
+		else
+		{
+			Format = FTextFormat();
+			CompiledRevision.store(INDEX_NONE, std::memory_order_relaxed);
+			State.store(NotCompiled, std::memory_order_release);
+		}
+	}
+	return *this;
+}
+
+const FTextFormat& FSUDSLazyTextFormat::Get(const FText& Text) const
+{
+	Compile(Text, FTextLocalizationManager::Get().GetTextRevision(), true);
+	return Format;
+}
+
+void FSUDSLazyTextFormat::Compile(const FText& Text, int TextRevision, bool bWait) const
+{
+	while (true)
+	{
+		uint8 Current = State.load(std::memory_order_acquire);
+		if (Current == Compiled && CompiledRevision.load(std::memory_order_relaxed) >= TextRevision)
+		{
+			return;
+		}
+		if (Current == Compiling)
+		{
+			if (!bWait)
+			{
+				// Someone else is already on it
+				return;
+			}
+			FPlatformProcess::Yield();
+			continue;
+		}
+		// Not compiled, or compiled for an older culture; whoever swaps the state gets to compile it. Revisions only go
+		// up, so an older prewarm never replaces a format compiled for a newer culture
+		if (State.compare_exchange_weak(Current, Compiling, std::memory_order_acquire))
+		{
+			Format = FTextFormat(Text);
+			CompiledRevision.store(TextRevision, std::memory_order_relaxed);
+			State.store(Compiled, std::memory_order_release);
+			return;
+		}
+	}
+}
@@ -4,8 +4,10 @@
 
 #include "SUDSScriptNode.h"
 #include "SUDSScriptNodeGosub.h"
+#include "SUDSScriptNodeSet.h"
 #include "SUDSScriptNodeText.h"
 #include "EditorFramework/AssetImportData.h"
+#include "Internationalization/TextLocalizationManager.h"
 
 void USUDSScript::StartImport(TArray<USUDSScriptNode*>** ppNodes,
                               TArray<USUDSScriptNode*>** ppHeaderNodes,
@@ -13,6 +15,10 @@ void USUDSScript::StartImport(TArray<USUDSScriptNode*>** ppNodes,
                               TMap<FName, int>** ppHeaderLabelList,
                               TArray<FString>** ppSpeakerList)
 {
+	// The background format compile holds our current nodes, which are about to be replaced
+	WaitForTextFormats();
+	bTextFormatsPrewarmed = false;
+
 	*ppNodes = &Nodes;
 	*ppHeaderNodes = &HeaderNodes;
 	*ppLabelList = &LabelList;
@@ -150,84 +156,475 @@ void USUDSScript::FinishImport()
 			}
 		}
 	}
-	
+
+	BuildStaticChoicePaths();
+	BuildVariableSlots();
+	BuildIDLists();
+	BuildSpeakerTable(true);
+	BuildHeaderSnapshot();
 }
 
-USUDSScriptNode* USUDSScript::GetHeaderNode() const
+void USUDSScript::BuildStaticChoicePaths()
 {
-	if (HeaderNodes.Num() > 0)
-		return HeaderNodes[0];
+	// For text nodes which may have choices, see if the path to the choice is unconditional, so that at runtime we can
+	// go straight there instead of walking to it twice (once to find it, once to run the nodes in between)
+	// Anything other than set and event nodes on the way (selects, gosubs) means we can't know until runtime
+	TArray<int> PreChoiceNodes;
+	for (auto Node : Nodes)
+	{
+		auto TextNode = Cast<USUDSScriptNodeText>(Node);
+		if (!TextNode || !TextNode->MayHaveChoices() || TextNode->GetEdgeCount() != 1)
+			continue;
 
-	return nullptr;
+		PreChoiceNodes.Reset();
+		int NextIndex = TextNode->GetEdge(0)->GetTargetNodeIndex();
+		// Limit steps in case of a loop of set nodes
+		for (int Steps = 0; Steps < Nodes.Num(); ++Steps)
+		{
+			const USUDSScriptNode* NextNode = GetNodeByIndex(NextIndex);
+			if (!NextNode)
+				break;
+			
+			const ESUDSScriptNodeType Type = NextNode->GetNodeType();
+			if (Type == ESUDSScriptNodeType::Choice)
+			{
+				TextNode->SetStaticChoicePath(NextIndex, PreChoiceNodes);
+				break;
+			}
+			if ((Type != ESUDSScriptNodeType::SetVariable && Type != ESUDSScriptNodeType::Event) ||
+				NextNode->GetEdgeCount() != 1)
+			{
+				break;
+			}
+			PreChoiceNodes.Add(NextIndex);
+			NextIndex = NextNode->GetEdge(0)->GetTargetNodeIndex();
+		}
+	}
 }
 
-USUDSScriptNode* USUDSScript::GetFirstNode() const
+void USUDSScript::BuildIDLists()
 {
-	if (Nodes.Num() > 0)
-		return Nodes[0];
+	BuildIDLookups();
+	LineTextIDs.Empty();
+	ChoiceTextIDs.Empty();
+	TMap<FString, int> ChoiceOrdinals;
+	for (int i = 0; i < Nodes.Num(); ++i)
+	{
+		if (auto TN = Cast<USUDSScriptNodeText>(Nodes[i]))
+		{
+			const FString TextID = TN->GetTextID();
+			const int First = FindTextNodeIndex(TextID);
+			if (First != i)
+			{
+				// Duplicate lines count as the same line
+				TN->SetLineOrdinal(CastChecked<USUDSScriptNodeText>(Nodes[First])->GetLineOrdinal());
+			}
+			else
+			{
+				TN->SetLineOrdinal(LineTextIDs.Add(TextID));
+			}
+		}
+		Nodes[i]->AssignChoiceOrdinals(ChoiceOrdinals, ChoiceTextIDs);
+	}
+	BuildOrdinalLookups();
+}
 
-	return nullptr;
+void USUDSScript::BuildIDLookups()
+{
+	TextIDLookup.Empty();
+	GosubIDLookup.Empty();
+	// Only add an ID if it isn't there yet, so that the first node wins if IDs are ever duplicated, as it did with a
+	// linear search
+	for (int i = 0; i < Nodes.Num(); ++i)
+	{
+		if (auto TN = Cast<USUDSScriptNodeText>(Nodes[i]))
+		{
+			const FString TextID = TN->GetTextID();
+			if (FindTextNodeIndex(TextID) == INDEX_NONE)
+			{
+				TextIDLookup.Add(GetTypeHash(TextID), i);
+			}
+		}
+		else if (auto GN = Cast<USUDSScriptNodeGosub>(Nodes[i]))
+		{
+			if (FindGosubNodeIndex(GN->GetGosubID()) == INDEX_NONE)
+			{
+				GosubIDLookup.Add(GetTypeHash(GN->GetGosubID()), i);
+			}
+		}
+	}
 }
 
-USUDSScriptNode* USUDSScript::GetNodeByLabel(const FName& Label) const
+int USUDSScript::FindTextNodeIndex(const FString& TextID) const
 {
-	if (const int* pIdx = LabelList.Find(Label))
+	for (auto It = TextIDLookup.CreateConstKeyIterator(GetTypeHash(TextID)); It; ++It)
 	{
-		return Nodes[*pIdx];
+		// Only the hash was matched, check it's really this ID
+		if (CastChecked<USUDSScriptNodeText>(Nodes[It.Value()])->GetTextID() == TextID)
+		{
+			return It.Value();
+		}
 	}
+	return INDEX_NONE;
+}
 
-	return nullptr;
-	
+int USUDSScript::FindGosubNodeIndex(const FString& GosubID) const
+{
+	for (auto It = GosubIDLookup.CreateConstKeyIterator(GetTypeHash(GosubID)); It; ++It)
+	{
+		if (CastChecked<USUDSScriptNodeGosub>(Nodes[It.Value()])->GetGosubID() == GosubID)
+		{
+			return It.Value();
+		}
+	}
+	return INDEX_NONE;
 }
 
-USUDSScriptNodeText* USUDSScript::GetNodeByTextID(const FString& TextID) const
+void USUDSScript::BuildOrdinalLookups()
+{
+	ChoiceOrdinalMap.Empty(ChoiceTextIDs.Num());
+	for (int i = 0; i < ChoiceTextIDs.Num(); ++i)
+	{
+		ChoiceOrdinalMap.Add(ChoiceTextIDs[i], i);
+	}
+
+	OrdinalLayoutHash = HashCombine(GetTypeHash(LineTextIDs.Num()), GetTypeHash(ChoiceTextIDs.Num()));
+	for (const FString& ID : LineTextIDs)
+	{
+		OrdinalLayoutHash = HashCombine(OrdinalLayoutHash, GetTypeHash(ID));
+	}
+	for (const FString& ID : ChoiceTextIDs)
+	{
+		OrdinalLayoutHash = HashCombine(OrdinalLayoutHash, GetTypeHash(ID));
+	}
+}
+
+int USUDSScript::GetLineOrdinalByTextID(const FString& TextID) const
 {
-	for (auto N : Nodes)
+	if (const USUDSScriptNodeText* TN = GetNodeByTextID(TextID))
 	{
-		if (N->GetNodeType() == ESUDSScriptNodeType::Text)
+		return TN->GetLineOrdinal();
+	}
+	return INDEX_NONE;
+}
+
+void USUDSScript::BuildSpeakerTable(bool bResolveNodes)
+{
+	static const FString SpeakerIDPrefix = "SpeakerName.";
+	SpeakerDisplayNameKeys.Empty(Speakers.Num());
+	SpeakerVoiceTable.Empty(Speakers.Num());
+	for (const FString& Speaker : Speakers)
+	{
+		SpeakerDisplayNameKeys.Add(FName(SpeakerIDPrefix + Speaker));
+		const TSoftObjectPtr<UDialogueVoice>* pVoice = SpeakerVoices.Find(Speaker);
+		SpeakerVoiceTable.Add(pVoice ? *pVoice : TSoftObjectPtr<UDialogueVoice>());
+	}
+
+	if (bResolveNodes)
+	{
+		for (auto Node : Nodes)
 		{
-			if (auto TN = Cast<USUDSScriptNodeText>(N))
+			if (auto TN = Cast<USUDSScriptNodeText>(Node))
 			{
-				if (TextID.Equals(TN->GetTextID()))
-				{
-					return TN;
-				}
+				TN->SetSpeakerIndex(GetSpeakerIndex(TN->GetSpeakerID()));
 			}
 		}
 	}
-	return nullptr;
 }
 
-USUDSScriptNodeGosub* USUDSScript::GetNodeByGosubID(const FString& ID) const
+void USUDSScript::BuildHeaderSnapshot()
+{
+	bHeaderIsLiteral = false;
+	LiteralHeaderSets.Empty();
+	HeaderDefaultSlots.Reset();
+
+	// Follow the header from the start; anything other than a chain of literal sets means it has to be run each time
+	const USUDSScriptNode* Node = GetHeaderNode();
+	for (int Steps = 0; Node && Steps < HeaderNodes.Num(); ++Steps)
+	{
+		const USUDSScriptNodeSet* SetNode = Cast<USUDSScriptNodeSet>(Node);
+		if (!SetNode ||
+			SetNode->GetEdgeCount() != 1 ||
+			!SetNode->GetExpression().IsLiteral() ||
+			!VariableSlotNames.IsValidIndex(SetNode->GetIdentifierSlot()))
+		{
+			LiteralHeaderSets.Empty();
+			return;
+		}
+		LiteralHeaderSets.Add(SetNode);
+		Node = GetEdgeTargetNode(*SetNode->GetEdge(0), true);
+	}
+	if (Node)
+	{
+		// Looped back on itself
+		LiteralHeaderSets.Empty();
+		return;
+	}
+
+	TArray<FSUDSValue> Defaults;
+	Defaults.SetNum(VariableSlotNames.Num());
+	for (auto SetNode : LiteralHeaderSets)
+	{
+		Defaults[SetNode->GetIdentifierSlot()] = SetNode->GetExpression().GetLiteralValue();
+	}
+	HeaderDefaultSlots = MakeShared<TArray<FSUDSValue>>(MoveTemp(Defaults));
+	bHeaderIsLiteral = true;
+}
+
+void USUDSScript::BuildVariableSlots()
+{
+	// Every variable anything in the script might read or write gets a slot
+	TArray<FName> AllNames;
+	for (auto Node : HeaderNodes)
+	{
+		Node->GatherVariableNames(AllNames);
+	}
+	for (auto Node : Nodes)
+	{
+		Node->GatherVariableNames(AllNames);
+	}
+	// Except globals, which are held by the subsystem rather than the dialogue
+	VariableSlotNames.Empty(AllNames.Num());
+	TMap<FName, int> ResolveMap;
+	for (const FName& Name : AllNames)
+	{
+		if (IsSUDSGlobalVariableName(Name))
+		{
+			ResolveMap.Add(Name, SUDS_GLOBAL_VARIABLE_SLOT);
+		}
+		else
+		{
+			VariableSlotNames.Add(Name);
+		}
+	}
+	BuildVariableSlotMap();
+	ResolveMap.Append(VariableSlotMap);
+
+	for (auto Node : HeaderNodes)
+	{
+		Node->ResolveVariableSlots(ResolveMap);
+	}
+	for (auto Node : Nodes)
+	{
+		Node->ResolveVariableSlots(ResolveMap);
+	}
+}
+
+void USUDSScript::BuildVariableSlotMap()
+{
+	VariableSlotMap.Empty(VariableSlotNames.Num());
+	for (int i = 0; i < VariableSlotNames.Num(); ++i)
+	{
+		VariableSlotMap.Add(VariableSlotNames[i], i);
+	}
+}
+
+void USUDSScript::PostLoad()
 {
-	for (auto N : Nodes)
+	Super::PostLoad();
+
+	// Make sure nodes have finished loading (including parameter names for old assets) before deriving anything
+	for (auto Node : HeaderNodes)
+	{
+		if (Node)
+		{
+			Node->ConditionalPostLoad();
+		}
+	}
+	for (auto Node : Nodes)
 	{
-		if (N->GetNodeType() == ESUDSScriptNodeType::Text)
+		if (Node)
 		{
-			if (auto GN = Cast<USUDSScriptNodeGosub>(N))
+			Node->ConditionalPostLoad();
+		}
+	}
+
+	if (VariableSlotNames.IsEmpty() && (!Nodes.IsEmpty() || !HeaderNodes.IsEmpty()))
+	{
+		// Imported before variables had slots, nodes are loaded by now so we can resolve them
+		BuildVariableSlots();
+	}
+	else
+	{
+		BuildVariableSlotMap();
+	}
+
+	if (LineTextIDs.IsEmpty() && !Nodes.IsEmpty())
+	{
+		// Imported before lines & choices had ordinals
+		BuildIDLists();
+	}
+	else
+	{
+		// ID lookups aren't saved, they're always rebuilt from the nodes
+		BuildIDLookups();
+		BuildOrdinalLookups();
+	}
+
+	// Text nodes lack a speaker index if imported before the speaker table existed. Always resolve them rather than
+	// guessing from one node, like edge indexes below it's cheap compared to the load itself
+	BuildSpeakerTable(true);
+
+	// Imported before edges had target node indexes, or only partly resolved. Check every edge rather than guessing
+	// from one, it's cheap compared to the load itself
+	auto NeedsEdgeTargetIndices = [](const TArray<USUDSScriptNode*>& NodeList)
+	{
+		for (const auto Node : NodeList)
+		{
+			if (!Node)
 			{
-				if (ID.Equals(GN->GetGosubID()))
+				continue;
+			}
+			for (const auto& Edge : Node->GetEdges())
+			{
+				if (Edge.GetTargetNodeIndex() == INDEX_NONE && Edge.GetTargetNode().IsValid())
 				{
-					return GN;
+					return true;
 				}
 			}
 		}
+		return false;
+	};
+	if (NeedsEdgeTargetIndices(Nodes))
+	{
+		ResolveEdgeTargetIndices(Nodes);
+	}
+	if (NeedsEdgeTargetIndices(HeaderNodes))
+	{
+		ResolveEdgeTargetIndices(HeaderNodes);
+	}
+
+	BuildHeaderSnapshot();
+}
+
+void USUDSScript::ResolveEdgeTargetIndices(const TArray<USUDSScriptNode*>& NodeList)
+{
+	TMap<const USUDSScriptNode*, int> NodeIndices;
+	NodeIndices.Reserve(NodeList.Num());
+	for (int i = 0; i < NodeList.Num(); ++i)
+	{
+		NodeIndices.Add(NodeList[i], i);
+	}
+	for (auto Node : NodeList)
+	{
+		Node->ResolveEdgeTargetIndices(NodeIndices);
+	}
+}
+
+void USUDSScript::PrewarmTextFormats() const
+{
+	bTextFormatsPrewarmed = true;
+
+	// Don't let two compiles of the same formats overlap
+	WaitForTextFormats();
+
+	// Formats not compiled yet when they're needed are compiled on demand, so nothing waits for this task
+	const int TextRevision = FTextLocalizationManager::Get().GetTextRevision();
+	TextFormatTask = UE::Tasks::Launch(UE_SOURCE_LOCATION, [NodesToCompile = Nodes, TextRevision]()
+	{
+		for (auto Node : NodesToCompile)
+		{
+			if (Node)
+			{
+				Node->PrewarmTextFormats(TextRevision);
+			}
+		}
+	});
+}
+
+void USUDSScript::EnsureTextFormatsPrewarmed() const
+{
+	if (!bTextFormatsPrewarmed)
+	{
+		PrewarmTextFormats();
+	}
+}
+
+void USUDSScript::WaitForTextFormats() const
+{
+	if (TextFormatTask.IsValid() && !TextFormatTask.IsCompleted())
+	{
+		TextFormatTask.Wait();
 	}
+}
+
+void USUDSScript::BeginDestroy()
+{
+	// The compile task uses our nodes
+	WaitForTextFormats();
+
+	Super::BeginDestroy();
+}
+
+bool USUDSScript::CanBeClusterRoot() const
+{
+	// Nodes are created with the script as their outer, and the object references between the script and its nodes
+	// are fixed once it's loaded, so the whole graph can be one GC cluster (only created in cooked builds). GC then
+	// considers the script rather than every node and its edges individually.
+	// Scripts do change after load (compiled text formats, cached voice context indexes, speaker tables), but only in
+	// data which isn't a strong object reference. Anything which adds UObject references to a script or its nodes at
+	// runtime must not be done while this returns true, since the cluster wouldn't know about them.
+	// Nodes are still one UObject each, so this doesn't reduce object count, memory or load time.
+	return true;
+}
+
+USUDSScriptNode* USUDSScript::GetHeaderNode() const
+{
+	if (HeaderNodes.Num() > 0)
+		return HeaderNodes[0];
+
 	return nullptr;
 }
 
+USUDSScriptNode* USUDSScript::GetFirstNode() const
+{
+	if (Nodes.Num() > 0)
+		return Nodes[0];
+
+	return nullptr;
+}
+
+USUDSScriptNode* USUDSScript::GetNodeByLabel(const FName& Label) const
+{
+	if (const int* pIdx = LabelList.Find(Label))
+	{
+		return Nodes[*pIdx];
+	}
+
+	return nullptr;
+	
+}
+
+USUDSScriptNodeText* USUDSScript::GetNodeByTextID(const FString& TextID) const
+{
+	const int Index = FindTextNodeIndex(TextID);
+	return Index != INDEX_NONE ? Cast<USUDSScriptNodeText>(Nodes[Index]) : nullptr;
+}
+
+USUDSScriptNodeGosub* USUDSScript::GetNodeByGosubID(const FString& ID) const
+{
+	const int Index = FindGosubNodeIndex(ID);
+	return Index != INDEX_NONE ? Cast<USUDSScriptNodeGosub>(Nodes[Index]) : nullptr;
+}
+
 UDialogueVoice* USUDSScript::GetSpeakerVoice(const FString& SpeakerID) const
 {
-	if (UDialogueVoice* const* pVoice = SpeakerVoices.Find(SpeakerID))
+	if (const TSoftObjectPtr<UDialogueVoice>* pVoice = SpeakerVoices.Find(SpeakerID))
 	{
-		return *pVoice;
+		// Normally already loaded along with the line being spoken, voice assets are small anyway
+		return pVoice->LoadSynchronous();
 	}
 	return nullptr;
 }
 
-void USUDSScript::SetSpeakerVoice(const FString& SpeakerID, UDialogueVoice* Voice)
+void USUDSScript::SetSpeakerVoice(const FString& SpeakerID, const TSoftObjectPtr<UDialogueVoice>& Voice)
 {
 	SpeakerVoices.Add(SpeakerID, Voice);
+	const int Index = GetSpeakerIndex(SpeakerID);
+	if (SpeakerVoiceTable.IsValidIndex(Index))
+	{
+		SpeakerVoiceTable[Index] = Voice;
+	}
 }
 
 #if WITH_EDITORONLY_DATA
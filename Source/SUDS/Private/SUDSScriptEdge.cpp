@@ -2,18 +2,47 @@
 // Released under the MIT license https://opensource.org/license/MIT/
 #include "SUDSScriptEdge.h"
 
-void FSUDSScriptEdge::ExtractFormat() const
+void FSUDSScriptEdge::ExtractParameterNames()
 {
-	// Only do this on demand, and only once
-	TextFormat = Text;
 	ParameterNames.Empty();
 	TArray<FString> TextParams;
-	TextFormat.GetFormatArgumentNames(TextParams);
+	TextFormat.Get(Text).GetFormatArgumentNames(TextParams);
 	for (auto Param : TextParams)
 	{
 		ParameterNames.Add(FName(Param));
 	}
-	bFormatExtracted = true;
+	BuildParameterKeys();
+}
+
+void FSUDSScriptEdge::BuildParameterKeys()
+{
+	ParameterKeys.Empty(ParameterNames.Num());
+	for (auto& Name : ParameterNames)
+	{
+		// Key as the dialogue has always supplied it, from the name
+		ParameterKeys.Add(Name.ToString());
+	}
+}
+
+void FSUDSScriptEdge::PostLoad()
+{
+	// Assets imported before parameter names were stored need them extracted now
+	if (ParameterNames.IsEmpty() && !Text.IsEmpty() && Text.ToString().Contains(TEXT("{")))
+	{
+		ExtractParameterNames();
+	}
+	else
+	{
+		BuildParameterKeys();
+	}
+}
+
+void FSUDSScriptEdge::PrewarmTextFormat(int TextRevision) const
+{
+	if (HasParameters())
+	{
+		TextFormat.Prewarm(Text, TextRevision);
+	}
 }
 
 FString FSUDSScriptEdge::GetTextID() const
@@ -24,35 +53,34 @@ FString FSUDSScriptEdge::GetTextID() const
 void FSUDSScriptEdge::SetText(const FText& InText)
 {
 	Text = InText;
-	bFormatExtracted = false;
+	ExtractParameterNames();
 }
 
-const FTextFormat& FSUDSScriptEdge::GetTextFormat() const
+void FSUDSScriptEdge::GatherVariableNames(TArray<FName>& OutNames) const
 {
-	if (!bFormatExtracted)
+	for (auto& Name : Condition.GetVariableNames())
 	{
-		ExtractFormat();
+		OutNames.AddUnique(Name);
 	}
-	return TextFormat;
-	
-}
-
-const TArray<FName>& FSUDSScriptEdge::GetParameterNames() const
-{
-	if (!bFormatExtracted)
+	if (!Text.IsEmpty())
 	{
-		ExtractFormat();
+		for (auto& Name : GetParameterNames())
+		{
+			OutNames.AddUnique(Name);
+		}
 	}
-	return ParameterNames;
-	
 }
 
-bool FSUDSScriptEdge::HasParameters() const
+void FSUDSScriptEdge::ResolveVariableSlots(const TMap<FName, int>& SlotMap)
 {
-	if (!bFormatExtracted)
+	Condition.ResolveVariableSlots(SlotMap);
+	ParameterSlots.Reset();
+	if (!Text.IsEmpty())
 	{
-		ExtractFormat();
+		for (auto& Name : GetParameterNames())
+		{
+			const int* pSlot = SlotMap.Find(Name);
+			ParameterSlots.Add(pSlot ? *pSlot : INDEX_NONE);
+		}
 	}
-	return !ParameterNames.IsEmpty();
-	
 }
@@ -29,3 +29,75 @@ void USUDSScriptNode::AddEdge(const FSUDSScriptEdge& NewEdge)
 	Edges.Add(NewEdge);
 }
 
+void USUDSScriptNode::PrewarmTextFormats(int TextRevision) const
+{
+	for (auto& Edge : Edges)
+	{
+		Edge.PrewarmTextFormat(TextRevision);
+	}
+}
+
+void USUDSScriptNode::PostLoad()
+{
+	Super::PostLoad();
+
+	for (auto& Edge : Edges)
+	{
+		Edge.PostLoad();
+	}
+}
+
+void USUDSScriptNode::GatherVariableNames(TArray<FName>& OutNames) const
+{
+	for (auto& Edge : Edges)
+	{
+		Edge.GatherVariableNames(OutNames);
+	}
+}
+
+bool USUDSScriptNode::ResolveEdgeTargetIndices(const TMap<const USUDSScriptNode*, int>& NodeIndices)
+{
+	bool bChanged = false;
+	for (auto& Edge : Edges)
+	{
+		if (Edge.GetTargetNodeIndex() == INDEX_NONE && Edge.GetTargetNode().IsValid())
+		{
+			if (const int* pIdx = NodeIndices.Find(Edge.GetTargetNode().Get()))
+			{
+				Edge.SetTargetNodeIndex(*pIdx);
+				bChanged = true;
+			}
+		}
+	}
+	return bChanged;
+}
+
+void USUDSScriptNode::AssignChoiceOrdinals(TMap<FString, int>& InOutOrdinals, TArray<FString>& InOutTextIDs)
+{
+	for (auto& Edge : Edges)
+	{
+		if (Edge.GetType() == ESUDSEdgeType::Decision)
+		{
+			const FString TextID = Edge.GetTextID();
+			if (const int* pOrdinal = InOutOrdinals.Find(TextID))
+			{
+				Edge.SetChoiceOrdinal(*pOrdinal);
+			}
+			else
+			{
+				const int Ordinal = InOutTextIDs.Add(TextID);
+				InOutOrdinals.Add(TextID, Ordinal);
+				Edge.SetChoiceOrdinal(Ordinal);
+			}
+		}
+	}
+}
+
+void USUDSScriptNode::ResolveVariableSlots(const TMap<FName, int>& SlotMap)
+{
+	for (auto& Edge : Edges)
+	{
+		Edge.ResolveVariableSlots(SlotMap);
+	}
+}
+
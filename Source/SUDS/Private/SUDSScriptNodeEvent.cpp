@@ -10,3 +10,24 @@ void USUDSScriptNodeEvent::Init(const FString& EvtName, const TArray<FSUDSExpres
 	SourceLineNo = LineNo;
 	
 }
+
+void USUDSScriptNodeEvent::GatherVariableNames(TArray<FName>& OutNames) const
+{
+	Super::GatherVariableNames(OutNames);
+	for (auto& Arg : Args)
+	{
+		for (auto& Name : Arg.GetVariableNames())
+		{
+			OutNames.AddUnique(Name);
+		}
+	}
+}
+
+void USUDSScriptNodeEvent::ResolveVariableSlots(const TMap<FName, int>& SlotMap)
+{
+	Super::ResolveVariableSlots(SlotMap);
+	for (auto& Arg : Args)
+	{
+		Arg.ResolveVariableSlots(SlotMap);
+	}
+}
@@ -9,3 +9,21 @@ void USUDSScriptNodeSet::Init(const FString& VarName, const FSUDSExpression& InE
 	Expression = InExpression;
 	SourceLineNo = LineNo;
 }
+
+void USUDSScriptNodeSet::GatherVariableNames(TArray<FName>& OutNames) const
+{
+	Super::GatherVariableNames(OutNames);
+	OutNames.AddUnique(Identifier);
+	for (auto& Name : Expression.GetVariableNames())
+	{
+		OutNames.AddUnique(Name);
+	}
+}
+
+void USUDSScriptNodeSet::ResolveVariableSlots(const TMap<FName, int>& SlotMap)
+{
+	Super::ResolveVariableSlots(SlotMap);
+	const int* pSlot = SlotMap.Find(Identifier);
+	IdentifierSlot = pSlot ? *pSlot : INDEX_NONE;
+	Expression.ResolveVariableSlots(SlotMap);
+}
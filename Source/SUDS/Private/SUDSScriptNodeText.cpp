@@ -2,61 +2,149 @@
 // Released under the MIT license https://opensource.org/license/MIT/
 #include "SUDSScriptNodeText.h"
 
+#include "Sound/DialogueSoundWaveProxy.h"
+#include "Sound/DialogueWave.h"
+
 void USUDSScriptNodeText::Init(const FString& InSpeakerID, const FText& InText, int LineNo)
 {
 	NodeType = ESUDSScriptNodeType::Text;
 	SpeakerID = InSpeakerID;
 	Text = InText;
-	TextFormat = Text;
 	SourceLineNo = LineNo;
-	bFormatExtracted = false;
+	ExtractParameterNames();
 	
 }
 
+void USUDSScriptNodeText::ResolveVoiceContexts(const UDialogueWave* InWave,
+                                               const UDialogueVoice* Speaker,
+                                               const UDialogueVoice* Target) const
+{
+	VoiceContextWave = InWave;
+	VoiceContextSpeaker = Speaker;
+	VoiceContextTarget = Target;
+	ExactVoiceContextIndex = INDEX_NONE;
+	LooseVoiceContextIndex = INDEX_NONE;
+	if (!InWave)
+	{
+		return;
+	}
+
+	// UDialogueWave's contexts have both speakers and targets, but the GetWaveFromContext method is too restrictive
+	// Instead we'll search the contexts ourselves and be more fuzzy
+	for (int i = 0; i < InWave->ContextMappings.Num(); ++i)
+	{
+		const FDialogueContextMapping& Ctx = InWave->ContextMappings[i];
+		if (Ctx.Context.Speaker == Speaker)
+		{
+			if (LooseVoiceContextIndex == INDEX_NONE)
+			{
+				LooseVoiceContextIndex = i;
+			}
+			if (Ctx.Context.Targets.Contains(Target))
+			{
+				ExactVoiceContextIndex = i;
+				break;
+			}
+		}
+	}
+}
+
+USoundBase* USUDSScriptNodeText::GetVoiceSound(const UDialogueWave* InWave,
+                                               const UDialogueVoice* Speaker,
+                                               const UDialogueVoice* Target,
+                                               bool bAllowAnyTarget) const
+{
+	if (!InWave)
+	{
+		return nullptr;
+	}
+
+	if (VoiceContextWave.Get() != InWave ||
+		VoiceContextSpeaker.Get() != Speaker ||
+		VoiceContextTarget.Get() != Target)
+	{
+		ResolveVoiceContexts(InWave, Speaker, Target);
+	}
+
+	const int Index = ExactVoiceContextIndex != INDEX_NONE || !bAllowAnyTarget
+		                  ? ExactVoiceContextIndex
+		                  : LooseVoiceContextIndex;
+	if (InWave->ContextMappings.IsValidIndex(Index))
+	{
+		// Need to use the proxy according to DialogueWave
+		return InWave->ContextMappings[Index].Proxy;
+	}
+	return nullptr;
+}
+
 FString USUDSScriptNodeText::GetTextID() const
 {
 	return FTextInspector::GetTextId(Text).GetKey().GetChars();
 }
 
-const FTextFormat& USUDSScriptNodeText::GetTextFormat() const
+void USUDSScriptNodeText::ExtractParameterNames()
+{
+	ParameterNames.Empty();
+
+	TArray<FString> TextParams;
+	TextFormat.Get(Text).GetFormatArgumentNames(TextParams);
+	for (auto Param : TextParams)
+	{
+		ParameterNames.Add(FName(Param));
+	}
+	BuildParameterKeys();
+}
+
+void USUDSScriptNodeText::BuildParameterKeys()
 {
-	if (!bFormatExtracted)
+	ParameterKeys.Empty(ParameterNames.Num());
+	for (auto& Name : ParameterNames)
 	{
-		ExtractFormat();
+		// Key as the dialogue has always supplied it, from the name
+		ParameterKeys.Add(Name.ToString());
 	}
-	return TextFormat;
 }
 
-const TArray<FName>& USUDSScriptNodeText::GetParameterNames() const
+void USUDSScriptNodeText::PostLoad()
 {
-	if (!bFormatExtracted)
+	Super::PostLoad();
+
+	// Assets imported before parameter names were stored need them extracted now
+	if (ParameterNames.IsEmpty() && Text.ToString().Contains(TEXT("{")))
 	{
-		ExtractFormat();
+		ExtractParameterNames();
+	}
+	else
+	{
+		BuildParameterKeys();
 	}
-	return ParameterNames;
 }
 
-bool USUDSScriptNodeText::HasParameters() const
+void USUDSScriptNodeText::PrewarmTextFormats(int TextRevision) const
 {
-	if (!bFormatExtracted)
+	Super::PrewarmTextFormats(TextRevision);
+	if (HasParameters())
 	{
-		ExtractFormat();
+		TextFormat.Prewarm(Text, TextRevision);
 	}
-	return !ParameterNames.IsEmpty();
-	
 }
 
-void USUDSScriptNodeText::ExtractFormat() const
+void USUDSScriptNodeText::GatherVariableNames(TArray<FName>& OutNames) const
 {
-	// Only do this on demand, and only once
-	TextFormat = Text;
-	ParameterNames.Empty();
+	Super::GatherVariableNames(OutNames);
+	for (auto& Name : GetParameterNames())
+	{
+		OutNames.AddUnique(Name);
+	}
+}
 
-	TArray<FString> TextParams;
-	TextFormat.GetFormatArgumentNames(TextParams);
-	for (auto Param : TextParams)
+void USUDSScriptNodeText::ResolveVariableSlots(const TMap<FName, int>& SlotMap)
+{
+	Super::ResolveVariableSlots(SlotMap);
+	ParameterSlots.Reset();
+	for (auto& Name : GetParameterNames())
 	{
-		ParameterNames.Add(FName(Param));
+		const int* pSlot = SlotMap.Find(Name);
+		ParameterSlots.Add(pSlot ? *pSlot : INDEX_NONE);
 	}
-	bFormatExtracted = true;
 }
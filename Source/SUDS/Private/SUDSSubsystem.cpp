@@ -1,10 +1,28 @@
 ﻿// Copyright Steve Streeting 2022
 // Released under the MIT license https://opensource.org/license/MIT/
 #include "SUDSSubsystem.h"
+#include "SUDSDialogue.h"
+#include "SUDSLibrary.h"
+#include "SUDSScript.h"
+#include "Internationalization/TextLocalizationManager.h"
+#include "Serialization/ArchiveCountMem.h"
 #include "Sound/SoundConcurrency.h"
+#include "UObject/UObjectHash.h"
 
 DEFINE_LOG_CATEGORY(LogSUDSSubsystem)
 
+FArchive& operator<<(FArchive& Ar, FSUDSGlobalVariablesState& Value)
+{
+	Ar << Value.Variables;
+	return Ar;
+}
+
+void operator<<(FStructuredArchive::FSlot Slot, FSUDSGlobalVariablesState& Value)
+{
+	FStructuredArchive::FRecord Record = Slot.EnterRecord();
+	Record << SA_VALUE(TEXT("Variables"), Value.Variables);
+}
+
 void USUDSSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 {
 	Super::Initialize(Collection);
@@ -12,10 +30,32 @@ void USUDSSubsystem::Initialize(FSubsystemCollectionBase& Collection)
 	// Default to a single voice line being played at once
 	VoiceConcurrency = NewObject<USoundConcurrency>(this);
 	VoiceConcurrency->Concurrency.MaxCount = 1;
+
+	TextRevisionChangedHandle = FTextLocalizationManager::Get().OnTextRevisionChangedEvent.AddUObject(
+		this,
+		&USUDSSubsystem::OnTextRevisionChanged);
 }
 
 void USUDSSubsystem::Deinitialize()
 {
+	FTextLocalizationManager::Get().OnTextRevisionChangedEvent.Remove(TextRevisionChangedHandle);
+	TextRevisionChangedHandle.Reset();
+
+	for (auto& Pair : ScriptCache)
+	{
+		if (Pair.Value.Handle.IsValid())
+		{
+			// Stops holding the script. A load that hasn't finished carries on, but OnScriptLoaded ignores it once
+			// the cache has been emptied below, so pending callbacks aren't called
+			Pair.Value.Handle->ReleaseHandle();
+		}
+	}
+	ScriptCache.Empty();
+	ScriptCacheBytes = 0;
+	EventSubscriptions.Reset();
+	DialoguePools.Empty();
+	GlobalVariables.Empty();
+	
 	Super::Deinitialize();
 }
 
@@ -55,3 +95,427 @@ const FSoundConcurrencySettings& USUDSSubsystem::GetVoicedLineConcurrencySetting
 	return Dummy;
 	
 }
+
+void USUDSSubsystem::RequestScriptAsync(const TSoftObjectPtr<USUDSScript>& Script, FOnSUDSScriptLoaded OnLoaded)
+{
+	RequestScriptAsyncWithCallback(Script, [OnLoaded](USUDSScript* Loaded)
+	{
+		OnLoaded.ExecuteIfBound(Loaded);
+	});
+}
+
+void USUDSSubsystem::RequestScriptAsyncWithCallback(const TSoftObjectPtr<USUDSScript>& Script,
+                                                    TFunction<void(USUDSScript*)>&& OnLoaded)
+{
+	const FSoftObjectPath Path = Script.ToSoftObjectPath();
+	if (Path.IsNull())
+	{
+		UE_LOG(LogSUDSSubsystem, Error, TEXT("Called RequestScriptAsync with a null script"));
+		OnLoaded(nullptr);
+		return;
+	}
+
+	FSUDSScriptCacheEntry& Entry = ScriptCache.FindOrAdd(Path);
+	++Entry.RefCount;
+	Entry.LastUsed = ++ScriptUseCounter;
+
+	if (!Entry.Script)
+	{
+		// May already be loaded, for example if something else hard references it
+		if (USUDSScript* Loaded = Script.Get())
+		{
+			Entry.Script = Loaded;
+			Entry.MemoryBytes = EstimateScriptMemory(Loaded);
+			ScriptCacheBytes += Entry.MemoryBytes;
+		}
+	}
+
+	if (Entry.Script)
+	{
+		OnLoaded(Entry.Script);
+		return;
+	}
+
+	Entry.PendingCallbacks.Add(MoveTemp(OnLoaded));
+	if (!Entry.Handle.IsValid())
+	{
+		Entry.Handle = StreamableManager.RequestAsyncLoad(
+			Path,
+			FStreamableDelegate::CreateUObject(this, &USUDSSubsystem::OnScriptLoaded, Path));
+	}
+}
+
+void USUDSSubsystem::OnScriptLoaded(FSoftObjectPath Path)
+{
+	FSUDSScriptCacheEntry* Entry = ScriptCache.Find(Path);
+	if (!Entry)
+	{
+		// Evicted while loading
+		return;
+	}
+
+	Entry->Script = Cast<USUDSScript>(Path.ResolveObject());
+	if (Entry->Script)
+	{
+		Entry->MemoryBytes = EstimateScriptMemory(Entry->Script);
+		ScriptCacheBytes += Entry->MemoryBytes;
+	}
+	else
+	{
+		UE_LOG(LogSUDSSubsystem, Error, TEXT("Failed to load SUDS script %s"), *Path.ToString());
+	}
+
+	// Callbacks may request other scripts, which can reallocate the cache, so don't hold on to the entry
+	TArray<TFunction<void(USUDSScript*)>> Callbacks = MoveTemp(Entry->PendingCallbacks);
+	USUDSScript* Loaded = Entry->Script;
+	if (!Loaded)
+	{
+		ScriptCache.Remove(Path);
+	}
+	
+	for (auto& Callback : Callbacks)
+	{
+		Callback(Loaded);
+	}
+
+	TrimScriptCache();
+}
+
+void USUDSSubsystem::ReleaseScript(const TSoftObjectPtr<USUDSScript>& Script)
+{
+	if (FSUDSScriptCacheEntry* Entry = ScriptCache.Find(Script.ToSoftObjectPath()))
+	{
+		if (Entry->RefCount > 0)
+		{
+			--Entry->RefCount;
+		}
+		else
+		{
+			UE_LOG(LogSUDSSubsystem, Warning, TEXT("ReleaseScript called more times than RequestScriptAsync for %s"), *Script.ToString());
+		}
+		TrimScriptCache();
+	}
+}
+
+bool USUDSSubsystem::IsScriptResident(const TSoftObjectPtr<USUDSScript>& Script) const
+{
+	const FSUDSScriptCacheEntry* Entry = ScriptCache.Find(Script.ToSoftObjectPath());
+	return Entry && Entry->Script;
+}
+
+void USUDSSubsystem::SetScriptCacheBudget(int64 Bytes)
+{
+	ScriptCacheBudgetBytes = FMath::Max<int64>(Bytes, 0);
+	TrimScriptCache();
+}
+
+void USUDSSubsystem::OnTextRevisionChanged()
+{
+	// Compiled text formats are only valid for the culture they were compiled in. Scripts we're not holding recompile
+	// their formats on demand instead
+	for (auto& Pair : ScriptCache)
+	{
+		if (Pair.Value.Script)
+		{
+			Pair.Value.Script->PrewarmTextFormats();
+		}
+	}
+}
+
+void USUDSSubsystem::TrimScriptCache()
+{
+	// The budget only covers scripts nobody has requested, those still requested don't count towards it
+	SIZE_T IdleBytes = 0;
+	for (auto& Pair : ScriptCache)
+	{
+		if (Pair.Value.RefCount == 0 && Pair.Value.Script)
+		{
+			IdleBytes += Pair.Value.MemoryBytes;
+		}
+	}
+
+	// Evict least recently used scripts that nobody has requested until we're within budget
+	while (IdleBytes > (SIZE_T)ScriptCacheBudgetBytes)
+	{
+		const FSoftObjectPath* OldestPath = nullptr;
+		uint64 OldestUse = MAX_uint64;
+		for (auto& Pair : ScriptCache)
+		{
+			if (Pair.Value.RefCount == 0 && Pair.Value.Script && Pair.Value.LastUsed < OldestUse)
+			{
+				OldestPath = &Pair.Key;
+				OldestUse = Pair.Value.LastUsed;
+			}
+		}
+
+		if (!OldestPath)
+		{
+			break;
+		}
+
+		const FSoftObjectPath Path = *OldestPath;
+		FSUDSScriptCacheEntry& Entry = ScriptCache[Path];
+		ScriptCacheBytes -= Entry.MemoryBytes;
+		IdleBytes -= Entry.MemoryBytes;
+		if (Entry.Handle.IsValid())
+		{
+			Entry.Handle->ReleaseHandle();
+		}
+		// Dialogues pooled for this script would never be used again once it's gone
+		DialoguePools.Remove(Entry.Script.Get());
+		ScriptCache.Remove(Path);
+	}
+}
+
+SIZE_T USUDSSubsystem::EstimateScriptMemory(const USUDSScript* Script)
+{
+	// The script plus all its nodes, which are created with the script as their outer
+	SIZE_T Total = 0;
+	{
+		FArchiveCountMem ScriptMem(const_cast<USUDSScript*>(Script));
+		Total += ScriptMem.GetMax() + Script->GetClass()->GetStructureSize();
+	}
+	ForEachObjectWithOuter(Script, [&Total](UObject* Obj)
+	{
+		FArchiveCountMem ObjMem(Obj);
+		Total += ObjMem.GetMax() + Obj->GetClass()->GetStructureSize();
+	});
+	return Total;
+}
+
+void USUDSSubsystem::CreateDialogueAsync(UObject* Owner,
+                                         const TSoftObjectPtr<USUDSScript>& Script,
+                                         const TArray<UObject*>& Participants,
+                                         FOnSUDSDialogueCreated OnCreated,
+                                         bool bStartImmediately,
+                                         FName StartLabel)
+{
+	// Don't keep the owner or participants alive just because we're waiting for the script
+	const bool bHasOwner = IsValid(Owner);
+	TWeakObjectPtr<UObject> WeakOwner(Owner);
+	TArray<TWeakObjectPtr<UObject>> WeakParticipants;
+	for (auto P : Participants)
+	{
+		WeakParticipants.Add(P);
+	}
+	
+	RequestScriptAsyncWithCallback(Script, [this, Script, bHasOwner, WeakOwner, WeakParticipants, OnCreated, bStartImmediately, StartLabel](USUDSScript* Loaded)
+	{
+		USUDSDialogue* Dlg = nullptr;
+		if (Loaded && (!bHasOwner || WeakOwner.IsValid()))
+		{
+			TArray<UObject*> LiveParticipants;
+			for (auto& P : WeakParticipants)
+			{
+				if (P.IsValid())
+				{
+					LiveParticipants.Add(P.Get());
+				}
+			}
+			Dlg = USUDSLibrary::CreateDialogueWithParticipants(WeakOwner.Get(), Loaded, LiveParticipants, bStartImmediately, StartLabel);
+		}
+		// The dialogue holds its own reference to the script, we only needed it resident until now
+		if (Loaded)
+		{
+			ReleaseScript(Script);
+		}
+		OnCreated.ExecuteIfBound(Dlg);
+	});
+}
+
+void USUDSSubsystem::SubscribeToEvent(FName EventName, FOnSUDSNamedEvent Handler)
+{
+	EventSubscriptions.Subscribe(EventName, Handler);
+}
+
+void USUDSSubsystem::UnsubscribeFromEvent(FName EventName, FOnSUDSNamedEvent Handler)
+{
+	EventSubscriptions.Unsubscribe(EventName, Handler);
+}
+
+bool USUDSSubsystem::SubscribeFunctionToEvent(FName EventName, UObject* Object, FName FunctionName)
+{
+	if (FunctionName.IsNone())
+	{
+		FunctionName = EventName;
+	}
+	if (!EventSubscriptions.SubscribeFunction(EventName, Object, FunctionName))
+	{
+		UE_LOG(LogSUDSSubsystem,
+		       Error,
+		       TEXT("Can't subscribe to event %s: %s has no function %s with parameters (Dialogue, EventName, Arguments)"),
+		       *EventName.ToString(),
+		       *GetNameSafe(Object),
+		       *FunctionName.ToString());
+		return false;
+	}
+	return true;
+}
+
+void USUDSSubsystem::UnsubscribeObjectFromEvents(UObject* Object)
+{
+	EventSubscriptions.UnsubscribeAll(Object);
+}
+
+USUDSDialogue* USUDSSubsystem::AcquireDialogue(USUDSScript* Script, bool bStartImmediately, FName StartLabel)
+{
+	return AcquireDialogueWithParticipants(Script, TArray<UObject*>(), bStartImmediately, StartLabel);
+}
+
+USUDSDialogue* USUDSSubsystem::AcquireDialogueWithParticipants(USUDSScript* Script,
+                                                               const TArray<UObject*>& Participants,
+                                                               bool bStartImmediately,
+                                                               FName StartLabel)
+{
+	if (!IsValid(Script))
+	{
+		UE_LOG(LogSUDSSubsystem, Error, TEXT("Called AcquireDialogue with an invalid script"));
+		return nullptr;
+	}
+
+	USUDSDialogue* Dlg = nullptr;
+	if (FSUDSDialoguePool* Pool = DialoguePools.Find(Script))
+	{
+		while (!Dlg && Pool->FreeDialogues.Num() > 0)
+		{
+			Dlg = Pool->FreeDialogues.Pop();
+			if (!IsValid(Dlg))
+			{
+				Dlg = nullptr;
+			}
+		}
+	}
+
+	if (Dlg)
+	{
+		++DialoguePoolStats.Hits;
+	}
+	else
+	{
+		++DialoguePoolStats.Misses;
+		// Pooled dialogues are owned by us so that we can take them back; GetWorld() still works via the game instance
+		const FName Name = MakeUniqueObjectName(this, USUDSDialogue::StaticClass(), Script->GetFName());
+		Dlg = NewObject<USUDSDialogue>(this, Name);
+	}
+
+	// Same order as CreateDialogueWithParticipants, participants may provide variables to the header
+	Dlg->SetParticipants(Participants);
+	Dlg->Initialise(Script);
+	if (bStartImmediately)
+	{
+		Dlg->Start(StartLabel);
+	}
+	return Dlg;
+}
+
+void USUDSSubsystem::ReleaseDialogue(USUDSDialogue* Dialogue)
+{
+	if (!IsValid(Dialogue))
+	{
+		return;
+	}
+	if (Dialogue->GetOuter() != this)
+	{
+		UE_LOG(LogSUDSSubsystem, Warning, TEXT("ReleaseDialogue called with %s which wasn't acquired from the pool, ignoring"), *Dialogue->GetName());
+		return;
+	}
+	const USUDSScript* Script = Dialogue->GetScript();
+	if (!Script)
+	{
+		// Already released
+		return;
+	}
+
+	Dialogue->ResetForReuse();
+	++DialoguePoolStats.Released;
+
+	// Drop pools whose scripts have since been destroyed
+	for (auto It = DialoguePools.CreateIterator(); It; ++It)
+	{
+		if (!It.Key().IsValid())
+		{
+			It.RemoveCurrent();
+		}
+	}
+
+	FSUDSDialoguePool& Pool = DialoguePools.FindOrAdd(Script);
+	if (Pool.FreeDialogues.Num() < MaxPooledDialoguesPerScript)
+	{
+		Pool.FreeDialogues.Add(Dialogue);
+	}
+	else
+	{
+		++DialoguePoolStats.Discarded;
+	}
+}
+
+void USUDSSubsystem::SetMaxPooledDialoguesPerScript(int MaxDialogues)
+{
+	MaxPooledDialoguesPerScript = FMath::Max(MaxDialogues, 0);
+	for (auto& Pair : DialoguePools)
+	{
+		if (Pair.Value.FreeDialogues.Num() > MaxPooledDialoguesPerScript)
+		{
+			Pair.Value.FreeDialogues.SetNum(MaxPooledDialoguesPerScript);
+		}
+	}
+}
+
+int USUDSSubsystem::GetNumPooledDialogues() const
+{
+	int Total = 0;
+	for (auto& Pair : DialoguePools)
+	{
+		Total += Pair.Value.FreeDialogues.Num();
+	}
+	return Total;
+}
+
+void USUDSSubsystem::EmptyDialoguePool()
+{
+	DialoguePools.Empty();
+}
+
+void USUDSSubsystem::SetGlobalVariableImpl(const FName& FullName, const FSUDSValue& Value, USUDSDialogue* FromDialogue)
+{
+	const FSUDSValue* OldValue = GlobalVariables.Find(FullName);
+	if (Value.IsEmpty())
+	{
+		if (!OldValue)
+		{
+			return;
+		}
+		GlobalVariables.Remove(FullName);
+	}
+	else
+	{
+		if (OldValue && OldValue->GetType() == Value.GetType() && !(*OldValue != Value).GetBooleanValue())
+		{
+			return;
+		}
+		GlobalVariables.Add(FullName, Value);
+	}
+	++GlobalVariablesVersion;
+	OnGlobalVariableChanged.Broadcast(FullName, Value, FromDialogue);
+}
+
+FName USUDSSubsystem::GetGlobalVariableKey(const FName& Name)
+{
+	if (Name.IsNone() || IsSUDSGlobalVariableName(Name))
+	{
+		return Name;
+	}
+	return FName(FString(SUDS_GLOBAL_VARIABLE_PREFIX) + Name.ToString());
+}
+
+void USUDSSubsystem::ResetGlobalVariables()
+{
+	GlobalVariables.Empty();
+	++GlobalVariablesVersion;
+}
+
+void USUDSSubsystem::RestoreGlobalVariablesState(const FSUDSGlobalVariablesState& State)
+{
+	GlobalVariables = State.GetVariables();
+	++GlobalVariablesVersion;
+}
@@ -4,8 +4,13 @@
 
 FArchive& operator<<(FArchive& Ar, FSUDSValue& Value)
 {
-	// Custom serialisation since we can't auto-serialise union, TOptional
+	// Custom serialisation since we can't auto-serialise union
+	// Format predates the compact layout, text & names were optional
 	uint8 TypeAsInt = (uint8)Value.Type; 
+	if (Ar.IsLoading())
+	{
+		Value.ReleasePayload();
+	}
 	Ar << TypeAsInt;
 	if (Ar.IsLoading())
 		Value.Type = static_cast<ESUDSValueType>(TypeAsInt);
@@ -15,17 +20,17 @@ FArchive& operator<<(FArchive& Ar, FSUDSValue& Value)
 
 	if (Value.Type == ESUDSValueType::Text)
 	{
-		FText Text = Value.TextValue.Get(FText::GetEmpty());
+		FText Text = Value.GetTextValue();
 		Ar << Text;
 		if (Ar.IsLoading())
-			Value.TextValue = Text;
+			Value.SetText(new FSUDSSharedText(MoveTemp(Text)));
 	}
-	else if (Value.Type == ESUDSValueType::Variable || Value.Type == ESUDSValueType::Name)
+	else if (Value.HasName())
 	{
-		FString VarNameStr = Value.Name.Get(NAME_None).ToString();
+		FString VarNameStr = Value.GetNameValue().ToString();
 		Ar << VarNameStr;
 		if (Ar.IsLoading())
-			Value.Name = FName(VarNameStr);
+			Value.NameValue = NameToMinimalName(FName(VarNameStr));
 	}
 		
 	return Ar;
@@ -33,18 +38,34 @@ FArchive& operator<<(FArchive& Ar, FSUDSValue& Value)
 
 void operator<<(FStructuredArchive::FSlot Slot, FSUDSValue& Value)
 {
+	if (Slot.GetUnderlyingArchive().IsLoading())
+	{
+		Value.ReleasePayload();
+	}
 	FStructuredArchive::FRecord Record = Slot.EnterRecord();
 	Record
 		<< SA_VALUE(TEXT("Type"), Value.Type)
 		<< SA_VALUE(TEXT("IntValue"), Value.IntValue); // gets/sets float/boolean/gender too
 
+	// Text & name were optionals before the compact layout, keep the same format
+	const bool bLoading = Slot.GetUnderlyingArchive().IsLoading();
 	if (Value.Type == ESUDSValueType::Text)
 	{
-		Record << SA_VALUE(TEXT("TextValue"), Value.TextValue);
+		TOptional<FText> TextValue;
+		if (!bLoading)
+			TextValue = Value.GetTextValue();
+		Record << SA_VALUE(TEXT("TextValue"), TextValue);
+		if (bLoading)
+			Value.SetText(new FSUDSSharedText(TextValue.Get(FText::GetEmpty())));
 	}
-	else if (Value.Type == ESUDSValueType::Variable || Value.Type == ESUDSValueType::Name)
+	else if (Value.HasName())
 	{
-		Record << SA_VALUE(TEXT("Name"), Value.Name);
+		TOptional<FName> Name;
+		if (!bLoading)
+			Name = Value.GetNameValue();
+		Record << SA_VALUE(TEXT("Name"), Name);
+		if (bLoading)
+			Value.NameValue = NameToMinimalName(Name.Get(NAME_None));
 	}
 
 }
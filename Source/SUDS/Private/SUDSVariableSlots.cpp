@@ -0,0 +1,76 @@
+﻿// Copyright Steve Streeting 2022
+// Released under the MIT license https://opensource.org/license/MIT/
+#include "SUDSVariableSlots.h"
+
+void FSUDSVariableSlots::Init(const TSharedPtr<const TArray<FSUDSValue>>& InBase, int32 InNumSlots, uint32 InVersion)
+{
+	Base = InBase;
+	NumSlots = InNumSlots;
+	BaseVersion = InVersion;
+	Overlay.Reset();
+	Flat.Reset();
+	FlatVersions.Reset();
+	bFlat = false;
+}
+
+void FSUDSVariableSlots::Reset()
+{
+	Init(nullptr, 0, 0);
+}
+
+void FSUDSVariableSlots::Set(int32 Slot, const FSUDSValue& Value, uint32 Version)
+{
+	check(IsValidIndex(Slot));
+	if (bFlat)
+	{
+		Flat[Slot] = Value;
+		FlatVersions[Slot] = Version;
+		return;
+	}
+
+	for (FOverlayEntry& Entry : Overlay)
+	{
+		if (Entry.Slot == Slot)
+		{
+			Entry.Value = Value;
+			Entry.Version = Version;
+			return;
+		}
+	}
+
+	if (Overlay.Num() < MaxOverlayEntries)
+	{
+		Overlay.Add(FOverlayEntry { Slot, Version, Value });
+	}
+	else
+	{
+		Flatten();
+		Flat[Slot] = Value;
+		FlatVersions[Slot] = Version;
+	}
+}
+
+void FSUDSVariableSlots::Flatten()
+{
+	if (Base.IsValid())
+	{
+		Flat = *Base;
+	}
+	Flat.SetNum(NumSlots);
+	FlatVersions.Init(BaseVersion, NumSlots);
+	for (const FOverlayEntry& Entry : Overlay)
+	{
+		Flat[Entry.Slot] = Entry.Value;
+		FlatVersions[Entry.Slot] = Entry.Version;
+	}
+	// Drop the overlay's allocation too, we won't be using it again until re-initialised
+	Overlay.Empty();
+	Base.Reset();
+	bFlat = true;
+}
+
+const FSUDSValue& FSUDSVariableSlots::GetEmptyValue()
+{
+	static const FSUDSValue Empty;
+	return Empty;
+}
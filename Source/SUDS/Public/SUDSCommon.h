@@ -2,6 +2,20 @@
 // Released under the MIT license https://opensource.org/license/MIT/
 #pragma once
 
+#include "CoreMinimal.h"
+
 // Use DECLARE_LOG_CATEGORY_CLASS not DECLARE_LOG_CATEGORY_EXTERN because we use UE_LOG in headers
 DECLARE_LOG_CATEGORY_CLASS(LogSUDS, Warning, All)
 
+/// Variables whose names start with this prefix are global, held once by USUDSSubsystem and shared by all dialogues
+#define SUDS_GLOBAL_VARIABLE_PREFIX TEXT("global.")
+
+/// Variable slot used for global variables, which aren't stored in the dialogue
+constexpr int SUDS_GLOBAL_VARIABLE_SLOT = -2;
+
+/// Whether a variable name refers to a global variable (e.g. "global.Reputation")
+inline bool IsSUDSGlobalVariableName(const FName& Name)
+{
+	const FNameBuilder Builder(Name);
+	return Builder.ToView().StartsWith(SUDS_GLOBAL_VARIABLE_PREFIX, ESearchCase::IgnoreCase);
+}
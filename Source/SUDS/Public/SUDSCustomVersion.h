@@ -0,0 +1,29 @@
+﻿// Copyright Steve Streeting 2022
+// Released under the MIT license https://opensource.org/license/MIT/
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/Guid.h"
+
+/// Versions of SUDS runtime data which is serialised by hand, such as FSUDSDialogueState
+struct SUDS_API FSUDSCustomVersion
+{
+	enum Type
+	{
+		/// Before any version was recorded
+		BeforeCustomVersionWasAdded = 0,
+		/// Dialogue state records lines seen and choices taken as bits indexed by script ordinals, with the text IDs
+		/// of lines seen alongside choices taken so they can be mapped onto an edited script
+		VisitedBits,
+
+		// -----<new versions can be added above this line>-------------------------------------------------
+		VersionPlusOne,
+		LatestVersion = VersionPlusOne - 1
+	};
+
+	/// The GUID for this custom version number
+	const static FGuid GUID;
+
+private:
+	FSUDSCustomVersion() {}
+};
@@ -4,7 +4,10 @@
 
 #include "CoreMinimal.h"
 #include "SUDSScriptNode.h"
+#include "SUDSEventSubscriptions.h"
 #include "SUDSExpression.h"
+#include "SUDSNativeParticipant.h"
+#include "SUDSVariableSlots.h"
 #include "UObject/Object.h"
 #include "SUDSDialogue.generated.h"
 
@@ -14,8 +17,10 @@ struct FSUDSScriptEdge;
 class USUDSScriptNode;
 class USUDSScript;
 class UDialogueWave;
+struct FStreamableHandle;
 class UDialogueVoice;
 class USoundBase;
+class USUDSSubsystem;
 
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnDialogueSpeakerLine, class USUDSDialogue*, Dialogue);
@@ -27,6 +32,57 @@ DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnDialogueEvent, class USUDSDial
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_FourParams(FOnVariableChangedEvent, class USUDSDialogue*, Dialogue, FName, VariableName, const FSUDSValue&, Value, bool, bFromScript);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnVariableRequestedEvent, class USUDSDialogue*, Dialogue, FName, VariableName);
 
+/// A participant with how to call it resolved up-front, when it's added to the dialogue
+struct FSUDSParticipantDispatch
+{
+	/// The participant. Weak because USUDSDialogue::Participants can be cleared by GC if the participant is destroyed
+	TWeakObjectPtr<UObject> Object;
+	/// Set if the participant implements ISUDSNativeParticipant, which is then called directly. Only valid while
+	/// Object is
+	ISUDSNativeParticipant* Native = nullptr;
+	int Priority = 0;
+	/// Which callbacks are worth calling on this participant
+	ESUDSParticipantCallback Callbacks = ESUDSParticipantCallback::None;
+
+	/// Whether this participant should be called for a callback, false if it has since been destroyed
+	bool Handles(ESUDSParticipantCallback Callback) const
+	{
+		return EnumHasAnyFlags(Callbacks, Callback) && Object.IsValid();
+	}
+};
+
+/// A resolved copy of parameterised text, and the state it was resolved with
+struct FSUDSResolvedTextCacheEntry
+{
+	FText Text;
+	/// Arguments last used to format the text, updated in place so keys aren't reallocated on every format
+	FFormatNamedArguments Args;
+	/// Highest version of any variable the text referenced
+	uint32 VariablesVersion = 0;
+	/// Text localisation revision, changes with the culture
+	int TextRevision = INDEX_NONE;
+	bool bValid = false;
+};
+
+/// Counters for how effective voice prefetching has been, see USUDSDialogue::SetVoicePrefetchDepth
+USTRUCT(BlueprintType)
+struct SUDS_API FSUDSVoicePrefetchStats
+{
+	GENERATED_BODY()
+
+	/// Voiced lines which were reached with their wave already prefetched and loaded
+	UPROPERTY(BlueprintReadOnly, Category="SUDS")
+	int Hits = 0;
+
+	/// Voiced lines which were reached without their wave being prefetched, or before it had finished loading
+	UPROPERTY(BlueprintReadOnly, Category="SUDS")
+	int Misses = 0;
+
+	/// Voiced lines which were prefetched but then not reached
+	UPROPERTY(BlueprintReadOnly, Category="SUDS")
+	int Wasted = 0;
+};
+
 #if WITH_EDITOR
 	// Non-dynamic events for editor use
 	DECLARE_DELEGATE_TwoParams(FOnDialogueSpeakerLineInternal, class USUDSDialogue* /* Dialogue */, int /*SourceLineNo*/);
@@ -54,11 +110,30 @@ protected:
 	UPROPERTY(BlueprintReadOnly, SaveGame, Category="SUDS|Dialogue")
 	TMap<FName, FSUDSValue> Variables;
 
+	/// Text IDs of the choices taken. Only used on restore if the script's lines or choices have changed since this
+	/// was saved, otherwise ChoicesTakenBits is used
 	UPROPERTY(BlueprintReadOnly, SaveGame, Category="SUDS|Dialogue")
 	TArray<FString> ChoicesTaken;
 
 	UPROPERTY(BlueprintReadOnly, SaveGame, Category="SUDS|Dialogue")
 	TArray<FString> ReturnStack;
+
+	/// Text IDs of the speaker lines seen, used in the same way as ChoicesTaken
+	UPROPERTY(BlueprintReadOnly, SaveGame, Category="SUDS|Dialogue")
+	TArray<FString> LinesSeen;
+
+	/// Choices taken, as bits indexed by the script's choice ordinals
+	UPROPERTY(SaveGame)
+	TArray<uint32> ChoicesTakenBits;
+
+	/// Speaker lines seen, as bits indexed by the script's line ordinals
+	UPROPERTY(SaveGame)
+	TArray<uint32> LinesSeenBits;
+
+	/// The script's ordinal layout when saved, see USUDSScript::GetOrdinalLayoutHash. The bits are only valid if this
+	/// still matches
+	UPROPERTY(SaveGame)
+	uint32 OrdinalLayoutHash = 0;
 	
 public:
 	FSUDSDialogueState() {}
@@ -73,11 +148,35 @@ public:
 	{
 	}
 
+	FSUDSDialogueState(const FString& TxtID,
+	                   const TMap<FName, FSUDSValue>& InVars,
+	                   const TArray<FString>& InChoices,
+	                   const TArray<FString>& InLinesSeen,
+	                   const TArray<uint32>& InChoiceBits,
+	                   const TArray<uint32>& InLineBits,
+	                   uint32 InOrdinalLayoutHash,
+	                   const TArray<FString>& InReturnStack) : TextNodeID(TxtID),
+	                                                           Variables(InVars),
+	                                                           ChoicesTaken(InChoices),
+	                                                           ReturnStack(InReturnStack),
+	                                                           LinesSeen(InLinesSeen),
+	                                                           ChoicesTakenBits(InChoiceBits),
+	                                                           LinesSeenBits(InLineBits),
+	                                                           OrdinalLayoutHash(InOrdinalLayoutHash)
+	{
+	}
+
 	const FString& GetTextNodeID() const { return TextNodeID; }
 	const TMap<FName, FSUDSValue>& GetVariables() const { return Variables; }
 	const TArray<FString>& GetChoicesTaken() const { return ChoicesTaken; }
 	const TArray<FString>& GetReturnStack() const { return ReturnStack; }
+	const TArray<FString>& GetLinesSeen() const { return LinesSeen; }
+	const TArray<uint32>& GetChoicesTakenBits() const { return ChoicesTakenBits; }
+	const TArray<uint32>& GetLinesSeenBits() const { return LinesSeenBits; }
+	uint32 GetOrdinalLayoutHash() const { return OrdinalLayoutHash; }
 
+	/// Versioned with FSUDSCustomVersion. If you serialise to a plain archive which doesn't record custom versions,
+	/// such as FMemoryWriter, save Ar.GetCustomVersions() alongside and restore them on the reader
 	SUDS_API friend FArchive& operator<<(FArchive& Ar, FSUDSDialogueState& Value);
 	SUDS_API friend void operator<<(FStructuredArchive::FSlot Slot, FSUDSDialogueState& Value);
 	bool Serialize(FStructuredArchive::FSlot Slot)
@@ -151,24 +250,69 @@ protected:
 	/// External objects which want to closely participate in the dialogue (not just listen to events)
 	UPROPERTY()
 	TArray<UObject*> Participants;
+
+	/// Participants in call order, with their priorities & implemented callbacks cached
+	TArray<FSUDSParticipantDispatch> ParticipantDispatch;
+	/// Whether any participant handles events
+	bool bParticipantsHandleEvents = false;
+
+	/// Handlers for specific events, see SubscribeToEvent
+	FSUDSEventSubscriptions EventSubscriptions;
 	
 
 	/// All of the dialogue variables
 	/// Dialogue variable state is all held locally. Dialogue participants can retrieve or set values in state.
 	/// All state is saved with the dialogue. Variables can be used as text substitution parameters, conditionals,
 	/// or communication with external state.
+	/// Variables the script references are held in VariableSlots, indexed by the script's variable slot, with an
+	/// Empty value meaning unset. These share the script's header defaults where possible, see FSUDSVariableSlots.
+	/// Anything else set at runtime goes in OverflowVariables.
+	/// Global variables ("global.X") aren't held here at all, but in GlobalVariableHost, so there's one copy shared by
+	/// all dialogues. If there's no subsystem (e.g. when running outside a game world) they go in OverflowVariables.
 	typedef TMap<FName, FSUDSValue> FSUDSValueMap;
-	FSUDSValueMap VariableState;
+	FSUDSVariableSlots VariableSlots;
+	FSUDSValueMap OverflowVariables;
+	TWeakObjectPtr<USUDSSubsystem> GlobalVariableHost;
 
 	/// Stack of Gosub nodes to return to
 	UPROPERTY()
 	TArray<USUDSScriptNodeGosub*> GosubReturnStack;
 
-	/// Set of all the TextIDs of choices taken already in this dialogue
-	TSet<FString> ChoicesTaken;
+	/// Choices taken already in this dialogue, indexed by the script's choice ordinals
+	TBitArray<> ChoicesTaken;
+	/// Speaker lines seen already in this dialogue, indexed by the script's line ordinals
+	TBitArray<> LinesSeen;
+	/// Whether the current speaker line had already been seen before it was reached this time
+	bool bCurrentLineSeenBefore = false;
 
 	TSet<FName> CurrentRequestedParamNames;
 	bool bParamNamesExtracted;
+
+	/// Whether expression variables are requested only when read, rather than all up-front
+	bool bLazyVariableRequests = false;
+
+	/// Whether we're currently running the header nodes, which means edge indexes refer to the header node list
+	bool bRunningHeader = false;
+
+	/// Whether resolved parameterised text is cached until a variable it uses changes. Opt-in, see SetResolvedTextCaching
+	bool bCacheResolvedText = false;
+	/// Incremented on every variable change, the latest value is recorded against the changed variable
+	uint32 VariableVersionCounter = 0;
+	/// Version shared by all variables without slots
+	uint32 OverflowVariablesVersion = 0;
+	FSUDSResolvedTextCacheEntry CurrentTextCache;
+	TArray<FSUDSResolvedTextCacheEntry> ChoiceTextCache;
+
+	/// Keeps the current line's voice assets loaded
+	TSharedPtr<FStreamableHandle> VoiceAssetsHandle;
+
+	/// How many speaker lines ahead to prefetch voice assets for, 0 to disable
+	int VoicePrefetchDepth = 0;
+	/// Upcoming voiced lines which have been prefetched
+	TSet<const USUDSScriptNodeText*> PrefetchedLines;
+	/// Keeps prefetched voice assets loaded
+	TSharedPtr<FStreamableHandle> PrefetchHandle;
+	FSUDSVoicePrefetchStats VoicePrefetchStats;
 	
 	/// Cached derived info
 	mutable FText CurrentSpeakerDisplayName;
@@ -179,6 +323,8 @@ protected:
 	static const FString DummyString;
 
 	void InitVariables();
+	/// Forget all choices taken & lines seen
+	void ResetVisited();
 	void RunUntilNextSpeakerNodeOrEnd(USUDSScriptNode* FromNode, bool bRaiseAtEnd);
 	const USUDSScriptNode* WalkToNextChoiceNode(USUDSScriptNode* FromNode, bool bExecute);
 	USUDSScriptNode* RecurseWalkToNextChoiceOrTextNode(USUDSScriptNode* Node, bool bExecute, TArray<USUDSScriptNodeGosub*>& LocalGosubStack);
@@ -186,6 +332,7 @@ protected:
 	const USUDSScriptNode* FindNextChoiceNode(USUDSScriptNode* FromNode);
 	void SetCurrentSpeakerNode(USUDSScriptNodeText* Node, bool bQuietly);
 	void SortParticipants();
+	static FSUDSParticipantDispatch ResolveParticipantDispatch(UObject* Participant);
 	void RaiseStarting(FName StartLabel);
 	void RaiseFinished();
 	void RaiseNewSpeakerLine();
@@ -194,8 +341,14 @@ protected:
 	void RaiseVariableChange(const FName& VarName, const FSUDSValue& Value, bool bFromScript, int LineNo);
 	void RaiseVariableRequested(const FName& VarName, int LineNo);
 	void RaiseExpressionVariablesRequested(const FSUDSExpression& Expression, int LineNo);
+	FSUDSValue EvaluateExpression(const FSUDSExpression& Expression, int LineNo);
+	bool EvaluateCondition(const FSUDSExpression& Expression, int LineNo);
 
 	USUDSScriptNode* GetNextNode(USUDSScriptNode* Node);
+	USUDSScriptNode* GetEdgeTarget(const FSUDSScriptEdge& Edge) const;
+	void RunHeader();
+	/// Whether anything would be told about variables being changed
+	bool HasVariableChangeListeners() const;
 	bool IsChoiceOrTextNode(ESUDSScriptNodeType Type);
 	USUDSScriptNode* RunNode(USUDSScriptNode* Node);
 	USUDSScriptNode* RunSelectNode(USUDSScriptNode* Node);
@@ -206,23 +359,101 @@ protected:
 	void UpdateChoices();
 	void RecurseAppendChoices(const USUDSScriptNode* Node, TArray<FSUDSScriptEdge>& OutChoices);
 	USoundBase* GetSoundForCurrentLine(bool bAllowAnyTarget) const;
+	void RequestVoiceAssetsForCurrentLine();
+	/// Request the voice assets for the lines which could follow the current one. If bLineReached, the current line
+	/// has just been reached, so how well the previous prefetch did is added to the stats
+	void UpdateVoicePrefetch(bool bLineReached);
+	void GatherUpcomingVoicedLines(const USUDSScriptNode* FromNode,
+	                               int DepthLeft,
+	                               int& StepsLeft,
+	                               TSet<const USUDSScriptNodeText*>& OutLines) const;
+	static void PrimeWaveSounds(const UDialogueWave* Wave);
 	UDialogueVoice* GetTargetVoice() const;
 	class USoundConcurrency* GetVoiceSoundConcurrency() const;
 
-	FText ResolveParameterisedText(const TArray<FName> Params, const FTextFormat& TextFormat, int LineNo);
-	void GetTextFormatArgs(const TArray<FName>& ArgNames, FFormatNamedArguments& OutArgs) const;
+	/// Resolve the text of a speaker node or choice edge
+	template <typename TextSource>
+	FText ResolveParameterisedText(const TextSource& Source, FSUDSResolvedTextCacheEntry& Cache);
+	uint32 GetVariablesVersion(const TArray<FName>& Names, const TArray<int>& Slots) const;
+	/// Store a variable's value (Empty to unset it) and record that it changed, the slot versions being kept with
+	/// the values
+	void StoreVariable(const FName& Name, int Slot, const FSUDSValue& Value)
+	{
+		++VariableVersionCounter;
+		if (VariableSlots.IsValidIndex(Slot))
+		{
+			VariableSlots.Set(Slot, Value, VariableVersionCounter);
+		}
+		else if (Slot == SUDS_GLOBAL_VARIABLE_SLOT && GlobalVariableHost.IsValid())
+		{
+			StoreGlobalVariable(Name, Value);
+		}
+		else
+		{
+			if (Value.IsEmpty())
+			{
+				OverflowVariables.Remove(Name);
+			}
+			else
+			{
+				OverflowVariables.Add(Name, Value);
+			}
+			OverflowVariablesVersion = VariableVersionCounter;
+		}
+	}
+	void GetTextFormatArgs(const TArray<FName>& ArgNames,
+	                       const TArray<FString>& ArgKeys,
+	                       const TArray<int>& ArgSlots,
+	                       FFormatNamedArguments& InOutArgs) const;
 	bool CurrentNodeHasChoices() const;
 	void SetVariableImpl(FName Name, const FSUDSValue& Value, bool bFromScript, int LineNo)
 	{
-		const FSUDSValue OldValue = GetVariable(Name);
-		if (!IsVariableSet(Name) ||
-			(OldValue != Value).GetBooleanValue())
+		SetVariableImpl(Name, INDEX_NONE, Value, bFromScript, LineNo);
+	}
+	void SetVariableImpl(FName Name, int Slot, const FSUDSValue& Value, bool bFromScript, int LineNo)
+	{
+		if (Slot == INDEX_NONE)
 		{
-			VariableState.Add(Name, Value);
+			Slot = GetVariableSlot(Name);
+		}
+		const FSUDSValue* OldValue = FindVariableInSlot(Name, Slot);
+		if (!OldValue ||
+			(*OldValue != Value).GetBooleanValue())
+		{
+			StoreVariable(Name, Slot, Value);
 			RaiseVariableChange(Name, Value, bFromScript, LineNo);
 		}
 		
 	}
+	int GetVariableSlot(const FName& Name) const;
+	/// Find a set variable, null if unset
+	const FSUDSValue* FindVariable(const FName& Name) const
+	{
+		return FindVariableInSlot(Name, GetVariableSlot(Name));
+	}
+	/// Find a set variable when its slot has already been resolved (INDEX_NONE if it has none), null if unset
+	const FSUDSValue* FindVariableInSlot(const FName& Name, int Slot) const
+	{
+		if (VariableSlots.IsValidIndex(Slot))
+		{
+			const FSUDSValue& Value = VariableSlots.Get(Slot);
+			return Value.IsEmpty() ? nullptr : &Value;
+		}
+		if (Slot == SUDS_GLOBAL_VARIABLE_SLOT && GlobalVariableHost.IsValid())
+		{
+			return FindGlobalVariable(Name);
+		}
+		return OverflowVariables.Find(Name);
+	}
+	FSUDSExpressionVariables GetExpressionVariables() const
+	{
+		return FSUDSExpressionVariables(VariableSlots, OverflowVariables, GetGlobalVariableMap());
+	}
+	/// Global variable access via GlobalVariableHost, which must be valid
+	const FSUDSValue* FindGlobalVariable(const FName& Name) const;
+	void StoreGlobalVariable(const FName& Name, const FSUDSValue& Value);
+	/// The global variables if we have a subsystem to hold them, otherwise null
+	const FSUDSValueMap* GetGlobalVariableMap() const;
 
 public:
 	USUDSDialogue();
@@ -231,6 +462,13 @@ public:
 	//		UE_LOG(LogTemp, Warning, TEXT("*********** Destroyed Dialogue!"));
 	// }
 	void Initialise(const USUDSScript* Script);
+
+	/**
+	 * Return this dialogue to a blank state so it can be initialised again, as if newly created. Participants,
+	 * event subscriptions and delegate bindings are all removed, and settings revert to their defaults; containers
+	 * keep their allocations. Used by the dialogue pool in USUDSSubsystem, see AcquireDialogue.
+	 */
+	void ResetForReuse();
 	
 	/// Get the script asset this dialogue is based on
 	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue")
@@ -274,6 +512,79 @@ public:
 	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
 	void SetParticipants(const TArray<UObject*>& NewParticipants);
 
+	/**
+	 * Subscribe a handler to a specific event raised by the script. Unlike OnEvent, the handler is only called for
+	 * the event it's subscribed to. If nothing at all wants an event (no subscribers, no participants handling events
+	 * and no OnEvent listeners), its arguments aren't even evaluated.
+	 * Subscribers are called after participants, and before OnEvent listeners.
+	 * See also USUDSSubsystem::SubscribeToEvent for subscribing to events from all dialogues.
+	 * @param EventName The name of the event
+	 * @param Handler The handler to call
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
+	void SubscribeToEvent(FName EventName, FOnSUDSNamedEvent Handler);
+
+	/// Remove a handler subscribed with SubscribeToEvent
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
+	void UnsubscribeFromEvent(FName EventName, FOnSUDSNamedEvent Handler);
+
+	/**
+	 * Subscribe a function on an object, found by name, to a specific event raised by the script. 
+	 * @param EventName The name of the event
+	 * @param Object The object to call
+	 * @param FunctionName The name of the function to call, which must have the same parameters as OnEvent. If None,
+	 *   the function with the same name as the event is called.
+	 * @return Whether a suitable function was found
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
+	bool SubscribeFunctionToEvent(FName EventName, UObject* Object, FName FunctionName = NAME_None);
+
+	/**
+	 * Subscribe every participant which has a function with a given name to a specific event raised by the script.
+	 * Call this after adding participants.
+	 * @param EventName The name of the event
+	 * @param FunctionName The name of the function to call on participants, which must have the same parameters as
+	 *   OnEvent. If None, the function with the same name as the event is called.
+	 * @return The number of participants subscribed
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
+	int SubscribeParticipantsToEvent(FName EventName, FName FunctionName = NAME_None);
+
+	/// Remove all event subscriptions which call an object
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
+	void UnsubscribeObjectFromEvents(UObject* Object);
+
+	/**
+	 * Choose when variable requests (OnVariableRequested / ISUDSParticipant::OnDialogueVariableRequested) are raised
+	 * for conditions and expressions in the script.
+	 * By default, every variable an expression refers to is requested before the expression is evaluated. If you
+	 * enable lazy requests, each variable is only requested the first time evaluation actually reads it; so in
+	 * "{HasQuest} and {QuestStage} > 3", QuestStage is not requested at all if HasQuest is false. Use this if your
+	 * variable requests are expensive.
+	 * @param bLazy Whether to only request variables when they're read
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
+	void SetLazyVariableRequests(bool bLazy) { bLazyVariableRequests = bLazy; }
+
+	/// Get whether variable requests are only raised when an expression actually reads the variable
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue")
+	bool IsUsingLazyVariableRequests() const { return bLazyVariableRequests; }
+
+	/**
+	 * Choose whether text with parameters is cached once resolved. 
+	 * By default, GetText and GetChoiceText resolve the text every time they're called, requesting the variables it
+	 * uses each time (see OnVariableRequested). With caching enabled, the text is resolved once, then the same result
+	 * is returned until one of those variables is changed, or the culture changes. This makes calling them every frame
+	 * cheap, but only enable it if the values you supply on request are always set on the dialogue when they change.
+	 * @param bCache Whether to cache resolved text
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
+	void SetResolvedTextCaching(bool bCache);
+
+	/// Get whether resolved text with parameters is cached until the variables it uses change
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue")
+	bool IsResolvedTextCaching() const { return bCacheResolvedText; }
+
 
 	/// Get the speech text for the current dialogue node
 	/// Any parameters required will be requested from participants in the dialogue and replaced 
@@ -282,7 +593,9 @@ public:
 
 	/// Get the DialogueWave associated with the current dialogue node
 	/// Returns null if there is no wave for this line.
-	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue")
+	/// Waves are streamed in when their line is reached; if it hasn't finished yet, this will wait for it to load.
+	/// Not pure because of that, so that Blueprints call it once rather than for every pin it's connected to.
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
 	UDialogueWave* GetWave() const;
 
 	/// Return whether the current dialogue node has a Dialogue Wave associated with it
@@ -298,7 +611,8 @@ public:
 	FText GetSpeakerDisplayName() const;
 
 	/// Get the Dialogue Voice belonging to the current speaker, if voiced (Null otherwise)
-	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue")
+	/// Loads the voice if it isn't already, so like GetWave this is not pure
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
 	UDialogueVoice* GetSpeakerVoice() const;
 
 	/// Get the Dialogue Voice belonging to the named participant, if voiced (Null otherwise)
@@ -308,6 +622,27 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "SUDS|Dialogue")
 	USoundBase* GetSound(bool bLooselyMatchTarget = true) const;
 	
+	/**
+	 * Set how many speaker lines ahead of the current line to prefetch voice assets for. When a line is reached, the
+	 * lines which could follow it (after any choice, and any conditions which can be resolved now) have their
+	 * Dialogue Waves loaded and the start of their sounds primed, so that playing them doesn't stall on loading.
+	 * @param Depth The number of lines ahead to prefetch; 0 (the default) disables prefetching
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
+	void SetVoicePrefetchDepth(int Depth);
+
+	/// Get how many speaker lines ahead voice assets are prefetched for
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue")
+	int GetVoicePrefetchDepth() const { return VoicePrefetchDepth; }
+
+	/// Get counters for how well voice prefetching has worked so far
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue")
+	const FSUDSVoicePrefetchStats& GetVoicePrefetchStats() const { return VoicePrefetchStats; }
+
+	/// Reset the voice prefetching counters
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
+	void ResetVoicePrefetchStats() { VoicePrefetchStats = FSUDSVoicePrefetchStats(); }
+
 	/** If the current line is voiced, plays it in 2D.
 	 * @param VolumeMultiplier A linear scalar multiplied with the volume, in order to make the sound louder or softer.
 	 * @param PitchMultiplier A linear scalar multiplied with the pitch.
@@ -400,6 +735,22 @@ public:
 	*/
 	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
 	bool HasChoiceBeenTakenPreviously(const FSUDSScriptEdge& Choice);
+
+	/** Returns whether a speaker line has been reached before in this dialogue, including the current line.
+	*	This is saved in dialogue state so will be remembered across save/restore.
+	*	@param TextID The text ID of the line
+	*/
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue")
+	bool HasSpeakerLineBeenSeen(const FString& TextID) const;
+
+	/// Returns whether a speaker line node has been reached before in this dialogue, including the current line
+	bool HasSpeakerLineNodeBeenSeen(const USUDSScriptNodeText* Node) const;
+
+	/** Returns whether the current speaker line had been seen before it was reached this time, for example so
+	*	that you can let the player skip lines they've read already.
+	*/
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue")
+	bool HasCurrentSpeakerLineBeenSeenBefore() const { return bCurrentLineSeenBefore; }
 	
 	
 	/**
@@ -447,7 +798,7 @@ public:
 	 * Reset the state of this dialogue.
 	 * @param bResetVariables If true, resets all variable state
 	 * @param bResetPosition If true, resets the current position in the dialogue (which speaker line is next)
-	 * @param bResetVisited If true, resets the memory of which choices have been made
+	 * @param bResetVisited If true, resets the memory of which choices have been made and lines have been seen
 	 */
 	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
 	void ResetState(bool bResetVariables = true, bool bResetPosition = true, bool bResetVisited = true);
@@ -459,6 +810,7 @@ public:
 	 *  @note If you save/load mid-dialogue then you're need to have written Text ID's into the source text to ensure they
 	 *  stay the same between edits, as you do for localisation. If you only save/load after dialogue has ended then
 	 *  you don't need to worry about this since the dialogue will always start from the beginning
+	 *  @note Global variables aren't included, save those with USUDSSubsystem::GetGlobalVariablesState
 	 */
 	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
 	FSUDSDialogueState GetSavedState() const;
@@ -499,7 +851,7 @@ public:
 	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
 	FSUDSValue GetVariable(FName Name) const
 	{
-		if (const auto Arg = VariableState.Find(Name))
+		if (const auto Arg = FindVariable(Name))
 		{
 			return *Arg;
 		}
@@ -509,12 +861,20 @@ public:
 	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
 	bool IsVariableSet(FName Name) const
 	{
-		return VariableState.Contains(Name);
+		return FindVariable(Name) != nullptr;
 	}
 
 	/// Get all variables
+	/// Note this builds a new map, so use GetVariable if you only want one. Global variables held by the subsystem
+	/// aren't included, see USUDSSubsystem::GetGlobalVariables
 	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue")
-	const TMap<FName, FSUDSValue>& GetVariables() const { return VariableState; }
+	TMap<FName, FSUDSValue> GetVariables() const;
+
+	/// Get the memory allocated for this dialogue's variables, not counting defaults shared with other dialogues
+	SIZE_T GetVariablesAllocatedSize() const
+	{
+		return VariableSlots.GetAllocatedSize() + OverflowVariables.GetAllocatedSize();
+	}
 	
 	/**
 	 * Set a text dialogue variable
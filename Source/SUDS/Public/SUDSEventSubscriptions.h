@@ -0,0 +1,44 @@
+﻿// Copyright Steve Streeting 2022
+// Released under the MIT license https://opensource.org/license/MIT/
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SUDSValue.h"
+#include "SUDSEventSubscriptions.generated.h"
+
+class USUDSDialogue;
+
+DECLARE_DYNAMIC_DELEGATE_ThreeParams(FOnSUDSNamedEvent, class USUDSDialogue*, Dialogue, FName, EventName, const TArray<FSUDSValue>&, Arguments);
+
+/**
+ * Handlers bound to specific event names, so that an event raised by a dialogue only goes to those interested in it.
+ * Used by USUDSDialogue and USUDSSubsystem.
+ */
+struct SUDS_API FSUDSEventSubscriptions
+{
+protected:
+	TMap<FName, TArray<FOnSUDSNamedEvent>> Handlers;
+
+public:
+	/// Bind a handler to an event name
+	void Subscribe(FName EventName, const FOnSUDSNamedEvent& Handler);
+	/**
+	 * Bind a function on an object to an event name
+	 * @param EventName The event name
+	 * @param Object The object to call
+	 * @param FunctionName The UFunction to call, which must take the same parameters as FOnSUDSNamedEvent
+	 * @return Whether a suitable function was found
+	 */
+	bool SubscribeFunction(FName EventName, UObject* Object, FName FunctionName);
+	/// Remove a handler previously bound to an event name
+	void Unsubscribe(FName EventName, const FOnSUDSNamedEvent& Handler);
+	/// Remove all handlers bound to functions on an object
+	void UnsubscribeAll(const UObject* Object);
+	/// Remove all handlers
+	void Reset() { Handlers.Reset(); }
+
+	/// Whether anything is subscribed to an event name
+	bool HasSubscribers(FName EventName) const { return !Handlers.IsEmpty() && Handlers.Contains(EventName); }
+	/// Call the handlers subscribed to an event name
+	void Dispatch(USUDSDialogue* Dialogue, FName EventName, const TArray<FSUDSValue>& Arguments) const;
+};
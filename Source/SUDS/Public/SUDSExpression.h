@@ -2,6 +2,7 @@
 // Released under the MIT license https://opensource.org/license/MIT/
 #pragma once
 #include "SUDSValue.h"
+#include "SUDSVariableSlots.h"
 #include "SUDSExpression.generated.h"
 
 UENUM(BlueprintType)
@@ -31,6 +32,37 @@ enum class ESUDSExpressionItemType : uint8
 	
 };
 
+/// Op codes for the compiled form of an expression
+/// Operators share their values with ESUDSExpressionItemType so that the RPN queue can be lowered directly
+enum class ESUDSExpressionOpCode : uint8
+{
+	/// Push a literal value, followed by a 1-byte index into the literal table
+	PushLiteral = 0,
+	/// Push the value of a variable, followed by a 1-byte index into the variable name table
+	LoadVariable = 1,
+
+	Not = 4,
+	Multiply = 10,
+	Divide = 11,
+	Add = 20,
+	Subtract = 21,
+	Less = 30,
+	LessEqual = 31,
+	Greater = 32,
+	GreaterEqual = 33,
+	Equal = 34,
+	NotEqual = 35,
+	And = 40,
+	Or = 41,
+
+	/// Inserted after the LHS of an And; if the LHS is false, replace it with false and skip the RHS and the And.
+	/// Followed by a 2-byte forward offset
+	JumpIfFalse = 50,
+	/// Inserted after the LHS of an Or; if the LHS is true, replace it with true and skip the RHS and the Or.
+	/// Followed by a 2-byte forward offset
+	JumpIfTrue = 51,
+};
+
 /// An item in an expression queue, can be operator or operand
 USTRUCT(BlueprintType)
 struct SUDS_API FSUDSExpressionItem
@@ -70,6 +102,25 @@ public:
 	}
 };
 
+/**
+ * The variable state an expression is evaluated against.
+ * Variables which have been resolved to a slot in the script's variable table are read by index from Slots, where an
+ * Empty value means the variable is unset. Anything else is looked up by name in Named.
+ * A plain variable map converts implicitly, in which case every variable is looked up by name.
+ */
+struct SUDS_API FSUDSExpressionVariables
+{
+	const FSUDSVariableSlots* Slots = nullptr;
+	const TMap<FName, FSUDSValue>& Named;
+	/// Global variables, for variables in SUDS_GLOBAL_VARIABLE_SLOT. If null, these are looked up in Named
+	const TMap<FName, FSUDSValue>* Globals = nullptr;
+
+	FSUDSExpressionVariables(const TMap<FName, FSUDSValue>& InNamed) : Named(InNamed) {}
+	FSUDSExpressionVariables(const FSUDSVariableSlots& InSlots,
+	                         const TMap<FName, FSUDSValue>& InNamed,
+	                         const TMap<FName, FSUDSValue>* InGlobals = nullptr)
+		: Slots(&InSlots), Named(InNamed), Globals(InGlobals) {}
+};
 
 /// An expression holds an executable expression, whether it's a simple single literal
 /// or a compound expression with variables
@@ -89,19 +140,43 @@ protected:
 
 	UPROPERTY()
 	TArray<FName> VariableNames;
-	
+
+	/// Slot in the owning script's variable table for each of VariableNames, or empty if not resolved
+	UPROPERTY()
+	TArray<int32> VariableSlots;
 
 	/// The original string version of the expression, for reference 
 	UPROPERTY(BlueprintReadOnly, Category="SUDS|Expression")
 	FString SourceString;
 
-	FSUDSExpressionItem EvaluateOperator(ESUDSExpressionItemType Op,
-	                                       const FSUDSExpressionItem& Arg1,
-	                                       const FSUDSExpressionItem& Arg2,
-	                                       const TMap<FName, FSUDSValue>& Variables) const;
-	FSUDSValue EvaluateOperand(const FSUDSValue& Operand, const TMap<FName, FSUDSValue>& Variables) const;
+	/// Compiled form of the queue, which is what actually gets executed. See ESUDSExpressionOpCode
+	UPROPERTY()
+	TArray<uint8> ByteCode;
+
+	/// Literal values referenced by the byte code
+	UPROPERTY()
+	TArray<FSUDSValue> Literals;
+
+	/// The deepest the evaluation stack will get when running the byte code
+	UPROPERTY()
+	int32 MaxStackDepth = 0;
+
+	/// Evaluation stack depth we can handle without allocating
+	static constexpr int32 InlineStackSize = 8;
+
+	/// Version of the compact format used for cooked data, see Serialize
+	static constexpr uint8 CompactFormatVersion = 1;
+
+	static FSUDSValue EvaluateBinaryOperator(ESUDSExpressionOpCode Op, const FSUDSValue& Arg1, const FSUDSValue& Arg2);
+	FSUDSValue EvaluateImpl(const FSUDSExpressionVariables& Variables,
+	                        const TFunctionRef<void(const FName&)>* OnFirstRead) const;
+	bool EvaluateBooleanResult(const FSUDSValue& Result, const FString& ErrorContext) const;
 
 	bool Validate();
+	void Optimise();
+	bool Compile();
+	static bool CanFoldOperator(ESUDSExpressionItemType Op, const FSUDSValue& Arg1, const FSUDSValue& Arg2);
+	static bool IsIdentityOperand(ESUDSExpressionItemType Op, const FSUDSValue& Operand, bool bIsLeft);
 
 public:
 
@@ -111,9 +186,7 @@ public:
 	FSUDSExpression(const FSUDSValue& LiteralOrVariable)
 	{
 		Queue.Add(FSUDSExpressionItem(LiteralOrVariable));
-		if (LiteralOrVariable.IsVariable())
-			VariableNames.Add(LiteralOrVariable.GetVariableNameValue());
-		bIsValid = true;
+		bIsValid = Compile();
 	}
 
 	/**
@@ -125,10 +198,25 @@ public:
 	bool ParseFromString(const FString& Expression, FString* OutParseError);
 
 	/// Evaluate the expression and return the result, using a given variable state 
-	FSUDSValue Evaluate(const TMap<FName, FSUDSValue>& Variables) const;
+	FSUDSValue Evaluate(const FSUDSExpressionVariables& Variables) const;
+
+	/**
+	 * Evaluate the expression and return the result, calling OnFirstRead the first time each variable is actually read.
+	 * Because and/or short-circuit, variables on a side which is skipped are never read. The callback may change
+	 * the contents of Variables, the new value is what will be used.
+	 */
+	FSUDSValue Evaluate(const FSUDSExpressionVariables& Variables, TFunctionRef<void(const FName&)> OnFirstRead) const;
 
 	/// Evaluate the expression and return the result as a boolean, using a given variable state 
-	bool EvaluateBoolean(const TMap<FName, FSUDSValue>& Variables, const FString& ErrorContext) const;
+	bool EvaluateBoolean(const FSUDSExpressionVariables& Variables, const FString& ErrorContext) const;
+
+	/// Evaluate the expression and return the result as a boolean, calling OnFirstRead for each variable actually read
+	bool EvaluateBoolean(const FSUDSExpressionVariables& Variables,
+	                     TFunctionRef<void(const FName&)> OnFirstRead,
+	                     const FString& ErrorContext) const;
+
+	/// Resolve the variables this expression reads to slots in the script's variable table
+	void ResolveVariableSlots(const TMap<FName, int>& SlotMap);
 
 	/// Get the original source of the expression as a string
 	const FString& GetSourceString() const { return SourceString; }
@@ -137,7 +225,7 @@ public:
 	bool IsValid() const { return bIsValid; }
 
 	/// Whether this expression is blank
-	bool IsEmpty() const { return Queue.IsEmpty(); }
+	bool IsEmpty() const { return Queue.IsEmpty() && ByteCode.IsEmpty(); }
 
 	/// Get the list of variables this expression needs
 	const TArray<FName>& GetVariableNames() const { return VariableNames; }
@@ -154,26 +242,43 @@ public:
 	// Attempt to parse an operator from an incoming string
 	static ESUDSExpressionItemType ParseOperator(const FString& OpStr);
 
-	/// Access the internal RPN execution queue
+	/// Access the internal RPN execution queue. Note that this is not kept in cooked data, only the byte code
 	const TArray<FSUDSExpressionItem>& GetQueue() { return Queue; }
 
+	/// Access the compiled byte code that's actually executed
+	const TArray<uint8>& GetByteCode() const { return ByteCode; }
+
+	/// Get the maximum depth of the evaluation stack needed for this expression
+	int32 GetMaxStackDepth() const { return MaxStackDepth; }
+
+	/**
+	 * Cooked data only stores the compiled form of the expression, as one compact block, instead of tagged
+	 * properties for every item in the queue. Returns false for everything else so that normal tagged
+	 * serialisation is used.
+	 */
+	bool Serialize(FArchive& Ar);
+
+	/// Recompiles byte code when loading data saved before byte code existed
+	void PostSerialize(const FArchive& Ar);
+
 	/// Return whether this is a single literal
 	bool IsLiteral() const
 	{
-		return bIsValid && Queue.Num() == 1 && Queue[0].IsOperand() && Queue[0].GetOperandValue().GetType() != ESUDSValueType::Variable;
+		// Use the byte code rather than the queue, since only the byte code is present in cooked data
+		return bIsValid && ByteCode.Num() == 2 && ByteCode[0] == static_cast<uint8>(ESUDSExpressionOpCode::PushLiteral);
 	}
 
 	/// Helper method to get literal values
-	FSUDSValue GetLiteralValue() const
+	const FSUDSValue& GetLiteralValue() const
 	{
 		check(IsLiteral());
-		return Queue[0].GetOperandValue();
+		return Literals[ByteCode[1]];
 	}
 
 	/// Return whenter this is a text literal
 	bool IsTextLiteral() const
 	{
-		return bIsValid && Queue.Num() == 1 && Queue[0].IsOperand() && Queue[0].GetOperandValue().GetType() == ESUDSValueType::Text;
+		return IsLiteral() && GetLiteralValue().GetType() == ESUDSValueType::Text;
 	}
 
 	/// Helper method to get a text literal value, for easier localisation
@@ -186,7 +291,11 @@ public:
 	void SetTextLiteralValue(const FText& NewLiteral)
 	{
 		check(IsTextLiteral());
-		Queue[0].SetOperandValue(NewLiteral);
+		if (Queue.Num() == 1)
+		{
+			Queue[0].SetOperandValue(NewLiteral);
+		}
+		Literals[ByteCode[1]] = NewLiteral;
 	}
 
 	/// Helper method to get boolean literal value
@@ -223,3 +332,12 @@ public:
 
 };
 
+template<>
+struct TStructOpsTypeTraits<FSUDSExpression> : public TStructOpsTypeTraitsBase2<FSUDSExpression>
+{
+	enum
+	{
+		WithSerializer = true,
+		WithPostSerialize = true
+	};
+};
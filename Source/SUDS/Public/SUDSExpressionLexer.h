@@ -0,0 +1,252 @@
+﻿// Copyright Steve Streeting 2022
+// Released under the MIT license https://opensource.org/license/MIT/
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SUDSExpression.h"
+
+/**
+ * Single pass tokeniser for expressions. Recognised tokens are:
+ * - {Variable}
+ * - Literal numbers (with or without decimal point, with or without preceding negation)
+ * - Arithmetic operators & parentheses
+ * - Boolean operators & comparisons
+ * - Predefined constants (Masculine, feminine, true, false etc)
+ * - Quoted strings "string"
+ * - Quoted names `name`
+ * At each position these are tried in that order, and anything which doesn't start a token is skipped, which is
+ * exactly how the regex we used to use behaved.
+ * Used by FSUDSExpression::ParseFromString, it's only in a public header so that tests can check it against the regex.
+ */
+class FSUDSExpressionLexer
+{
+public:
+	explicit FSUDSExpressionLexer(FStringView InSource) : Source(InSource), Pos(0), TokenStart(0) {}
+
+	/// Read the next token; OutType is Operand for operands, in which case OutOperand is populated
+	bool Next(ESUDSExpressionItemType& OutType, FSUDSValue& OutOperand)
+	{
+		while (Pos < Source.Len())
+		{
+			TokenStart = Pos;
+			if (LexVariable(OutOperand) || LexNumber(OutOperand))
+			{
+				OutType = ESUDSExpressionItemType::Operand;
+				return true;
+			}
+			if (LexOperator(OutType))
+			{
+				return true;
+			}
+			if (LexConstant(OutOperand) || LexQuoted(OutOperand))
+			{
+				OutType = ESUDSExpressionItemType::Operand;
+				return true;
+			}
+			// Not the start of any token
+			++Pos;
+		}
+		return false;
+	}
+
+	/// Get the source text of the token last returned by Next
+	FStringView GetTokenText() const { return Source.Mid(TokenStart, Pos - TokenStart); }
+
+protected:
+	FStringView Source;
+	int Pos;
+	int TokenStart;
+
+	TCHAR Peek(int Offset = 0) const
+	{
+		return Pos + Offset < Source.Len() ? Source[Pos + Offset] : TCHAR(0);
+	}
+
+	/// Case sensitive match of a literal at the current position, consumed if matched
+	bool Match(FStringView Literal)
+	{
+		if (Source.Len() - Pos >= Literal.Len() &&
+			FCString::Strncmp(Source.GetData() + Pos, Literal.GetData(), Literal.Len()) == 0)
+		{
+			Pos += Literal.Len();
+			return true;
+		}
+		return false;
+	}
+
+	/// Match a constant which may have an upper case first letter, Lower is the all lower case version
+	bool MatchConstant(FStringView Lower)
+	{
+		if (Peek() == Lower[0] || Peek() == FChar::ToUpper(Lower[0]))
+		{
+			++Pos;
+			if (Match(Lower.RightChop(1)))
+			{
+				return true;
+			}
+			--Pos;
+		}
+		return false;
+	}
+
+	bool LexVariable(FSUDSValue& OutOperand)
+	{
+		if (Peek() != '{')
+			return false;
+
+		int End = Pos + 1;
+		while (End < Source.Len() && (FChar::IsAlnum(Source[End]) || Source[End] == '_' || Source[End] == '.'))
+		{
+			++End;
+		}
+		if (End == Pos + 1 || End >= Source.Len() || Source[End] != '}')
+			return false;
+
+		const FStringView Name = Source.Mid(Pos + 1, End - Pos - 1);
+		OutOperand = FSUDSValue(FName(Name.Len(), Name.GetData()), true);
+		Pos = End + 1;
+		return true;
+	}
+
+	bool LexNumber(FSUDSValue& OutOperand)
+	{
+		int End = Pos;
+		if (Peek() == '-')
+			++End;
+		if (End >= Source.Len() || !FChar::IsDigit(Source[End]))
+			return false;
+
+		while (End < Source.Len() && FChar::IsDigit(Source[End]))
+		{
+			++End;
+		}
+		bool bIsFloat = false;
+		if (End < Source.Len() && Source[End] == '.')
+		{
+			bIsFloat = true;
+			++End;
+			while (End < Source.Len() && FChar::IsDigit(Source[End]))
+			{
+				++End;
+			}
+		}
+
+		// Atoi/Atof need a terminated string
+		TStringBuilder<64> NumStr;
+		NumStr.Append(Source.Mid(Pos, End - Pos));
+		if (bIsFloat)
+		{
+			OutOperand = FSUDSValue(FCString::Atof(*NumStr));
+		}
+		else
+		{
+			OutOperand = FSUDSValue(FCString::Atoi(*NumStr));
+		}
+		Pos = End;
+		return true;
+	}
+
+	bool LexOperator(ESUDSExpressionItemType& OutType)
+	{
+		switch (Peek())
+		{
+		case '-':
+			++Pos;
+			OutType = ESUDSExpressionItemType::Subtract;
+			return true;
+		case '+':
+			++Pos;
+			OutType = ESUDSExpressionItemType::Add;
+			return true;
+		case '*':
+			++Pos;
+			OutType = ESUDSExpressionItemType::Multiply;
+			return true;
+		case '/':
+			++Pos;
+			OutType = ESUDSExpressionItemType::Divide;
+			return true;
+		case '(':
+			++Pos;
+			OutType = ESUDSExpressionItemType::LParens;
+			return true;
+		case ')':
+			++Pos;
+			OutType = ESUDSExpressionItemType::RParens;
+			return true;
+		default:
+			break;
+		}
+
+		if (Match(TEXT("and")) || Match(TEXT("&&")))
+			OutType = ESUDSExpressionItemType::And;
+		else if (Match(TEXT("||")) || Match(TEXT("or")))
+			OutType = ESUDSExpressionItemType::Or;
+		else if (Match(TEXT("not")))
+			OutType = ESUDSExpressionItemType::Not;
+		else if (Match(TEXT("<>")) || Match(TEXT("!=")))
+			OutType = ESUDSExpressionItemType::NotEqual;
+		else if (Match(TEXT("!")))
+			OutType = ESUDSExpressionItemType::Not;
+		else if (Match(TEXT("<=")))
+			OutType = ESUDSExpressionItemType::LessEqual;
+		else if (Match(TEXT("<")))
+			OutType = ESUDSExpressionItemType::Less;
+		else if (Match(TEXT(">=")))
+			OutType = ESUDSExpressionItemType::GreaterEqual;
+		else if (Match(TEXT(">")))
+			OutType = ESUDSExpressionItemType::Greater;
+		else if (Match(TEXT("==")) || Match(TEXT("=")))
+			OutType = ESUDSExpressionItemType::Equal;
+		else
+			return false;
+
+		return true;
+	}
+
+	bool LexConstant(FSUDSValue& OutOperand)
+	{
+		if (MatchConstant(TEXT("masculine")))
+			OutOperand = FSUDSValue(ETextGender::Masculine);
+		else if (MatchConstant(TEXT("feminine")))
+			OutOperand = FSUDSValue(ETextGender::Feminine);
+		else if (MatchConstant(TEXT("neuter")))
+			OutOperand = FSUDSValue(ETextGender::Neuter);
+		else if (MatchConstant(TEXT("true")))
+			OutOperand = FSUDSValue(true);
+		else if (MatchConstant(TEXT("false")))
+			OutOperand = FSUDSValue(false);
+		else
+			return false;
+
+		return true;
+	}
+
+	bool LexQuoted(FSUDSValue& OutOperand)
+	{
+		const TCHAR Quote = Peek();
+		if (Quote != '"' && Quote != '`')
+			return false;
+
+		int End = Pos + 1;
+		while (End < Source.Len() && Source[End] != Quote)
+		{
+			++End;
+		}
+		if (End >= Source.Len())
+			return false;
+
+		const FStringView Contents = Source.Mid(Pos + 1, End - Pos - 1);
+		if (Quote == '"')
+		{
+			// Text, will be localised later in asset conversion
+			OutOperand = FSUDSValue(FText::FromString(FString(Contents)));
+		}
+		else
+		{
+			OutOperand = FSUDSValue(FName(Contents.Len(), Contents.GetData()), false);
+		}
+		Pos = End + 1;
+		return true;
+	}
+};
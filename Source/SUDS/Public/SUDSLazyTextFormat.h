@@ -0,0 +1,43 @@
+﻿// Copyright Steve Streeting 2022
+// Released under the MIT license https://opensource.org/license/MIT/
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/**
+ * A text format which is compiled the first time it's needed, unless a background prewarm (see
+ * USUDSScript::PrewarmTextFormats) got to it first. Each format is compiled for a text revision, so it's compiled again
+ * when the culture changes.
+ * Compiling can happen on any thread, but using the format (Get) and copying must be on the game thread. If a
+ * background thread is compiling this format when it's needed, Get waits for just this format rather than the whole
+ * script.
+ */
+struct SUDS_API FSUDSLazyTextFormat
+{
+protected:
+	enum EState : uint8
+	{
+		NotCompiled,
+		Compiling,
+		Compiled
+	};
+
+	mutable FTextFormat Format;
+	mutable std::atomic<uint8> State { NotCompiled };
+	mutable std::atomic<int> CompiledRevision { INDEX_NONE };
+
+	/// Compile if not already compiled for TextRevision (or later). If bWait, waits for another thread compiling it
+	void Compile(const FText& Text, int TextRevision, bool bWait) const;
+
+public:
+	FSUDSLazyTextFormat() {}
+	FSUDSLazyTextFormat(const FSUDSLazyTextFormat& Other) { *this = Other; }
+	FSUDSLazyTextFormat& operator=(const FSUDSLazyTextFormat& Other);
+
+	/// Get the format of Text for the current culture, compiling it now if need be. Game thread only
+	const FTextFormat& Get(const FText& Text) const;
+	/// Compile the format of Text for a text revision, unless that's already been done or is in progress. Safe to call
+	/// from any thread
+	void Prewarm(const FText& Text, int TextRevision) const { Compile(Text, TextRevision, false); }
+};
@@ -0,0 +1,65 @@
+﻿// Copyright Steve Streeting 2022
+// Released under the MIT license https://opensource.org/license/MIT/
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Interface.h"
+#include "SUDSValue.h"
+#include "SUDSNativeParticipant.generated.h"
+
+class USUDSDialogue;
+
+/// Participant callbacks, as flags so that a participant can declare which ones it handles
+enum class ESUDSParticipantCallback : uint16
+{
+	None = 0,
+	Starting = 1 << 0,
+	Finished = 1 << 1,
+	SpeakerLine = 1 << 2,
+	ChoiceMade = 1 << 3,
+	Proceeding = 1 << 4,
+	Event = 1 << 5,
+	VariableChanged = 1 << 6,
+	VariableRequested = 1 << 7,
+	All = 0xFF
+};
+ENUM_CLASS_FLAGS(ESUDSParticipantCallback)
+
+UINTERFACE(MinimalAPI, meta=(CannotImplementInterfaceInBlueprint))
+class USUDSNativeParticipant : public UInterface
+{
+	GENERATED_BODY()
+};
+
+/**
+* C++ only version of ISUDSParticipant.
+* The callbacks are the same as ISUDSParticipant, see that for details, but they're plain virtual functions which the
+* dialogue calls directly instead of going through Blueprint events. If you're implementing a participant in C++,
+* and especially if your scripts raise a lot of events, implement this instead of ISUDSParticipant.
+* If an object implements both interfaces, only this one is used.
+*/
+class SUDS_API ISUDSNativeParticipant
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual void NativeOnDialogueStarting(USUDSDialogue* Dialogue, FName AtLabel) = 0;
+	virtual void NativeOnDialogueFinished(USUDSDialogue* Dialogue) = 0;
+	virtual void NativeOnDialogueSpeakerLine(USUDSDialogue* Dialogue) = 0;
+	virtual void NativeOnDialogueChoiceMade(USUDSDialogue* Dialogue, int ChoiceIndex) = 0;
+	virtual void NativeOnDialogueProceeding(USUDSDialogue* Dialogue) = 0;
+	virtual void NativeOnDialogueEvent(USUDSDialogue* Dialogue, FName EventName, const TArray<FSUDSValue>& Arguments) = 0;
+	virtual void NativeOnDialogueVariableChanged(USUDSDialogue* Dialogue,
+	                                             FName VariableName,
+	                                             const FSUDSValue& Value,
+	                                             bool bFromScript) = 0;
+	virtual void NativeOnDialogueVariableRequested(USUDSDialogue* Dialogue, FName VariableName) = 0;
+	/// Higher priority participants are called later, see ISUDSParticipant::GetDialogueParticipantPriority.
+	/// Read once, when the participant is added to a dialogue.
+	virtual int GetNativeDialogueParticipantPriority() const = 0;
+
+	/// Which callbacks this participant does something with; the dialogue won't call the others. Read once, when
+	/// the participant is added to a dialogue.
+	virtual ESUDSParticipantCallback GetHandledDialogueCallbacks() const { return ESUDSParticipantCallback::All; }
+};
@@ -3,13 +3,16 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "SUDSScriptEdge.h"
 #include "Sound/DialogueVoice.h"
+#include "Tasks/Task.h"
 #include "UObject/Object.h"
 #include "SUDSScript.generated.h"
 
 class USUDSScriptNode;
 class USUDSScriptNodeText;
 class USUDSScriptNodeGosub;
+class USUDSScriptNodeSet;
 /**
  * A single SUDS script asset.
  */
@@ -41,10 +44,68 @@ protected:
 
 	/// When using VO, Dialogue Voice assets are associated with speaker IDs
 	UPROPERTY(BlueprintReadOnly, EditDefaultsOnly, Category="SUDS")
-	TMap<FString, UDialogueVoice*> SpeakerVoices;
+	TMap<FString, TSoftObjectPtr<UDialogueVoice>> SpeakerVoices;
+
+	/// Derived from Speakers, the variable name holding each speaker's display name ("SpeakerName.SpeakerID")
+	TArray<FName> SpeakerDisplayNameKeys;
+	/// Derived from Speakers & SpeakerVoices, the voice for each speaker
+	TArray<TSoftObjectPtr<UDialogueVoice>> SpeakerVoiceTable;
+
+	/// Every variable name read or written by this script; the index of each is its slot, which dialogues use to
+	/// store values in a flat array rather than looking them up by name
+	UPROPERTY(BlueprintReadOnly, VisibleDefaultsOnly, Category="SUDS")
+	TArray<FName> VariableSlotNames;
+
+	/// Lookup of variable name to slot, derived from VariableSlotNames
+	TMap<FName, int> VariableSlotMap;
+
+	/// Derived: whether the header does nothing but set variables to literal values, so always has the same result
+	bool bHeaderIsLiteral = false;
+	/// Derived: if the header is literal, its set nodes in the order they run
+	TArray<const USUDSScriptNodeSet*> LiteralHeaderSets;
+	/// Derived: if the header is literal, the variable slots as they are after running it. Shared with dialogues, which
+	/// layer their own changes over it
+	TSharedPtr<const TArray<FSUDSValue>> HeaderDefaultSlots;
+
+	/// Derived: hash of each text ID to the index of its text node, for restoring state. Hashes can collide, so
+	/// lookups check the ID of the node too; see FindTextNodeIndex
+	TMultiMap<uint32, int> TextIDLookup;
+
+	/// Derived: hash of each gosub ID to the index of its gosub node, see FindGosubNodeIndex
+	TMultiMap<uint32, int> GosubIDLookup;
+
+	/// Text ID of each speaker line ordinal, see USUDSScriptNodeText::GetLineOrdinal
+	UPROPERTY()
+	TArray<FString> LineTextIDs;
+
+	/// Text ID of each choice ordinal, see FSUDSScriptEdge::GetChoiceOrdinal
+	UPROPERTY()
+	TArray<FString> ChoiceTextIDs;
+
+	/// Derived from ChoiceTextIDs, the ordinal of each choice text ID
+	TMap<FString, int> ChoiceOrdinalMap;
+	/// Derived: identifies the assignment of ordinals to lines and choices, so that saved state can tell whether it
+	/// still matches
+	uint32 OrdinalLayoutHash = 0;
 
 	bool DoesAnyPathAfterLeadToChoice(USUDSScriptNode* FromNode);
 	int RecurseLookForChoice(USUDSScriptNode* CurrNode);
+	void BuildVariableSlots();
+	void BuildVariableSlotMap();
+	void BuildIDLists();
+	void BuildIDLookups();
+	int FindTextNodeIndex(const FString& TextID) const;
+	int FindGosubNodeIndex(const FString& GosubID) const;
+	void BuildOrdinalLookups();
+	void BuildStaticChoicePaths();
+	void BuildSpeakerTable(bool bResolveNodes);
+	void BuildHeaderSnapshot();
+
+	/// Background task compiling text formats, see PrewarmTextFormats
+	mutable UE::Tasks::FTask TextFormatTask;
+	/// Whether text formats have been prewarmed since this script was loaded or imported, see EnsureTextFormatsPrewarmed
+	mutable bool bTextFormatsPrewarmed = false;
+	static void ResolveEdgeTargetIndices(const TArray<USUDSScriptNode*>& NodeList);
 	
 public:
 	void StartImport(TArray<USUDSScriptNode*>** Nodes,
@@ -76,9 +137,41 @@ public:
 	UFUNCTION(BlueprintCallable, Category="SUDS")
 	USUDSScriptNode* GetNodeByLabel(const FName& Label) const;
 
+	/// Get a node by its index in the node list, or the header node list if bHeader is true
+	USUDSScriptNode* GetNodeByIndex(int Index, bool bHeader = false) const
+	{
+		const TArray<USUDSScriptNode*>& NodeList = bHeader ? HeaderNodes : Nodes;
+		return NodeList.IsValidIndex(Index) ? NodeList[Index] : nullptr;
+	}
+
+	/// Get the node an edge leads to, or null if it leads to the end. Edges from header nodes only lead to other
+	/// header nodes, so bHeader must be true when following those
+	USUDSScriptNode* GetEdgeTargetNode(const FSUDSScriptEdge& Edge, bool bHeader = false) const
+	{
+		return GetNodeByIndex(Edge.GetTargetNodeIndex(), bHeader);
+	}
+
 	/// Try to find a speaker node by its text ID
 	UFUNCTION(BlueprintCallable, Category="SUDS")
 	USUDSScriptNodeText* GetNodeByTextID(const FString& TextID) const;
+	/// Get the number of distinct speaker lines, for tracking which have been seen
+	int GetLineOrdinalCount() const { return LineTextIDs.Num(); }
+	/// Get the number of distinct choices, for tracking which have been taken
+	int GetChoiceOrdinalCount() const { return ChoiceTextIDs.Num(); }
+	/// Get the text ID of a speaker line ordinal
+	const FString& GetLineTextID(int Ordinal) const { return LineTextIDs[Ordinal]; }
+	/// Get the text ID of a choice ordinal
+	const FString& GetChoiceTextID(int Ordinal) const { return ChoiceTextIDs[Ordinal]; }
+	/// Get the ordinal of a speaker line by its text ID, or INDEX_NONE if not found
+	int GetLineOrdinalByTextID(const FString& TextID) const;
+	/// Get the ordinal of a choice by its text ID, or INDEX_NONE if not found
+	int GetChoiceOrdinalByTextID(const FString& TextID) const
+	{
+		const int* pOrdinal = ChoiceOrdinalMap.Find(TextID);
+		return pOrdinal ? *pOrdinal : INDEX_NONE;
+	}
+	/// Changes whenever the ordinals of lines or choices change, e.g. when lines are added or removed
+	uint32 GetOrdinalLayoutHash() const { return OrdinalLayoutHash; }
 	/// Try to find a gosub node by its gosub ID
 	UFUNCTION(BlueprintCallable, Category="SUDS")
 	USUDSScriptNodeGosub* GetNodeByGosubID(const FString& ID) const;
@@ -86,13 +179,69 @@ public:
 
 	/// Get the list of speakers
 	const TArray<FString>& GetSpeakers() const { return Speakers; }
+	/// Get the index of a speaker in the speaker list, or INDEX_NONE if not present
+	int GetSpeakerIndex(const FString& SpeakerID) const { return Speakers.IndexOfByKey(SpeakerID); }
+	/// Get the name of the variable holding the display name of the speaker at a given index
+	FName GetSpeakerDisplayNameKey(int SpeakerIndex) const
+	{
+		return SpeakerDisplayNameKeys.IsValidIndex(SpeakerIndex) ? SpeakerDisplayNameKeys[SpeakerIndex] : NAME_None;
+	}
+	/// Get the voice for the speaker at a given index, loading it if it isn't already
+	UDialogueVoice* GetSpeakerVoiceByIndex(int SpeakerIndex) const
+	{
+		return SpeakerVoiceTable.IsValidIndex(SpeakerIndex) ? SpeakerVoiceTable[SpeakerIndex].LoadSynchronous() : nullptr;
+	}
+
+	/// Get the names of all variables referenced by this script, in slot order
+	const TArray<FName>& GetVariableSlotNames() const { return VariableSlotNames; }
+	/// Get the number of variable slots in this script
+	int GetVariableSlotCount() const { return VariableSlotNames.Num(); }
+	/// Get the slot of a variable in this script, SUDS_GLOBAL_VARIABLE_SLOT if it's a global variable, or INDEX_NONE
+	/// if the script doesn't reference it
+	int GetVariableSlot(const FName& Name) const
+	{
+		if (const int* pSlot = VariableSlotMap.Find(Name))
+		{
+			return *pSlot;
+		}
+		return IsSUDSGlobalVariableName(Name) ? SUDS_GLOBAL_VARIABLE_SLOT : INDEX_NONE;
+	}
+
+	/**
+	 * Whether the header only sets variables to literal values, with no conditions, events or references to other
+	 * variables. If so, running it always has the same result, so dialogues can copy GetHeaderDefaultSlots instead.
+	 */
+	bool HasLiteralHeader() const { return bHeaderIsLiteral; }
+	/// If the header is literal, the variable slots as they are after the header has run on a new dialogue. Never
+	/// modified once built; if the script is re-imported a new table is created
+	const TSharedPtr<const TArray<FSUDSValue>>& GetHeaderDefaultSlots() const { return HeaderDefaultSlots; }
+	/// If the header is literal, the set nodes it consists of, in the order they run
+	const TArray<const USUDSScriptNodeSet*>& GetLiteralHeaderSets() const { return LiteralHeaderSets; }
 
+	/// Get the voice for a speaker, loading it if it isn't already
 	UFUNCTION(BlueprintCallable, Category="SUDS")
 	UDialogueVoice* GetSpeakerVoice(const FString& SpeakerID) const;
 
 	/// Set up the speaker voice association
-	void SetSpeakerVoice(const FString& SpeakerID, UDialogueVoice* Voice);
-	const TMap<FString, UDialogueVoice*> GetSpeakerVoices() const  { return SpeakerVoices; }
+	void SetSpeakerVoice(const FString& SpeakerID, const TSoftObjectPtr<UDialogueVoice>& Voice);
+	const TMap<FString, TSoftObjectPtr<UDialogueVoice>>& GetSpeakerVoices() const  { return SpeakerVoices; }
+
+	/// Compile the text formats of all speaker lines and choices on a background thread, so that the first time
+	/// each is displayed doesn't cause a hitch. Happens automatically when the first dialogue is created for the
+	/// script, and when the culture changes for scripts held by USUDSSubsystem's script cache. Formats needed before
+	/// this gets to them are compiled on demand.
+	void PrewarmTextFormats() const;
+	/// Call PrewarmTextFormats if it hasn't been since this script was loaded or imported. Not done on load, so that
+	/// scripts loaded only by the editor, cooks or commandlets don't start background work
+	void EnsureTextFormatsPrewarmed() const;
+	/// Wait for any background text format compilation in progress to finish. Not needed before using text formats
+	void WaitForTextFormats() const;
+
+	// UObject interface
+	virtual void PostLoad() override;
+	virtual void BeginDestroy() override;
+	virtual bool CanBeClusterRoot() const override;
+	// End of UObject interface
 
 #if WITH_EDITORONLY_DATA
 	// Import data for this 
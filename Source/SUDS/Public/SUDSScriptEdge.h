@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "SUDSExpression.h"
+#include "SUDSLazyTextFormat.h"
 #include "SUDSScriptEdge.generated.h"
 
 class USUDSScriptNode;
@@ -42,17 +43,37 @@ protected:
 	UPROPERTY(BlueprintReadOnly, Category="SUDS")
 	TWeakObjectPtr<USUDSScriptNode> TargetNode;
 
+	/// Index of the target node in the script's node list (the header node list, for edges between header nodes),
+	/// or INDEX_NONE if this edge leads to the end. Used at runtime instead of resolving TargetNode.
+	UPROPERTY()
+	int TargetNodeIndex = INDEX_NONE;
+
 	UPROPERTY(BlueprintReadOnly, Category="SUDS")
 	FSUDSExpression Condition;
 
 	UPROPERTY(BlueprintReadOnly, Category="SUDS")
 	int SourceLineNo;
 
-	mutable bool bFormatExtracted = false; 
-	mutable TArray<FName> ParameterNames;
-	mutable FTextFormat TextFormat;
+	/// Names of the parameters in the choice text, extracted at import
+	UPROPERTY()
+	TArray<FName> ParameterNames;
+
+	/// Variable slot of each choice text parameter, INDEX_NONE for variables without slots
+	UPROPERTY()
+	TArray<int> ParameterSlots;
+
+	/// For choices, the index of this choice in the script's list of choices, used to track whether it's been taken.
+	/// INDEX_NONE if not a choice
+	UPROPERTY()
+	int ChoiceOrdinal = INDEX_NONE;
 
-	void ExtractFormat() const;
+	/// Parameter names as format argument keys, so they needn't be converted each time the text is formatted
+	TArray<FString> ParameterKeys;
+	/// Compiled text format, see USUDSScript::PrewarmTextFormats
+	FSUDSLazyTextFormat TextFormat;
+
+	void ExtractParameterNames();
+	void BuildParameterKeys();
 	
 public:
 	FSUDSScriptEdge(): Type(ESUDSEdgeType::Continue), SourceLineNo(0)
@@ -76,15 +97,33 @@ public:
 	FString GetTextID() const;
 	ESUDSEdgeType GetType() const { return Type; }
 	TWeakObjectPtr<USUDSScriptNode> GetTargetNode() const { return TargetNode; }
+	int GetTargetNodeIndex() const { return TargetNodeIndex; }
 	const FSUDSExpression& GetCondition() const { return Condition; }
 	int GetSourceLineNo() const { return SourceLineNo; }
+	/// Get the index of this choice in the script's list of choices, or INDEX_NONE if not a choice
+	int GetChoiceOrdinal() const { return ChoiceOrdinal; }
 
 	void SetText(const FText& Text);
 	void SetType(ESUDSEdgeType InType) { Type = InType; } 
 	void SetTargetNode(const TWeakObjectPtr<USUDSScriptNode>& InTargetNode) { TargetNode = InTargetNode; }
+	void SetTargetNodeIndex(int InIndex) { TargetNodeIndex = InIndex; }
 	void SetCondition(const FSUDSExpression& InCondition) { Condition = InCondition; }
+	void SetChoiceOrdinal(int InOrdinal) { ChoiceOrdinal = InOrdinal; }
+
+	/// Get the compiled choice text format, compiling it now if it hasn't been prewarmed. Game thread only
+	const FTextFormat& GetTextFormat() const { return TextFormat.Get(Text); }
+	const TArray<FName>& GetParameterNames() const { return ParameterNames; }
+	const TArray<FString>& GetParameterKeys() const { return ParameterKeys; }
+	/// Get the variable slot of each parameter. May be empty if slots weren't resolved when this was imported
+	const TArray<int>& GetParameterSlots() const { return ParameterSlots; }
+	bool HasParameters() const { return !ParameterNames.IsEmpty(); }
+
+	/// Prepare derived parameter data after loading
+	void PostLoad();
+	/// Compile the text format for a text revision ahead of it being needed. Safe to call from a background thread
+	void PrewarmTextFormat(int TextRevision) const;
 
-	const FTextFormat& GetTextFormat() const;
-	const TArray<FName>& GetParameterNames() const;
-	bool HasParameters() const;
+	/// Add the variables used by the condition and choice text to OutNames, if not already there
+	void GatherVariableNames(TArray<FName>& OutNames) const;
+	void ResolveVariableSlots(const TMap<FName, int>& SlotMap);
 };
\ No newline at end of file
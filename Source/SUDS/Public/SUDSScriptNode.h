@@ -66,6 +66,28 @@ public:
 	void InitSelect(int LineNo);
 	void InitReturn(int LineNo);
 
+	/// Add the names of all variables this node reads or writes to OutNames, if not already there
+	virtual void GatherVariableNames(TArray<FName>& OutNames) const;
+	/// Resolve references to variables in this node to slots in the script's variable table
+	virtual void ResolveVariableSlots(const TMap<FName, int>& SlotMap);
+	/// Compile text formats in this node & its edges for a text revision, ahead of them being needed. Called by
+	/// USUDSScript from a background thread
+	virtual void PrewarmTextFormats(int TextRevision) const;
+
+	// UObject interface
+	virtual void PostLoad() override;
+	// End of UObject interface
+	/// Fill in missing edge target indexes from target nodes, for assets imported before edges had indexes.
+	/// Returns whether any were changed
+	bool ResolveEdgeTargetIndices(const TMap<const USUDSScriptNode*, int>& NodeIndices);
+	/**
+	 * Give each choice edge an ordinal for tracking whether it's been taken. Choices with the same text ID share the
+	 * same ordinal.
+	 * @param InOutOrdinals Ordinal of each text ID seen so far
+	 * @param InOutTextIDs Text ID of each ordinal so far, new ordinals are added to the end
+	 */
+	void AssignChoiceOrdinals(TMap<FString, int>& InOutOrdinals, TArray<FString>& InOutTextIDs);
+
 	int GetEdgeCount() const { return Edges.Num(); }
 	const FSUDSScriptEdge* GetEdge(int Index) const
 	{
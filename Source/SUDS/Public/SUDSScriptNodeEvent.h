@@ -28,6 +28,9 @@ public:
 	void Init(const FString& EvtName, const TArray<FSUDSExpression>& InArgs, int LineNo);
 	FName GetEventName() const { return EventName; }
 	const TArray<FSUDSExpression>& GetArgs() const { return Args; }
+
+	virtual void GatherVariableNames(TArray<FName>& OutNames) const override;
+	virtual void ResolveVariableSlots(const TMap<FName, int>& SlotMap) override;
 	
 	
 };
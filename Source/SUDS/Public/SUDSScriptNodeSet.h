@@ -24,10 +24,18 @@ protected:
 	UPROPERTY(BlueprintReadOnly, Category="SUDS")
 	FSUDSExpression Expression;
 
+	/// Slot of Identifier in the script's variable table
+	UPROPERTY()
+	int IdentifierSlot = INDEX_NONE;
+
 public:
 
 	void Init(const FString& VarName, const FSUDSExpression& InExpression, int LineNo);
 	const FName& GetIdentifier() const { return Identifier; }
 	const FSUDSExpression& GetExpression() const { return Expression; }
+	int GetIdentifierSlot() const { return IdentifierSlot; }
+
+	virtual void GatherVariableNames(TArray<FName>& OutNames) const override;
+	virtual void ResolveVariableSlots(const TMap<FName, int>& SlotMap) override;
 	
 };
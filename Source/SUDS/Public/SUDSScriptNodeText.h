@@ -3,10 +3,13 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "SUDSLazyTextFormat.h"
 #include "SUDSScriptNode.h"
 #include "SUDSScriptNodeText.generated.h"
 
+class UDialogueVoice;
 class UDialogueWave;
+class USoundBase;
 
 /**
 * A node which contains speaker text 
@@ -20,13 +23,16 @@ protected:
 	/// Identifier of the speaker for text nodes
 	UPROPERTY(BlueprintReadOnly, VisibleDefaultsOnly, Category="SUDS")
 	FString SpeakerID;
+	/// Index of SpeakerID in the script's speaker table
+	UPROPERTY()
+	int SpeakerIndex = INDEX_NONE;
 	/// Text, always references a string table. Parameters will not have been completed.
 	/// Note: if you're using voiced dialogue, see the Wave property and its subtitle functionality
 	UPROPERTY(BlueprintReadOnly, VisibleDefaultsOnly, Category="SUDS")
 	FText Text;
-	/// DialogueWave asset link for voiced dialogue
+	/// DialogueWave asset link for voiced dialogue. Soft so that waves are only loaded when their line is reached
 	UPROPERTY(BlueprintReadOnly, EditDefaultsOnly, Category="SUDS")
-	UDialogueWave* Wave;
+	TSoftObjectPtr<UDialogueWave> Wave;
 
 	/// Convenience flag to let you know whether this text node MAY HAVE choices attached
 	/// If false, there's only one way to proceed from here and no text associated with that
@@ -37,28 +43,106 @@ protected:
 	/// This flag is to let us know to look for choices, but if conditionals apply we may not find any using actual dialogue state.
 	UPROPERTY(BlueprintReadOnly, Category="SUDS")
 	bool bHasChoices = false;
+
+	/// Index of the choice node this text node always leads to, if that can be determined at import (only set and
+	/// event nodes in between). INDEX_NONE if there are no choices, or finding them depends on dialogue state.
+	UPROPERTY()
+	int RootChoiceNodeIndex = INDEX_NONE;
+
+	/// Indexes of the set / event nodes which must be run, in order, between this node and RootChoiceNodeIndex
+	UPROPERTY()
+	TArray<int> PreChoiceNodeIndices;
+
+	/// Names of the parameters in the text, extracted at import
+	UPROPERTY()
+	TArray<FName> ParameterNames;
+
+	/// Variable slot of each text parameter, INDEX_NONE for variables without slots
+	UPROPERTY()
+	TArray<int> ParameterSlots;
+
+	/// Index of this line in the script's list of speaker lines, used to track whether it's been seen
+	UPROPERTY()
+	int LineOrdinal = INDEX_NONE;
 	
-	mutable bool bFormatExtracted = false; 
-	mutable TArray<FName> ParameterNames;
-	mutable FTextFormat TextFormat;
+	/// The wave and voices that the voice context indexes below were resolved for. Runtime only, resolved the first
+	/// time a sound is needed for this line and again if the wave or voices differ
+	mutable TWeakObjectPtr<const UDialogueWave> VoiceContextWave;
+	mutable TWeakObjectPtr<const UDialogueVoice> VoiceContextSpeaker;
+	mutable TWeakObjectPtr<const UDialogueVoice> VoiceContextTarget;
+	/// Index of the wave context matching both speaker & target, and of the first matching the speaker only
+	mutable int ExactVoiceContextIndex = INDEX_NONE;
+	mutable int LooseVoiceContextIndex = INDEX_NONE;
+
+	/// Parameter names as format argument keys, so they needn't be converted each time the text is formatted
+	TArray<FString> ParameterKeys;
+	/// Compiled text format, see USUDSScript::PrewarmTextFormats
+	FSUDSLazyTextFormat TextFormat;
 
-	void ExtractFormat() const;
+	void ExtractParameterNames();
+	void BuildParameterKeys();
 
 public:
 	const FString& GetSpeakerID() const { return SpeakerID; }
+	/// Get the index of this line's speaker in the script's speaker table
+	int GetSpeakerIndex() const { return SpeakerIndex; }
+	void SetSpeakerIndex(int InIndex) { SpeakerIndex = InIndex; }
+	/// Get the index of this line in the script's list of speaker lines
+	int GetLineOrdinal() const { return LineOrdinal; }
+	void SetLineOrdinal(int InOrdinal) { LineOrdinal = InOrdinal; }
 	const FText& GetText() const { return Text; }
 	FString GetTextID() const;
-	UDialogueWave* GetWave() const { return Wave; }
+	const TSoftObjectPtr<UDialogueWave>& GetWave() const { return Wave; }
 	/// Whether on one select path or another a choice was found
 	/// Doesn't help if within a Gosub as call site may be anywhere
 	bool MayHaveChoices() const { return bHasChoices; }
 
 	void Init(const FString& SpeakerID, const FText& Text, int LineNo);
-	void SetWave(UDialogueWave* InWave) { Wave = InWave; }
-	const FTextFormat& GetTextFormat() const;
-	const TArray<FName>& GetParameterNames() const;	
-	bool HasParameters() const;
+	void SetWave(const TSoftObjectPtr<UDialogueWave>& InWave)
+	{
+		Wave = InWave;
+		VoiceContextWave.Reset();
+	}
+	/**
+	 * Find which of a wave's contexts to use for this line given the speaker & target voices. The result is cached
+	 * so that repeat calls for the same wave & voices don't need to search the contexts again.
+	 */
+	void ResolveVoiceContexts(const UDialogueWave* InWave, const UDialogueVoice* Speaker, const UDialogueVoice* Target) const;
+	/**
+	 * Get the sound to play for this line from a loaded copy of its wave, given the speaker & target voices.
+	 * @param InWave The loaded wave
+	 * @param Speaker The speaker's voice
+	 * @param Target The target's voice
+	 * @param bAllowAnyTarget If no context matches the target voice, whether to use any context with the speaker voice
+	 * @return The sound, or null if no context matched
+	 */
+	USoundBase* GetVoiceSound(const UDialogueWave* InWave,
+	                          const UDialogueVoice* Speaker,
+	                          const UDialogueVoice* Target,
+	                          bool bAllowAnyTarget) const;
+	/// Get the compiled text format, compiling it now if it hasn't been prewarmed. Game thread only
+	const FTextFormat& GetTextFormat() const { return TextFormat.Get(Text); }
+	const TArray<FName>& GetParameterNames() const { return ParameterNames; }
+	const TArray<FString>& GetParameterKeys() const { return ParameterKeys; }
+	/// Get the variable slot of each parameter. May be empty if slots weren't resolved when this was imported
+	const TArray<int>& GetParameterSlots() const { return ParameterSlots; }
+	bool HasParameters() const { return !ParameterNames.IsEmpty(); }
 
 	void NotifyMayHaveChoices() { bHasChoices = true; }
 
+	/// Get the index of the root choice node this node always leads to, or INDEX_NONE if it's not known statically
+	int GetRootChoiceNodeIndex() const { return RootChoiceNodeIndex; }
+	/// Get the indexes of nodes to run between this node and the root choice node
+	const TArray<int>& GetPreChoiceNodeIndices() const { return PreChoiceNodeIndices; }
+	void SetStaticChoicePath(int InRootChoiceNodeIndex, const TArray<int>& InPreChoiceNodeIndices)
+	{
+		RootChoiceNodeIndex = InRootChoiceNodeIndex;
+		PreChoiceNodeIndices = InPreChoiceNodeIndices;
+	}
+
+	virtual void GatherVariableNames(TArray<FName>& OutNames) const override;
+	virtual void ResolveVariableSlots(const TMap<FName, int>& SlotMap) override;
+	virtual void PrewarmTextFormats(int TextRevision) const override;
+	virtual void PostLoad() override;
+
 };
@@ -6,6 +6,9 @@
 #include "Subsystems/GameInstanceSubsystem.h"
 #include "Engine/World.h"
 #include "Engine/GameInstance.h"
+#include "Engine/StreamableManager.h"
+#include "SUDSEventSubscriptions.h"
+#include "SUDSValue.h"
 #include "SUDSSubsystem.generated.h"
 
 class USUDSDialogue;
@@ -13,6 +16,102 @@ class USUDSScript;
 class USoundConcurrency;
 struct FSoundConcurrencySettings;
 DECLARE_LOG_CATEGORY_EXTERN(LogSUDSSubsystem, Log, All);
+
+DECLARE_DYNAMIC_DELEGATE_OneParam(FOnSUDSScriptLoaded, USUDSScript*, Script);
+DECLARE_DYNAMIC_DELEGATE_OneParam(FOnSUDSDialogueCreated, USUDSDialogue*, Dialogue);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnSUDSGlobalVariableChanged, FName, VariableName, const FSUDSValue&, Value, USUDSDialogue*, Dialogue);
+
+/// A script held in the subsystem's script cache
+USTRUCT()
+struct FSUDSScriptCacheEntry
+{
+	GENERATED_BODY()
+
+	/// The script, once loaded
+	UPROPERTY()
+	TObjectPtr<USUDSScript> Script;
+
+	/// Handle for the async load, keeps the script loaded until released
+	TSharedPtr<FStreamableHandle> Handle;
+
+	/// Number of outstanding requests for this script to be resident. Scripts with no requests may be evicted
+	int RefCount = 0;
+
+	/// When this script was last requested, for LRU eviction
+	uint64 LastUsed = 0;
+
+	/// Estimated memory used by the script and its nodes
+	SIZE_T MemoryBytes = 0;
+
+	/// Callbacks waiting for the script to finish loading
+	TArray<TFunction<void(USUDSScript*)>> PendingCallbacks;
+};
+
+/// Dialogues waiting to be reused for one script
+USTRUCT()
+struct FSUDSDialoguePool
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<TObjectPtr<USUDSDialogue>> FreeDialogues;
+};
+
+/// Counters for the dialogue pool, see USUDSSubsystem::AcquireDialogue
+USTRUCT(BlueprintType)
+struct FSUDSDialoguePoolStats
+{
+	GENERATED_BODY()
+
+	/// Number of acquires which reused a pooled dialogue
+	UPROPERTY(BlueprintReadOnly, Category="SUDS")
+	int Hits = 0;
+
+	/// Number of acquires which had to create a new dialogue
+	UPROPERTY(BlueprintReadOnly, Category="SUDS")
+	int Misses = 0;
+
+	/// Number of dialogues released back into the pool
+	UPROPERTY(BlueprintReadOnly, Category="SUDS")
+	int Released = 0;
+
+	/// Number of released dialogues left for garbage collection because their pool was full
+	UPROPERTY(BlueprintReadOnly, Category="SUDS")
+	int Discarded = 0;
+};
+
+/// Copy of the global variables held by the subsystem, for saving
+USTRUCT(BlueprintType)
+struct FSUDSGlobalVariablesState
+{
+	GENERATED_BODY()
+protected:
+	UPROPERTY(BlueprintReadOnly, SaveGame, Category="SUDS")
+	TMap<FName, FSUDSValue> Variables;
+
+public:
+	FSUDSGlobalVariablesState() {}
+
+	FSUDSGlobalVariablesState(const TMap<FName, FSUDSValue>& InVars) : Variables(InVars)
+	{
+	}
+
+	const TMap<FName, FSUDSValue>& GetVariables() const { return Variables; }
+
+	SUDS_API friend FArchive& operator<<(FArchive& Ar, FSUDSGlobalVariablesState& Value);
+	SUDS_API friend void operator<<(FStructuredArchive::FSlot Slot, FSUDSGlobalVariablesState& Value);
+	bool Serialize(FStructuredArchive::FSlot Slot)
+	{
+		Slot << *this;
+		return true;
+	}
+	bool Serialize(FArchive& Ar)
+	{
+		Ar << *this;
+		return true;
+	}
+};
+
 /**
  * 
  */
@@ -58,6 +157,302 @@ public:
 	const FSoundConcurrencySettings& GetVoicedLineConcurrencySettings() const;
 
 	USoundConcurrency* GetVoicedLineConcurrency() const { return VoiceConcurrency; }
+
+protected:
+	/// Scripts which are resident, or being loaded, keyed by asset path
+	UPROPERTY()
+	TMap<FSoftObjectPath, FSUDSScriptCacheEntry> ScriptCache;
+
+	FStreamableManager StreamableManager;
+	uint64 ScriptUseCounter = 0;
+	int64 ScriptCacheBudgetBytes = 16 * 1024 * 1024;
+	SIZE_T ScriptCacheBytes = 0;
+
+	/// Handlers for specific events from any dialogue, see SubscribeToEvent
+	FSUDSEventSubscriptions EventSubscriptions;
+
+	/// Released dialogues ready to be reused, per script. Keyed weakly so pooling a script doesn't keep it alive
+	/// after the script cache has released it
+	UPROPERTY()
+	TMap<TWeakObjectPtr<const USUDSScript>, FSUDSDialoguePool> DialoguePools;
+	int MaxPooledDialoguesPerScript = 16;
+	FSUDSDialoguePoolStats DialoguePoolStats;
+
+	/// Global variables, keyed by their full name including SUDS_GLOBAL_VARIABLE_PREFIX
+	UPROPERTY()
+	TMap<FName, FSUDSValue> GlobalVariables;
+	/// Incremented whenever a global variable changes, never reset so dialogues can tell when to update cached text
+	uint32 GlobalVariablesVersion = 1;
+
+	/// One handler for culture changes, rather than one per script
+	FDelegateHandle TextRevisionChangedHandle;
+
+	void OnScriptLoaded(FSoftObjectPath Path);
+	void OnTextRevisionChanged();
+	void TrimScriptCache();
+	static SIZE_T EstimateScriptMemory(const USUDSScript* Script);
+
+public:
+	/**
+	 * Request that a script is loaded and kept resident. The script is loaded asynchronously if needed, and OnLoaded
+	 * is called when it's available (immediately, if it's already loaded). Call ReleaseScript when you no longer need
+	 * it, for example when walking away from an NPC whose dialogue you preloaded.
+	 * @param Script The script to load
+	 * @param OnLoaded Called when the script is loaded; the script will be null if it failed to load
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Scripts")
+	void RequestScriptAsync(const TSoftObjectPtr<USUDSScript>& Script, FOnSUDSScriptLoaded OnLoaded);
+
+	/// Native version of RequestScriptAsync, calling OnLoaded with the script (or null on failure)
+	void RequestScriptAsyncWithCallback(const TSoftObjectPtr<USUDSScript>& Script,
+	                                    TFunction<void(USUDSScript*)>&& OnLoaded);
+
+	/**
+	 * Release a request for a script previously made with RequestScriptAsync. Once there are no requests left for
+	 * a script it's kept around until the script cache needs the space, at which point the least recently used
+	 * scripts are released first. Dialogues hold their own references, so are unaffected. 
+	 * @param Script The script to release
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Scripts")
+	void ReleaseScript(const TSoftObjectPtr<USUDSScript>& Script);
+
+	/// Return whether a script is loaded and held in the script cache
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Scripts")
+	bool IsScriptResident(const TSoftObjectPtr<USUDSScript>& Script) const;
+
+	/**
+	 * Set the memory budget for scripts held in the cache which have no outstanding requests. When exceeded, the
+	 * least recently used of those scripts are released. Scripts still requested are never released.
+	 * @param Bytes The budget in bytes
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Scripts")
+	void SetScriptCacheBudget(int64 Bytes);
+
+	/// Get the memory budget for unrequested scripts in the cache
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Scripts")
+	int64 GetScriptCacheBudget() const { return ScriptCacheBudgetBytes; }
+
+	/// Get the estimated memory used by all scripts in the cache, in bytes
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Scripts")
+	int64 GetScriptCacheMemory() const { return ScriptCacheBytes; }
+
+	/**
+	 * Create a dialogue from a script which may not be loaded yet. The script is loaded asynchronously if needed,
+	 * and the dialogue created once it's available.
+	 * @param Owner The owner of the dialogue, see USUDSLibrary::CreateDialogue. If the owner is destroyed before the
+	 *   script loads, no dialogue is created.
+	 * @param Script The script to base the dialogue on
+	 * @param Participants Participants to add to the dialogue before it's initialised
+	 * @param OnCreated Called with the new dialogue, or null if the script could not be loaded
+	 * @param bStartImmediately Whether to call Start() on the dialogue before OnCreated is called
+	 * @param StartLabel If set to start immediately, which label to start from (None means start from the beginning)
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Scripts", meta=(AutoCreateRefTerm="Participants"))
+	void CreateDialogueAsync(UObject* Owner,
+	                         const TSoftObjectPtr<USUDSScript>& Script,
+	                         const TArray<UObject*>& Participants,
+	                         FOnSUDSDialogueCreated OnCreated,
+	                         bool bStartImmediately = false,
+	                         FName StartLabel = NAME_None);
+
+	/**
+	 * Subscribe a handler to a specific event raised by any dialogue's script. Useful for systems which react to
+	 * events wherever they come from, like quests or cameras, without becoming participants in every dialogue. 
+	 * Called after the dialogue's own subscribers (see USUDSDialogue::SubscribeToEvent).
+	 * @param EventName The name of the event
+	 * @param Handler The handler to call
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Events")
+	void SubscribeToEvent(FName EventName, FOnSUDSNamedEvent Handler);
+
+	/// Remove a handler subscribed with SubscribeToEvent
+	UFUNCTION(BlueprintCallable, Category="SUDS|Events")
+	void UnsubscribeFromEvent(FName EventName, FOnSUDSNamedEvent Handler);
+
+	/**
+	 * Subscribe a function on an object, found by name, to a specific event raised by any dialogue's script. 
+	 * @param EventName The name of the event
+	 * @param Object The object to call
+	 * @param FunctionName The name of the function to call, which must have the same parameters as
+	 *   USUDSDialogue::OnEvent. If None, the function with the same name as the event is called.
+	 * @return Whether a suitable function was found
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Events")
+	bool SubscribeFunctionToEvent(FName EventName, UObject* Object, FName FunctionName = NAME_None);
+
+	/// Remove all event subscriptions which call an object
+	UFUNCTION(BlueprintCallable, Category="SUDS|Events")
+	void UnsubscribeObjectFromEvents(UObject* Object);
+
+	/**
+	 * Get a dialogue for a script from the dialogue pool, creating one only if there are none free. This is much
+	 * cheaper than CreateDialogue when lots of short dialogues are run, such as barks. The dialogue is in the same
+	 * state as a newly created one, and is owned by this subsystem; call ReleaseDialogue when you're done with it
+	 * instead of just dropping your reference.
+	 * @param Script The script to run
+	 * @param bStartImmediately Whether to call Start() on the dialogue
+	 * @param StartLabel If set to start immediately, which label to start from (None means start from the beginning)
+	 * @return The dialogue, or null if the script was invalid
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue Pool")
+	USUDSDialogue* AcquireDialogue(USUDSScript* Script, bool bStartImmediately = true, FName StartLabel = NAME_None);
+
+	/**
+	 * Get a dialogue for a script from the dialogue pool with a set of participants, which are added before the
+	 * dialogue is initialised, as with USUDSLibrary::CreateDialogueWithParticipants.
+	 * See AcquireDialogue for more details.
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue Pool")
+	USUDSDialogue* AcquireDialogueWithParticipants(USUDSScript* Script,
+	                                               const TArray<UObject*>& Participants,
+	                                               bool bStartImmediately = true,
+	                                               FName StartLabel = NAME_None);
+
+	/**
+	 * Return a dialogue obtained from AcquireDialogue to the pool. Its participants, delegate bindings and event
+	 * subscriptions are all removed and its state reset, so don't use it again afterwards.
+	 * Dialogues which weren't acquired from the pool are ignored.
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue Pool")
+	void ReleaseDialogue(USUDSDialogue* Dialogue);
+
+	/// Set how many released dialogues are kept for reuse per script. Extra dialogues are left to be garbage collected.
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue Pool")
+	void SetMaxPooledDialoguesPerScript(int MaxDialogues);
+
+	/// Get how many released dialogues are kept for reuse per script
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue Pool")
+	int GetMaxPooledDialoguesPerScript() const { return MaxPooledDialoguesPerScript; }
+
+	/// Get the number of released dialogues currently waiting to be reused, for all scripts
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue Pool")
+	int GetNumPooledDialogues() const;
+
+	/// Release all pooled dialogues, for example after a level change
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue Pool")
+	void EmptyDialoguePool();
+
+	/// Get the dialogue pool counters
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Dialogue Pool")
+	const FSUDSDialoguePoolStats& GetDialoguePoolStats() const { return DialoguePoolStats; }
+
+	/// Reset the dialogue pool counters to zero
+	UFUNCTION(BlueprintCallable, Category="SUDS|Dialogue Pool")
+	void ResetDialoguePoolStats() { DialoguePoolStats = FSUDSDialoguePoolStats(); }
+
+	/**
+	 * Raised when a global variable changes, whether from a dialogue's script or from code. Since global variables
+	 * are shared by all dialogues, this is the place to listen for them rather than each dialogue's OnVariableChanged.
+	 */
+	UPROPERTY(BlueprintAssignable, Category="SUDS|Global Variables")
+	FOnSUDSGlobalVariableChanged OnGlobalVariableChanged;
+
+	/**
+	 * Set a global variable. Global variables are shared by all dialogues, which refer to them in scripts with the
+	 * "global." prefix, e.g. {global.Reputation}. Dialogues read the value held here directly, so there's no need to
+	 * supply it to each dialogue via participants.
+	 * @param Name The name of the variable, with or without the "global." prefix
+	 * @param Value The value of the variable
+	 */
+	UFUNCTION(BlueprintCallable, Category="SUDS|Global Variables")
+	void SetGlobalVariable(FName Name, FSUDSValue Value)
+	{
+		SetGlobalVariableImpl(GetGlobalVariableKey(Name), Value, nullptr);
+	}
+
+	/// Set a text global variable, see SetGlobalVariable
+	UFUNCTION(BlueprintCallable, Category="SUDS|Global Variables")
+	void SetGlobalVariableText(FName Name, FText Value) { SetGlobalVariable(Name, Value); }
+
+	/// Set an int global variable, see SetGlobalVariable
+	UFUNCTION(BlueprintCallable, Category="SUDS|Global Variables")
+	void SetGlobalVariableInt(FName Name, int32 Value) { SetGlobalVariable(Name, Value); }
+
+	/// Set a float global variable, see SetGlobalVariable
+	UFUNCTION(BlueprintCallable, Category="SUDS|Global Variables")
+	void SetGlobalVariableFloat(FName Name, float Value) { SetGlobalVariable(Name, Value); }
+
+	/// Set a boolean global variable, see SetGlobalVariable
+	UFUNCTION(BlueprintCallable, Category="SUDS|Global Variables")
+	void SetGlobalVariableBoolean(FName Name, bool Value) { SetGlobalVariable(Name, Value); }
+
+	/// Set a gender global variable, see SetGlobalVariable
+	UFUNCTION(BlueprintCallable, Category="SUDS|Global Variables")
+	void SetGlobalVariableGender(FName Name, ETextGender Value) { SetGlobalVariable(Name, Value); }
+
+	/// Set a name global variable, see SetGlobalVariable
+	UFUNCTION(BlueprintCallable, Category="SUDS|Global Variables")
+	void SetGlobalVariableName(FName Name, FName Value) { SetGlobalVariable(Name, FSUDSValue(Value, false)); }
+
+	/**
+	 * Get a global variable as a general value type. Use the GetDialogueValueAs functions in the SUDS library to
+	 * convert it.
+	 * @param Name The name of the variable, with or without the "global." prefix
+	 * @return The value, which is empty if the variable isn't set
+	 */
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Global Variables")
+	FSUDSValue GetGlobalVariable(FName Name) const
+	{
+		if (const FSUDSValue* Value = FindGlobalVariable(GetGlobalVariableKey(Name)))
+		{
+			return *Value;
+		}
+		return FSUDSValue();
+	}
+
+	/// Whether a global variable has been set
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Global Variables")
+	bool IsGlobalVariableSet(FName Name) const
+	{
+		return FindGlobalVariable(GetGlobalVariableKey(Name)) != nullptr;
+	}
+
+	/// Remove a global variable
+	UFUNCTION(BlueprintCallable, Category="SUDS|Global Variables")
+	void UnSetGlobalVariable(FName Name)
+	{
+		SetGlobalVariableImpl(GetGlobalVariableKey(Name), FSUDSValue(), nullptr);
+	}
+
+	/// Get all global variables, keyed by their full name including the "global." prefix
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Global Variables")
+	const TMap<FName, FSUDSValue>& GetGlobalVariables() const { return GlobalVariables; }
+
+	/// Remove all global variables, for example when starting a new game
+	UFUNCTION(BlueprintCallable, Category="SUDS|Global Variables")
+	void ResetGlobalVariables();
+
+	/// Get the global variables as a single block of state which can be saved. Dialogues' own saved state doesn't
+	/// include global variables.
+	UFUNCTION(BlueprintCallable, BlueprintPure, Category="SUDS|Global Variables")
+	FSUDSGlobalVariablesState GetGlobalVariablesState() const { return FSUDSGlobalVariablesState(GlobalVariables); }
+
+	/// Replace all global variables with state previously returned by GetGlobalVariablesState
+	UFUNCTION(BlueprintCallable, Category="SUDS|Global Variables")
+	void RestoreGlobalVariablesState(const FSUDSGlobalVariablesState& State);
+
+	/// Find a global variable by its full name, null if unset
+	const FSUDSValue* FindGlobalVariable(const FName& FullName) const { return GlobalVariables.Find(FullName); }
+	/**
+	 * Set (or unset, if Value is empty) a global variable by its full name, raising OnGlobalVariableChanged if it
+	 * changed. Called by dialogues when their scripts set global variables.
+	 * @param FullName The name including the "global." prefix
+	 * @param Value The new value
+	 * @param FromDialogue The dialogue which set it, if any
+	 */
+	void SetGlobalVariableImpl(const FName& FullName, const FSUDSValue& Value, USUDSDialogue* FromDialogue);
+	/// Version which changes whenever any global variable changes
+	uint32 GetGlobalVariablesVersion() const { return GlobalVariablesVersion; }
+	/// Add the "global." prefix to a variable name if it doesn't already have it
+	static FName GetGlobalVariableKey(const FName& Name);
+
+	/// Whether anything is subscribed to an event name
+	bool HasEventSubscribers(FName EventName) const { return EventSubscriptions.HasSubscribers(EventName); }
+	/// Call the handlers subscribed to an event, called by dialogues when they raise events
+	void DispatchEvent(USUDSDialogue* Dialogue, FName EventName, const TArray<FSUDSValue>& Arguments) const
+	{
+		EventSubscriptions.Dispatch(Dialogue, EventName, Arguments);
+	}
 	
 };
 
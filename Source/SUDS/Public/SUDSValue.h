@@ -3,6 +3,7 @@
 #pragma once
 
 #include "SUDSCommon.h"
+#include "HAL/ThreadSafeCounter.h"
 #include "SUDSValue.generated.h"
 
 
@@ -20,6 +21,29 @@ enum class ESUDSValueType : uint8
 
 	Empty = 99
 };
+
+/// Immutable, reference counted text so that a text value only needs a single pointer, and copying it is cheap
+class FSUDSSharedText
+{
+public:
+	explicit FSUDSSharedText(const FText& InText) : Text(InText) {}
+	explicit FSUDSSharedText(FText&& InText) : Text(MoveTemp(InText)) {}
+
+	const FText Text;
+
+	void AddRef() const { NumRefs.Increment(); }
+	void Release() const
+	{
+		if (NumRefs.Decrement() == 0)
+		{
+			delete this;
+		}
+	}
+
+private:
+	mutable FThreadSafeCounter NumRefs;
+};
+
 /// Struct which can hold any of the value types that SUDS needs to use, in a Blueprint friendly manner
 /// For getting / setting these values from blueprints, see blueprint library functions SetSUDSValue<Type>() / GetSUDSValue<Type>()
 /// For convenience these are wrapped in USUDSDialogue but in e.g. event callbacks they're not
@@ -28,53 +52,96 @@ struct SUDS_API FSUDSValue
 {
 	GENERATED_BODY()
 protected:
+	// Kept to 16 bytes since values are everywhere: variable state, expression queues, the evaluation stack, event
+	// args. Int/float/bool/gender live inline, names are stored minimally (variables are case insensitive anyway),
+	// and text is a pointer to shared immutable text. Which member of the second union is live depends on Type.
 	ESUDSValueType Type;
 	union
 	{
 		int32 IntValue;
 		float FloatValue;
 	};
-	TOptional<FText> TextValue;
-	// Used for variables and name values
-	TOptional<FName> Name;
+	union
+	{
+		/// Used for variables and name values
+		FMinimalName NameValue;
+		/// Used for text values, null means empty text
+		const FSUDSSharedText* SharedText;
+	};
+
+	FORCEINLINE bool HasName() const { return Type == ESUDSValueType::Name || Type == ESUDSValueType::Variable; }
+	FORCEINLINE bool HasSharedText() const { return Type == ESUDSValueType::Text && SharedText; }
+
+	void SetText(FSUDSSharedText* NewText)
+	{
+		SharedText = NewText;
+		SharedText->AddRef();
+	}
+
+	void CopyPayload(const FSUDSValue& Other)
+	{
+		Type = Other.Type;
+		IntValue = Other.IntValue;
+		if (Other.HasName())
+		{
+			NameValue = Other.NameValue;
+		}
+		else
+		{
+			SharedText = Other.SharedText;
+			if (HasSharedText())
+			{
+				SharedText->AddRef();
+			}
+		}
+	}
+
+	void ReleasePayload()
+	{
+		if (HasSharedText())
+		{
+			SharedText->Release();
+		}
+		SharedText = nullptr;
+	}
+
 public:
 
-	FSUDSValue() : Type(ESUDSValueType::Empty), IntValue(0), TextValue(FText::GetEmpty()) {}
+	FSUDSValue() : Type(ESUDSValueType::Empty), IntValue(0), SharedText(nullptr) {}
 
 	FSUDSValue(const int32 Value)
-		: Type(ESUDSValueType::Int) { IntValue = Value; }
+		: Type(ESUDSValueType::Int), IntValue(Value), SharedText(nullptr) {}
 
 	FSUDSValue(const float Value)
-		: Type(ESUDSValueType::Float) { FloatValue = Value; }
+		: Type(ESUDSValueType::Float), FloatValue(Value), SharedText(nullptr) {}
 
 	FSUDSValue(const FText& Value)
 		: Type(ESUDSValueType::Text),
-		  IntValue(0),
-		  TextValue(Value)
+		  IntValue(0)
 	{
+		SetText(new FSUDSSharedText(Value));
 	}
 
 	FSUDSValue(FText&& Value)
-		: Type(ESUDSValueType::Text), IntValue(0), TextValue(MoveTemp(Value))
+		: Type(ESUDSValueType::Text), IntValue(0)
 	{
+		SetText(new FSUDSSharedText(MoveTemp(Value)));
 	}
 
 	FSUDSValue(ETextGender Value)
-		: Type(ESUDSValueType::Gender), IntValue(0)
+		: Type(ESUDSValueType::Gender), IntValue(static_cast<int32>(Value)), SharedText(nullptr)
 	{
-		IntValue = static_cast<int32>(Value);
 	}
 
 	FSUDSValue(bool Value)
-		: Type(ESUDSValueType::Boolean), IntValue(0)
+		: Type(ESUDSValueType::Boolean), IntValue(Value ? 1 : 0), SharedText(nullptr)
 	{
-		IntValue = Value ? 1 : 0;
 	}
 
 	FSUDSValue(const FName& ReferencedName, bool bIsVariable)
 	: Type(bIsVariable ? ESUDSValueType::Variable : ESUDSValueType::Name),
 	  IntValue(0),
-	  Name(ReferencedName)
+	  NameValue(NameToMinimalName(ReferencedName))
 	{
 	}
 
@@ -82,6 +149,69 @@ public:
 	explicit FSUDSValue(ESUDSValueType ValType)
 		: Type(ValType), IntValue(0)
 	{
+		if (HasName())
+		{
+			NameValue = NameToMinimalName(NAME_None);
+		}
+		else
+		{
+			SharedText = nullptr;
+		}
+	}
+
+	FSUDSValue(const FSUDSValue& Other)
+	{
+		CopyPayload(Other);
+	}
+
+	FSUDSValue(FSUDSValue&& Other)
+		: Type(Other.Type), IntValue(Other.IntValue)
+	{
+		if (Other.HasName())
+		{
+			NameValue = Other.NameValue;
+		}
+		else
+		{
+			// Steal the text reference
+			SharedText = Other.SharedText;
+			Other.SharedText = nullptr;
+		}
+	}
+
+	FSUDSValue& operator=(const FSUDSValue& Other)
+	{
+		if (this != &Other)
+		{
+			ReleasePayload();
+			CopyPayload(Other);
+		}
+		return *this;
+	}
+
+	FSUDSValue& operator=(FSUDSValue&& Other)
+	{
+		if (this != &Other)
+		{
+			ReleasePayload();
+			Type = Other.Type;
+			IntValue = Other.IntValue;
+			if (Other.HasName())
+			{
+				NameValue = Other.NameValue;
+			}
+			else
+			{
+				SharedText = Other.SharedText;
+				Other.SharedText = nullptr;
+			}
+		}
+		return *this;
+	}
+
+	~FSUDSValue()
+	{
+		ReleasePayload();
 	}
 
 	/// Whether this value is empty, i.e. hasn't been set to anything
@@ -124,8 +254,8 @@ public:
 		if (!IsEmpty() && Type != ESUDSValueType::Text && Type != ESUDSValueType::Variable)
 			UE_LOG(LogSUDS, Warning, TEXT("Getting value as text but was type %s"), *StaticEnum<ESUDSValueType>()->GetValueAsString(Type))
 
-		if (TextValue.IsSet())
-			return TextValue.GetValue();
+		if (HasSharedText())
+			return SharedText->Text;
 
 		return FText::GetEmpty();
 	}
@@ -154,8 +284,8 @@ public:
 		if (!IsEmpty() && Type != ESUDSValueType::Name && Type != ESUDSValueType::Variable)
 			UE_LOG(LogSUDS, Warning, TEXT("Getting value as Name but was type %s"), *StaticEnum<ESUDSValueType>()->GetValueAsString(Type))
 
-		if (Name.IsSet())
-			return Name.GetValue();
+		if (HasName())
+			return MinimalNameToName(NameValue);
 
 		return NAME_None;
 	}
@@ -165,8 +295,8 @@ public:
 		if (!IsEmpty() && Type != ESUDSValueType::Variable)
 			UE_LOG(LogSUDS, Warning, TEXT("Getting value as variable name but was type %s"), *StaticEnum<ESUDSValueType>()->GetValueAsString(Type))
 
-		if (Name.IsSet())
-			return Name.GetValue();
+		if (HasName())
+			return MinimalNameToName(NameValue);
 
 		return NAME_None;
 	}
@@ -187,7 +317,7 @@ public:
 		{
 		default:
 		case ESUDSValueType::Text:
-			return FFormatArgumentValue(TextValue.GetValue());
+			return FFormatArgumentValue(GetTextValue());
 		case ESUDSValueType::Int:
 			return FFormatArgumentValue(GetIntValue());
 		case ESUDSValueType::Boolean:
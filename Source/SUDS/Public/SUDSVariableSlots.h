@@ -0,0 +1,105 @@
+﻿// Copyright Steve Streeting 2022
+// Released under the MIT license https://opensource.org/license/MIT/
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SUDSValue.h"
+
+/**
+ * The values of a dialogue's variable slots, layered over an immutable base table shared by many dialogues (a
+ * script's header defaults). Changes go into a small per-dialogue overlay, so dialogues which only change a few
+ * variables don't each need a copy of the whole table. Once the overlay grows past a few entries it's flattened into
+ * a full copy, so lookups stay cheap for dialogues which change a lot.
+ * An Empty value means the variable is unset. Each slot also has a version, which the owner supplies when changing it,
+ * so that things derived from variables know when to update.
+ */
+struct SUDS_API FSUDSVariableSlots
+{
+protected:
+	struct FOverlayEntry
+	{
+		int32 Slot;
+		uint32 Version;
+		FSUDSValue Value;
+	};
+
+	/// Shared values which apply to any slot not in the overlay; may be null
+	TSharedPtr<const TArray<FSUDSValue>> Base;
+	/// Slots changed from Base, in the order they were first changed
+	TArray<FOverlayEntry> Overlay;
+	/// All slots, once the overlay has been flattened
+	TArray<FSUDSValue> Flat;
+	TArray<uint32> FlatVersions;
+	int32 NumSlots = 0;
+	/// Version of every slot not in the overlay
+	uint32 BaseVersion = 0;
+	bool bFlat = false;
+
+	/// Overlay size at which we stop searching it and flatten instead
+	static constexpr int32 MaxOverlayEntries = 8;
+
+	void Flatten();
+
+public:
+	/**
+	 * Reset all slots to a shared base
+	 * @param InBase Values to share; may be null if all slots should be unset
+	 * @param InNumSlots The number of slots
+	 * @param InVersion The version of all slots
+	 */
+	void Init(const TSharedPtr<const TArray<FSUDSValue>>& InBase, int32 InNumSlots, uint32 InVersion);
+	/// Remove all slots and the base, keeping allocations
+	void Reset();
+
+	int32 Num() const { return NumSlots; }
+	bool IsValidIndex(int32 Slot) const { return Slot >= 0 && Slot < NumSlots; }
+
+	/// Get the value of a slot, which is Empty if the variable is unset. Slot must be valid
+	const FSUDSValue& Get(int32 Slot) const
+	{
+		checkSlow(IsValidIndex(Slot));
+		if (bFlat)
+		{
+			return Flat[Slot];
+		}
+		for (const FOverlayEntry& Entry : Overlay)
+		{
+			if (Entry.Slot == Slot)
+			{
+				return Entry.Value;
+			}
+		}
+		return Base.IsValid() && Base->IsValidIndex(Slot) ? (*Base)[Slot] : GetEmptyValue();
+	}
+	/// Get the version of a slot, i.e. the version it was given when last set. Slot must be valid
+	uint32 GetVersion(int32 Slot) const
+	{
+		checkSlow(IsValidIndex(Slot));
+		if (bFlat)
+		{
+			return FlatVersions[Slot];
+		}
+		for (const FOverlayEntry& Entry : Overlay)
+		{
+			if (Entry.Slot == Slot)
+			{
+				return Entry.Version;
+			}
+		}
+		return BaseVersion;
+	}
+	/// Set the value of a slot, or unset it with an Empty value. Slot must be valid
+	void Set(int32 Slot, const FSUDSValue& Value, uint32 Version);
+
+	/// Whether this has its own copy of every slot, rather than sharing its base
+	bool IsFlattened() const { return bFlat; }
+	/// Number of slots this holds its own value for, if not flattened
+	int32 GetNumOverlaid() const { return Overlay.Num(); }
+	/// Memory allocated by this, not including the shared base
+	SIZE_T GetAllocatedSize() const
+	{
+		return Overlay.GetAllocatedSize() + Flat.GetAllocatedSize() + FlatVersions.GetAllocatedSize();
+	}
+
+	static const FSUDSValue& GetEmptyValue();
+};
@@ -2018,6 +2018,7 @@ void FSUDSScriptImporter::PopulateAssetFromTree(USUDSScript* Asset,
 						};
 
 						USUDSScriptNode* TargetNode = nullptr;
+						int TargetIndex = INDEX_NONE;
 						
 						if (InTargetNode)
 						{
@@ -2029,14 +2030,14 @@ void FSUDSScriptImporter::PopulateAssetFromTree(USUDSScript* Asset,
 								// -1 means "Goto end", leave target null in that case
 								if (Idx != -1)
 								{
-									const int NewTargetIndex = IndexRemap[Idx];
-									TargetNode = (*pOutNodes)[NewTargetIndex];
+									TargetIndex = IndexRemap[Idx];
+									TargetNode = (*pOutNodes)[TargetIndex];
 								}
 							}
 							else
 							{
-								const int NewTargetIndex = IndexRemap[InEdge.TargetNodeIdx];
-								TargetNode = (*pOutNodes)[NewTargetIndex];
+								TargetIndex = IndexRemap[InEdge.TargetNodeIdx];
+								TargetNode = (*pOutNodes)[TargetIndex];
 							}
 
 						}
@@ -2044,6 +2045,7 @@ void FSUDSScriptImporter::PopulateAssetFromTree(USUDSScript* Asset,
 						FSUDSScriptEdge NewEdge(TargetNode, NewEdgeType, InEdge.SourceLineNo);
 						NewEdge.SetCondition(InEdge.ConditionExpression);
 						NewEdge.SetTargetNode(TargetNode);
+						NewEdge.SetTargetNodeIndex(TargetIndex);
 
 						if (!InEdge.TextID.IsEmpty() && !InEdge.Text.IsEmpty())
 						{
@@ -57,16 +57,16 @@ EReimportResult::Type USUDSScriptReimportFactory::Reimport(UObject* Obj)
 	// when you put them back at the same outer & asset name?
 	// This means if we want to preserve anything from the previously imported object, such as generated VO asset links,
 	// we need to copy those out now.
-	TMap<FString, UDialogueVoice*> PrevSpeakerVoices = Script->GetSpeakerVoices();
+	TMap<FString, TSoftObjectPtr<UDialogueVoice>> PrevSpeakerVoices = Script->GetSpeakerVoices();
 	// Store the TextID -> DialogueWave, but also store the line text as well so we can detect whether it matches & warn if not
-	TMap<FString, TPair<FString, UDialogueWave*> > PrevWaves;
+	TMap<FString, TPair<FString, TSoftObjectPtr<UDialogueWave>> > PrevWaves;
 	for (auto Node : Script->GetNodes())
 	{
 		if (auto TN = Cast<USUDSScriptNodeText>(Node))
 		{
-			if (auto W = TN->GetWave())
+			if (!TN->GetWave().IsNull())
 			{
-				PrevWaves.Add(TN->GetTextID(), TPair<FString, UDialogueWave*>(TN->GetText().ToString(), W));
+				PrevWaves.Add(TN->GetTextID(), TPair<FString, TSoftObjectPtr<UDialogueWave>>(TN->GetText().ToString(), TN->GetWave()));
 			}
 		}
 	}
@@ -105,7 +105,7 @@ EReimportResult::Type USUDSScriptReimportFactory::Reimport(UObject* Obj)
 						            TEXT(
 							            "TextID %s is linked to Dialogue Wave %s, but text has changed. Check whether this line is linked to the correct wave, and consider Writing String Keys back to script before making more script changes in future."),
 							            *TN->GetTextID(),
-							            *pWavePair->Value->GetName());
+							            *pWavePair->Value.GetAssetName());
 					}
 
 				}
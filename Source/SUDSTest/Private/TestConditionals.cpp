@@ -25,6 +25,7 @@ Player: Hello
 [endif]
 NPC: OK
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(BasicConditionalInput)
 
 const FString ConditionalChoiceInput = R"RAWSUD(
 # First test has a regular choice first before conditional
@@ -62,6 +63,7 @@ NPC: OK next question
         Player: I took the 2.4 choice
 NPC: Bye
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(ConditionalChoiceInput)
 
 const FString SiblingConditionalChoiceInput = R"RAWSUD(
 NPC: Hello
@@ -81,6 +83,7 @@ NPC: Hello
 
 NPC: End
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(SiblingConditionalChoiceInput)
 
 
 const FString MixedChoiceAndBranchInput = R"RAWSUD(
@@ -146,6 +149,7 @@ Player: This is some fallthrough text
 :goodbye
 NPC: Bye
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(MixedChoiceAndBranchInput)
 
 
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestBasicConditionals,
@@ -641,6 +645,7 @@ Player: This is the main path
 
 NPC: Bye
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(ChoiceAfterConditionals)
 
 
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestChoiceAfterConditionals,
@@ -699,6 +704,7 @@ NPC: Hello
 
 NPC: Bye
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(ChoiceAfterNestedConditionals)
 
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestChoiceAfterNestedConditionals,
                                  "SUDSTest.TestChoiceAfterNestedConditionals",
@@ -753,6 +759,7 @@ NPC: Hello
         Player: Common choice here
 NPC: Bye
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(VarsSetBetweenTextAndChoiceChoice)
 
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FVarsSetBetweenTextAndChoiceChoice,
                                  "SUDSTest.VarsSetBetweenTextAndChoiceChoice",
@@ -771,6 +778,13 @@ bool FVarsSetBetweenTextAndChoiceChoice::RunTest(const FString& Parameters)
     const ScopedStringTableHolder StringTableHolder;
     Importer.PopulateAsset(Script, StringTableHolder.StringTable);
 
+    // Path from text to choice is only through a set node, so should be resolved at import
+    if (auto TextNode = Cast<USUDSScriptNodeText>(Script->GetFirstNode()))
+    {
+        TestNotEqual("Root choice resolved", TextNode->GetRootChoiceNodeIndex(), (int)INDEX_NONE);
+        TestEqual("Nodes before choice", TextNode->GetPreChoiceNodeIndices().Num(), 1);
+    }
+
     // Script shouldn't be the owner of the dialogue but it's the only UObject we've got right now so why not
     auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
 
@@ -806,6 +820,7 @@ NPC: Testing
         Player: going back
 NPC: Fallthrough
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(MultipleOptionalChoicesWithLinesBetweenTextAndChoice)
 
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestMultipleOptionalChoicesWithLinesBetweenTextAndChoice,
                                  "SUDSTest.TestMultipleOptionalChoicesWithLinesBetweenTextAndChoice",
@@ -0,0 +1,141 @@
+﻿#include "SUDSDialogue.h"
+#include "SUDSLibrary.h"
+#include "SUDSMessageLogger.h"
+#include "SUDSScript.h"
+#include "SUDSScriptImporter.h"
+#include "SUDSScriptNodeSet.h"
+#include "TestEventSub.h"
+#include "TestUtils.h"
+#include "Misc/AutomationTest.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/ObjectAndNameAsStringProxyArchive.h"
+
+PRAGMA_DISABLE_OPTIMIZATION
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestCookedExpressionParity,
+								 "SUDSTest.TestCookedExpressionParity",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+/// Round trip a node through an archive which filters editor-only data, as cooking does, so its expressions are
+/// stored in the compact form and lose their RPN queues
+static void CookNode(USUDSScriptNode* Node)
+{
+	TArray<uint8> Bytes;
+	FMemoryWriter MemWriter(Bytes);
+	MemWriter.SetFilterEditorOnly(true);
+	FObjectAndNameAsStringProxyArchive Writer(MemWriter, false);
+	Writer.SetFilterEditorOnly(true);
+	Node->Serialize(Writer);
+
+	FMemoryReader MemReader(Bytes);
+	MemReader.SetFilterEditorOnly(true);
+	FObjectAndNameAsStringProxyArchive Reader(MemReader, false);
+	Reader.SetFilterEditorOnly(true);
+	Node->Serialize(Reader);
+}
+
+/// Run a dialogue from the start, picking choices in a fixed pattern, and record everything it does
+static TArray<FString> RunTranscript(USUDSScript* Script)
+{
+	TArray<FString> Transcript;
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+	auto EvtSub = NewObject<UTestEventSub>();
+	EvtSub->Init(Dlg);
+
+	for (int Step = 0; Step < 100 && !Dlg->IsEnded(); ++Step)
+	{
+		Transcript.Add(FString::Printf(TEXT("%s: %s"), *Dlg->GetSpeakerID(), *Dlg->GetText().ToString()));
+		const int NumChoices = Dlg->GetNumberOfChoices();
+		for (int i = 0; i < NumChoices; ++i)
+		{
+			Transcript.Add(FString::Printf(TEXT("  * %s"), *Dlg->GetChoiceText(i).ToString()));
+		}
+		if (NumChoices > 1)
+		{
+			Dlg->Choose(Step % NumChoices);
+		}
+		else
+		{
+			Dlg->Continue();
+		}
+	}
+
+	for (auto& Evt : EvtSub->EventRecords)
+	{
+		FString Line = FString::Printf(TEXT("Event %s"), *Evt.Name.ToString());
+		for (auto& Arg : Evt.Args)
+		{
+			Line.Append(TEXT(" ")).Append(Arg.ToString());
+		}
+		Transcript.Add(Line);
+	}
+
+	TMap<FName, FSUDSValue> Variables = Dlg->GetVariables();
+	Variables.KeySort(FNameLexicalLess());
+	for (auto& Pair : Variables)
+	{
+		Transcript.Add(FString::Printf(TEXT("%s = %s"), *Pair.Key.ToString(), *Pair.Value.ToString()));
+	}
+	return Transcript;
+}
+
+bool FTestCookedExpressionParity::RunTest(const FString& Parameters)
+{
+	const auto& Fixtures = FSUDSTestFixtures::Get();
+	TestTrue("Fixtures registered", Fixtures.Num() > 0);
+
+	const ScopedStringTableHolder StringTableHolder;
+	int NumCookedExpressions = 0;
+	for (auto& Fixture : Fixtures)
+	{
+		const FString& Input = *Fixture.Value;
+		FSUDSMessageLogger Logger(false);
+		FSUDSScriptImporter Importer;
+		if (!TestTrue(Fixture.Key, Importer.ImportFromBuffer(GetData(Input), Input.Len(), *Fixture.Key, &Logger, true)))
+		{
+			continue;
+		}
+
+		auto Script = NewObject<USUDSScript>(GetTransientPackage(), *(Fixture.Key + "Uncooked"));
+		auto CookedScript = NewObject<USUDSScript>(GetTransientPackage(), *(Fixture.Key + "Cooked"));
+		Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+		Importer.PopulateAsset(CookedScript, StringTableHolder.StringTable);
+
+		for (auto NodeList : { &CookedScript->GetHeaderNodes(), &CookedScript->GetNodes() })
+		{
+			for (auto Node : *NodeList)
+			{
+				CookNode(Node);
+				if (auto SetNode = Cast<USUDSScriptNodeSet>(Node))
+				{
+					FSUDSExpression Expr = SetNode->GetExpression();
+					TestTrue(Fixture.Key + " queue dropped", Expr.GetQueue().IsEmpty());
+					++NumCookedExpressions;
+				}
+			}
+		}
+
+		// Both paths must do exactly the same things
+		const TArray<FString> Expected = RunTranscript(Script);
+		const TArray<FString> Actual = RunTranscript(CookedScript);
+		if (TestEqual(Fixture.Key + " transcript length", Actual.Num(), Expected.Num()))
+		{
+			for (int i = 0; i < Expected.Num(); ++i)
+			{
+				TestEqual(Fixture.Key + " transcript", Actual[i], Expected[i]);
+			}
+		}
+
+		Script->MarkAsGarbage();
+		CookedScript->MarkAsGarbage();
+	}
+	TestTrue("Cooked expressions were exercised", NumCookedExpressions > 0);
+
+	return true;
+}
+
+PRAGMA_ENABLE_OPTIMIZATION
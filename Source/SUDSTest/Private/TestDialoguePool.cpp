@@ -0,0 +1,145 @@
+﻿#include "SUDSDialogue.h"
+#include "SUDSLibrary.h"
+#include "SUDSMessageLogger.h"
+#include "SUDSScript.h"
+#include "SUDSScriptImporter.h"
+#include "SUDSSubsystem.h"
+#include "TestEventSub.h"
+#include "TestParticipant.h"
+#include "TestUtils.h"
+#include "Misc/AutomationTest.h"
+
+PRAGMA_DISABLE_OPTIMIZATION
+
+const FString DialoguePoolInput = R"RAWSUD(
+===
+[set Greeted false]
+[set Mood 1]
+===
+NPC: Hello
+	* Hi
+		[set Greeted true]
+		[event Waved]
+		Player: Hi there
+	* Ignore
+[set Mood {Mood} + 1]
+NPC: Bye
+)RAWSUD";
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestDialoguePool,
+								 "SUDSTest.TestDialoguePool",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestDialoguePool::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(DialoguePoolInput), DialoguePoolInput.Len(), "DialoguePoolInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	auto Sys = NewObject<USUDSSubsystem>();
+
+	// First use creates, and changes all the state we expect to be reset
+	auto EvtSub = NewObject<UTestEventSub>();
+	auto Participant = NewObject<UTestParticipant>();
+	auto Dlg = Sys->AcquireDialogueWithParticipants(Script, { Participant });
+	EvtSub->Init(Dlg);
+	Dlg->SetVoicePrefetchDepth(2);
+	Dlg->SetVariableInt("External", 5);
+	TestDialogueText(this, "First use", Dlg, "NPC", "Hello");
+	TestTrue("Choose", Dlg->Choose(0));
+	TestTrue("Greeted", Dlg->GetVariableBoolean("Greeted"));
+	TestEqual("Participant var", Dlg->GetVariableInt("NumCats"), 3);
+	TestEqual("Event received", EvtSub->EventRecords.Num(), 1);
+	TestEqual("Stats misses", Sys->GetDialoguePoolStats().Misses, 1);
+	TestEqual("Stats hits", Sys->GetDialoguePoolStats().Hits, 0);
+
+	Sys->ReleaseDialogue(Dlg);
+	TestEqual("Pooled", Sys->GetNumPooledDialogues(), 1);
+	TestEqual("Stats released", Sys->GetDialoguePoolStats().Released, 1);
+	TestTrue("Released dialogue has no script", Dlg->GetScript() == nullptr);
+	// Releasing twice does nothing
+	Sys->ReleaseDialogue(Dlg);
+	TestEqual("Double release ignored", Sys->GetNumPooledDialogues(), 1);
+
+	// Second use gets the same object back, but clean
+	auto Dlg2 = Sys->AcquireDialogue(Script, false);
+	TestTrue("Reused dialogue", Dlg2 == Dlg);
+	TestEqual("Stats hits", Sys->GetDialoguePoolStats().Hits, 1);
+	TestEqual("Pool now empty", Sys->GetNumPooledDialogues(), 0);
+	TestEqual("No participants", Dlg2->GetParticipants().Num(), 0);
+	TestEqual("Prefetch depth reset", Dlg2->GetVoicePrefetchDepth(), 0);
+	TestFalse("Header re-run", Dlg2->GetVariableBoolean("Greeted"));
+	TestEqual("Header var", Dlg2->GetVariableInt("Mood"), 1);
+	TestFalse("External var cleared", Dlg2->IsVariableSet("External"));
+	Dlg2->Start();
+	TestDialogueText(this, "Second use", Dlg2, "NPC", "Hello");
+	TestFalse("Choices taken cleared", Dlg2->HasChoiceIndexBeenTakenPreviously(0));
+	TestFalse("Participant vars not set", Dlg2->IsVariableSet("NumCats"));
+	TestTrue("Choose", Dlg2->Choose(0));
+	TestEqual("Delegates unbound", EvtSub->EventRecords.Num(), 1);
+	Sys->ReleaseDialogue(Dlg2);
+
+	// Dialogues not from the pool are left alone
+	auto Unpooled = USUDSLibrary::CreateDialogue(Script, Script);
+	AddExpectedError("wasn't acquired from the pool", EAutomationExpectedErrorFlags::Contains, 1);
+	Sys->ReleaseDialogue(Unpooled);
+	TestEqual("Unpooled not added", Sys->GetNumPooledDialogues(), 1);
+	TestTrue("Unpooled untouched", Unpooled->GetScript() == Script);
+
+	// Stress: lots of short overlapping dialogues, like crowd barks
+	Sys->ResetDialoguePoolStats();
+	Sys->SetMaxPooledDialoguesPerScript(8);
+	const int Rounds = 500;
+	const int Concurrent = 4;
+	TArray<USUDSDialogue*> Active;
+	TSet<USUDSDialogue*> Distinct;
+	const double StartTime = FPlatformTime::Seconds();
+	for (int Round = 0; Round < Rounds; ++Round)
+	{
+		for (int i = 0; i < Concurrent; ++i)
+		{
+			auto D = Sys->AcquireDialogue(Script);
+			Distinct.Add(D);
+			D->Choose(Round % 2);
+			D->Continue();
+			Active.Add(D);
+		}
+		for (auto D : Active)
+		{
+			if (D->GetVariableInt("Mood") != 2 || D->GetVariableBoolean("Greeted") != (Round % 2 == 0))
+			{
+				AddError(FString::Printf(TEXT("Bad state in round %d"), Round));
+			}
+			Sys->ReleaseDialogue(D);
+		}
+		Active.Reset();
+	}
+	const double PooledTime = FPlatformTime::Seconds() - StartTime;
+
+	const FSUDSDialoguePoolStats& Stats = Sys->GetDialoguePoolStats();
+	TestEqual("Stress hits", Stats.Hits + Stats.Misses, Rounds * Concurrent);
+	TestEqual("Stress misses", Stats.Misses, Concurrent - 1);
+	TestEqual("Stress released", Stats.Released, Rounds * Concurrent);
+	TestEqual("Stress discarded", Stats.Discarded, 0);
+	TestEqual("Only needed as many objects as were used at once", Distinct.Num(), Concurrent);
+	AddInfo(FString::Printf(TEXT("%d pooled dialogues in %.2fms"), Rounds * Concurrent, PooledTime * 1000.0));
+
+	// Shrinking the pool discards extras
+	Sys->SetMaxPooledDialoguesPerScript(1);
+	TestEqual("Pool trimmed", Sys->GetNumPooledDialogues(), 1);
+	Sys->EmptyDialoguePool();
+	TestEqual("Pool emptied", Sys->GetNumPooledDialogues(), 0);
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
+PRAGMA_ENABLE_OPTIMIZATION
@@ -1,6 +1,7 @@
 ﻿#include "TestEventSub.h"
 
 #include "SUDSDialogue.h"
+#include "SUDSSubsystem.h"
 
 void UTestEventSub::Init(USUDSDialogue* Dlg)
 {
@@ -9,6 +10,11 @@ void UTestEventSub::Init(USUDSDialogue* Dlg)
 
 }
 
+void UTestEventSub::InitGlobal(USUDSSubsystem* Sys)
+{
+	Sys->OnGlobalVariableChanged.AddDynamic(this, &UTestEventSub::OnGlobalVariableChanged);
+}
+
 void UTestEventSub::OnEvent(USUDSDialogue* Dlg, FName EventName, const TArray<FSUDSValue>& Args)
 {
 	EventRecords.Add(FEventRecord { EventName, Args });
@@ -18,3 +24,17 @@ void UTestEventSub::OnVariableChanged(USUDSDialogue* Dlg, FName VarName, const F
 {
 	SetVarRecords.Add(FSetVarRecord { VarName, Value, bFromScript });
 }
+
+void UTestEventSub::OnGlobalVariableChanged(FName VarName, const FSUDSValue& Value, USUDSDialogue* Dlg)
+{
+	GlobalSetVarRecords.Add(FSetVarRecord { VarName, Value, Dlg != nullptr });
+}
+
+void UTestEventSub::WellBlowMeDown(USUDSDialogue* Dlg, FName EventName, const TArray<FSUDSValue>& Args)
+{
+	EventRecords.Add(FEventRecord { EventName, Args });
+}
+
+void UTestEventSub::NotAnEventHandler(USUDSDialogue* Dlg, FName EventName, int Arg)
+{
+}
@@ -6,6 +6,7 @@
 #include "TestEventSub.generated.h"
 
 class USUDSDialogue;
+class USUDSSubsystem;
 UCLASS()
 class SUDSTEST_API UTestEventSub : public UObject
 {
@@ -13,6 +14,7 @@ class SUDSTEST_API UTestEventSub : public UObject
 
 public:
 	void Init(USUDSDialogue* Dlg);
+	void InitGlobal(USUDSSubsystem* Sys);
 
 	struct FEventRecord
 	{
@@ -28,6 +30,7 @@ public:
 
 	TArray<FEventRecord> EventRecords;
 	TArray<FSetVarRecord> SetVarRecords;
+	TArray<FSetVarRecord> GlobalSetVarRecords;
 
 	UFUNCTION()
 	void OnEvent(USUDSDialogue* Dlg, FName EventName, const TArray<FSUDSValue>& Args);
@@ -35,5 +38,16 @@ public:
 	UFUNCTION()
 	void OnVariableChanged(USUDSDialogue* Dlg, FName VarName, const FSUDSValue& Value, bool bFromScript);
 
+	UFUNCTION()
+	void OnGlobalVariableChanged(FName VarName, const FSUDSValue& Value, USUDSDialogue* Dlg);
+
+	/// Named after an event so it can be subscribed by function name
+	UFUNCTION()
+	void WellBlowMeDown(USUDSDialogue* Dlg, FName EventName, const TArray<FSUDSValue>& Args);
+
+	/// Same number of parameters as an event handler, but the wrong types
+	UFUNCTION()
+	void NotAnEventHandler(USUDSDialogue* Dlg, FName EventName, int Arg);
+
 	
 };
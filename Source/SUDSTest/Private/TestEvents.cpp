@@ -3,6 +3,7 @@
 #include "SUDSMessageLogger.h"
 #include "SUDSScript.h"
 #include "SUDSScriptImporter.h"
+#include "SUDSSubsystem.h"
 #include "TestEventSub.h"
 #include "TestParticipant.h"
 #include "TestUtils.h"
@@ -20,6 +21,7 @@ NPC: Alreet chook
 [event Calculated {FloatVar} + 10, true or false, {StringVar}]
 Player: Tara
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(EventParsingInput)
 
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestEvents,
 								 "SUDSTest.TestEvents",
@@ -259,4 +261,166 @@ bool FTestEvents::RunTest(const FString& Parameters)
 	return true;
 }
 
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestNativeParticipant,
+								 "SUDSTest.TestNativeParticipant",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+bool FTestNativeParticipant::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(EventParsingInput), EventParsingInput.Len(), "EventParsingInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script, false);
+	auto Participant = NewObject<UTestParticipant>();
+	auto Native = NewObject<UTestNativeParticipant>();
+	Native->Priority = -10;
+	auto NativeNoEvents = NewObject<UTestNativeParticipant>();
+	NativeNoEvents->Priority = 10;
+	NativeNoEvents->HandledCallbacks = ESUDSParticipantCallback::All & ~ESUDSParticipantCallback::Event;
+	Dlg->AddParticipant(NativeNoEvents);
+	Dlg->AddParticipant(Participant);
+	Dlg->AddParticipant(Native);
+
+	// Participants are called in priority order
+	if (TestEqual("Participant count", Dlg->GetParticipants().Num(), 3))
+	{
+		TestTrue("Lowest priority first", Dlg->GetParticipants()[0] == Native);
+		TestTrue("Default priority", Dlg->GetParticipants()[1] == Participant);
+		TestTrue("Highest priority last", Dlg->GetParticipants()[2] == NativeNoEvents);
+	}
+
+	Dlg->Start();
+	TestEqual("Native starting", Native->StartingCount, 1);
+	TestEqual("Native speaker line", Native->SpeakerLineCount, 1);
+	TestEqual("Native var changes", Native->SetVarRecords.Num(), Participant->SetVarRecords.Num());
+
+	Dlg->Continue();
+	TestEqual("Native proceeding", Native->ProceedingCount, 1);
+	if (TestEqual("Native events", Native->EventRecords.Num(), 1))
+	{
+		TestEqual("Event name", Native->EventRecords[0].Name.ToString(), "SummatHappened");
+		TestEqual("Event arg count", Native->EventRecords[0].Args.Num(), 6);
+	}
+	TestEqual("Participant events", Participant->EventRecords.Num(), 1);
+	TestEqual("Unhandled events not sent", NativeNoEvents->EventRecords.Num(), 0);
+	TestEqual("Handled callbacks still sent", NativeNoEvents->SpeakerLineCount, 2);
+
+	// Destroyed participants are skipped rather than called
+	NativeNoEvents->MarkAsGarbage();
+	Dlg->Continue();
+	TestEqual("Destroyed participant not called", NativeNoEvents->SpeakerLineCount, 2);
+	TestEqual("Other participants still called", Native->SpeakerLineCount, 3);
+
+	// ...and dropped when participants are next sorted
+	auto Late = NewObject<UTestNativeParticipant>();
+	Dlg->AddParticipant(Late);
+	TestEqual("Destroyed participant removed", Dlg->GetParticipants().Num(), 3);
+	TestFalse("Destroyed participant not present", Dlg->GetParticipants().Contains(NativeNoEvents));
+
+	Dlg->Continue();
+	TestTrue("Ended", Dlg->IsEnded());
+	TestEqual("Native finished", Native->FinishedCount, 1);
+	TestEqual("Late participant finished", Late->FinishedCount, 1);
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestEventSubscriptions,
+								 "SUDSTest.TestEventSubscriptions",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+bool FTestEventSubscriptions::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(EventParsingInput), EventParsingInput.Len(), "EventParsingInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	// Dialogue from the subsystem's pool, so that its events reach subsystem subscribers without a game world
+	auto Sys = NewObject<USUDSSubsystem>();
+	auto Dlg = Sys->AcquireDialogue(Script, false);
+
+	// Delegate subscribed to one event only
+	auto DelegateSub = NewObject<UTestEventSub>();
+	FOnSUDSNamedEvent Handler;
+	Handler.BindUFunction(DelegateSub, GET_FUNCTION_NAME_CHECKED(UTestEventSub, OnEvent));
+	Dlg->SubscribeToEvent("Calculated", Handler);
+
+	// Function found by name, defaults to the event name
+	auto FunctionSub = NewObject<UTestEventSub>();
+	TestTrue("Subscribe by function name", Dlg->SubscribeFunctionToEvent("WellBlowMeDown", FunctionSub));
+	AddExpectedError("has no function", EAutomationExpectedErrorFlags::Contains, 2);
+	TestFalse("Missing function should fail", Dlg->SubscribeFunctionToEvent("SummatHappened", FunctionSub));
+	TestFalse("Incompatible signature should fail", Dlg->SubscribeFunctionToEvent("SummatHappened", FunctionSub, GET_FUNCTION_NAME_CHECKED(UTestEventSub, NotAnEventHandler)));
+
+	// Subscribers for all dialogues in the subsystem
+	auto GlobalSub = NewObject<UTestEventSub>();
+	TestFalse("No global subscribers", Sys->HasEventSubscribers("SummatHappened"));
+	TestTrue("Global subscribe", Sys->SubscribeFunctionToEvent("SummatHappened", GlobalSub, GET_FUNCTION_NAME_CHECKED(UTestEventSub, OnEvent)));
+	TestTrue("Global subscribers", Sys->HasEventSubscribers("SummatHappened"));
+	TestFalse("Other events have no global subscribers", Sys->HasEventSubscribers("Calculated"));
+
+	Dlg->Start();
+	Dlg->Continue();
+	TestEqual("Delegate not called for other events", DelegateSub->EventRecords.Num(), 0);
+	TestEqual("Function not called for other events", FunctionSub->EventRecords.Num(), 0);
+	if (TestEqual("Global subscriber called", GlobalSub->EventRecords.Num(), 1))
+	{
+		TestEqual("Global event name", GlobalSub->EventRecords[0].Name.ToString(), "SummatHappened");
+		if (TestEqual("Global event args", GlobalSub->EventRecords[0].Args.Num(), 6))
+		{
+			TestEqual("Global event arg", GlobalSub->EventRecords[0].Args[3].GetIntValue(), 2);
+		}
+	}
+
+	Dlg->Continue();
+	if (TestEqual("Function subscriber called", FunctionSub->EventRecords.Num(), 1))
+	{
+		TestEqual("Function event name", FunctionSub->EventRecords[0].Name.ToString(), "WellBlowMeDown");
+		TestEqual("Function event args", FunctionSub->EventRecords[0].Args.Num(), 3);
+	}
+	if (TestEqual("Delegate subscriber called", DelegateSub->EventRecords.Num(), 1))
+	{
+		TestEqual("Delegate event name", DelegateSub->EventRecords[0].Name.ToString(), "Calculated");
+		if (TestEqual("Delegate event args", DelegateSub->EventRecords[0].Args.Num(), 3))
+		{
+			TestEqual("Calculated arg", DelegateSub->EventRecords[0].Args[0].GetFloatValue(), 76.67f);
+		}
+	}
+
+	TestEqual("Global subscriber not called for other events", GlobalSub->EventRecords.Num(), 1);
+
+	// Unsubscribing
+	Sys->UnsubscribeObjectFromEvents(GlobalSub);
+	TestFalse("Global unsubscribed", Sys->HasEventSubscribers("SummatHappened"));
+	Dlg->UnsubscribeFromEvent("Calculated", Handler);
+	Dlg->UnsubscribeObjectFromEvents(FunctionSub);
+	Dlg->Restart();
+	Dlg->Continue();
+	Dlg->Continue();
+	TestEqual("Delegate unsubscribed", DelegateSub->EventRecords.Num(), 1);
+	TestEqual("Function unsubscribed", FunctionSub->EventRecords.Num(), 1);
+	TestEqual("Global subscriber unsubscribed", GlobalSub->EventRecords.Num(), 1);
+
+	Sys->ReleaseDialogue(Dlg);
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
 PRAGMA_ENABLE_OPTIMIZATION
\ No newline at end of file
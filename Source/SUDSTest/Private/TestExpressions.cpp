@@ -1,5 +1,10 @@
 ﻿#include "SUDSExpression.h"
+#include "SUDSExpressionLexer.h"
+#include "Internationalization/Regex.h"
+#include "Misc/DefaultValueHelper.h"
 #include "Misc/AutomationTest.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
 
 PRAGMA_DISABLE_OPTIMIZATION
 
@@ -36,6 +41,13 @@ bool FTestExpressions::RunTest(const FString& Parameters)
 	{
 		TestEqual("Variable name", Expr.GetVariableNames()[0].ToString(), "Six");
 	}
+	// Compiled form of 3 4 6 * + 1 + never needs more than 3 items on the stack
+	TestEqual("Max stack depth", Expr.GetMaxStackDepth(), 3);
+
+	// Deeper than the inline stack
+	TestTrue("DeepParse", Expr.ParseFromString("1 + (2 + (3 + (4 + (5 + (6 + (7 + (8 + (9 + {Six}))))))))", nullptr));
+	TestEqual("Max stack depth", Expr.GetMaxStackDepth(), 10);
+	TestEqual("Eval", Expr.Evaluate(Variables).GetIntValue(), 51);
 
 	TestTrue("Arithmetic", Expr.ParseFromString("-6.7 * 2 + (21.3 - 8) * 5", nullptr));
 	TestEqual("Eval", Expr.Evaluate(Variables).GetFloatValue(), 53.1f);
@@ -154,9 +166,54 @@ bool FTestExpressions::RunTest(const FString& Parameters)
 	TestTrue("Eval", Expr.Evaluate(Variables).GetBooleanValue());
 	TestTrue("Comparisons", Expr.ParseFromString("{Neuter} == Neuter", nullptr));
 	TestTrue("Eval", Expr.Evaluate(Variables).GetBooleanValue());
-	
 
-	
+	// Constant folding
+	TestTrue("Folding", Expr.ParseFromString("60 * 60 * 24", nullptr));
+	if (TestTrue("Folded to literal", Expr.IsLiteral()))
+	{
+		TestEqual("Folded value", Expr.GetIntLiteralValue(), 86400);
+	}
+	TestTrue("Folding", Expr.ParseFromString("not true", nullptr));
+	if (TestTrue("Folded to literal", Expr.IsLiteral()))
+	{
+		TestFalse("Folded value", Expr.GetBooleanLiteralValue());
+	}
+	TestTrue("Folding", Expr.ParseFromString("(3 + 4) * {Six}", nullptr));
+	TestEqual("Partially folded queue len", Expr.GetQueue().Num(), 3);
+	TestEqual("Eval", Expr.Evaluate(Variables).GetIntValue(), 42);
+	TestTrue("Folding", Expr.ParseFromString("({Six} > 1) and true", nullptr));
+	TestEqual("Identity removed queue len", Expr.GetQueue().Num(), 3);
+	TestTrue("Eval", Expr.Evaluate(Variables).GetBooleanValue());
+	// Identities on a lone variable must be kept, since the operator converts unset variables
+	TestTrue("Folding", Expr.ParseFromString("{Unset} + 0", nullptr));
+	TestEqual("Identity kept queue len", Expr.GetQueue().Num(), 3);
+	// Never fold a division by zero
+	TestTrue("Folding", Expr.ParseFromString("1 / 0", nullptr));
+	TestFalse("Not folded", Expr.IsLiteral());
+
+	// Short-circuiting; only variables actually read should be reported
+	TArray<FName> VariablesRead;
+	auto RecordRead = [&VariablesRead](const FName& VarName) { VariablesRead.Add(VarName); };
+	TestTrue("ShortCircuit", Expr.ParseFromString("{SomethingFalse} and {Six} > 3", nullptr));
+	TestFalse("Eval", Expr.EvaluateBoolean(Variables, RecordRead, ""));
+	if (TestEqual("Variables read", VariablesRead.Num(), 1))
+	{
+		TestEqual("Variable read", VariablesRead[0].ToString(), "SomethingFalse");
+	}
+	VariablesRead.Empty();
+	TestTrue("ShortCircuit", Expr.ParseFromString("{SomethingTrue} or {Six} > 3 or {Seven} > 3", nullptr));
+	TestTrue("Eval", Expr.EvaluateBoolean(Variables, RecordRead, ""));
+	TestEqual("Variables read", VariablesRead.Num(), 1);
+	VariablesRead.Empty();
+	TestTrue("ShortCircuit", Expr.ParseFromString("({SomethingFalse} or {Six} > 3) and not ({SomethingTrue} and {Six} == {Six})", nullptr));
+	TestFalse("Eval", Expr.EvaluateBoolean(Variables, RecordRead, ""));
+	// Each variable reported only once even though Six is read twice
+	TestEqual("Variables read", VariablesRead.Num(), 3);
+	VariablesRead.Empty();
+	TestTrue("ShortCircuit", Expr.ParseFromString("{SomethingTrue} and {SomethingFalse}", nullptr));
+	TestFalse("Eval", Expr.EvaluateBoolean(Variables, RecordRead, ""));
+	TestEqual("Variables read", VariablesRead.Num(), 2);
+
 	return true;
 };
 
@@ -189,6 +246,302 @@ bool FTestBadExpressions::RunTest(const FString& Parameters)
 	return true;
 }
 
+/// The regex ParseFromString used to tokenise with, before FSUDSExpressionLexer
+static const TCHAR* LegacyTokenPattern = TEXT("(\\{[\\w\\.]+\\}|-?\\d+(?:\\.\\d*)?|[-+*\\/\\(\\)]|and|&&|\\|\\||or|not|\\<\\>|!=|!|\\<=?|\\>=?|==?|[mM]asculine|[fF]eminine|[nN]euter|[tT]rue|[fF]alse|\\\"([^\\\"]*)\\\"|`([^`]*)`)");
+
+/// How FSUDSExpression::ParseOperand worked before the lexer, with a regex per kind of operand
+static bool LegacyParseOperand(const FString& ValueStr, FSUDSValue& OutVal)
+{
+	if (ValueStr.Compare("true", ESearchCase::IgnoreCase) == 0)
+	{
+		OutVal = FSUDSValue(true);
+		return true;
+	}
+	if (ValueStr.Compare("false", ESearchCase::IgnoreCase) == 0)
+	{
+		OutVal = FSUDSValue(false);
+		return true;
+	}
+	if (ValueStr.Compare("masculine", ESearchCase::IgnoreCase) == 0)
+	{
+		OutVal = FSUDSValue(ETextGender::Masculine);
+		return true;
+	}
+	if (ValueStr.Compare("feminine", ESearchCase::IgnoreCase) == 0)
+	{
+		OutVal = FSUDSValue(ETextGender::Feminine);
+		return true;
+	}
+	if (ValueStr.Compare("neuter", ESearchCase::IgnoreCase) == 0)
+	{
+		OutVal = FSUDSValue(ETextGender::Neuter);
+		return true;
+	}
+	{
+		const FRegexPattern Pattern(TEXT("^\\\"([^\\\"]*)\\\"$"));
+		FRegexMatcher Regex(Pattern, ValueStr);
+		if (Regex.FindNext())
+		{
+			OutVal = FSUDSValue(FText::FromString(Regex.GetCaptureGroup(1)));
+			return true;
+		}
+	}
+	{
+		const FRegexPattern Pattern(TEXT("^`([^`]*)`$"));
+		FRegexMatcher Regex(Pattern, ValueStr);
+		if (Regex.FindNext())
+		{
+			OutVal = FSUDSValue(FName(Regex.GetCaptureGroup(1)), false);
+			return true;
+		}
+	}
+	{
+		const FRegexPattern Pattern(TEXT("^\\{([^\\}]*)\\}$"));
+		FRegexMatcher Regex(Pattern, ValueStr);
+		if (Regex.FindNext())
+		{
+			OutVal = FSUDSValue(FName(Regex.GetCaptureGroup(1)), true);
+			return true;
+		}
+	}
+	float FloatVal;
+	int IntVal;
+	if (FDefaultValueHelper::ParseInt(ValueStr, IntVal))
+	{
+		OutVal = FSUDSValue(IntVal);
+		return true;
+	}
+	if (FDefaultValueHelper::ParseFloat(ValueStr, FloatVal))
+	{
+		OutVal = FSUDSValue(FloatVal);
+		return true;
+	}
+	return false;
+}
+
+/// Tokenise an expression the way ParseFromString used to, parsing each operand. Returns the token texts
+static TArray<FString> LegacyTokenise(const FString& Expression)
+{
+	TArray<FString> Tokens;
+	const FRegexPattern Pattern(LegacyTokenPattern);
+	FRegexMatcher Regex(Pattern, Expression);
+	while (Regex.FindNext())
+	{
+		FString Str = Regex.GetCaptureGroup(1);
+		if (FSUDSExpression::ParseOperator(Str) == ESUDSExpressionItemType::Null)
+		{
+			FSUDSValue Operand;
+			LegacyParseOperand(Str, Operand);
+		}
+		Tokens.Add(MoveTemp(Str));
+	}
+	return Tokens;
+}
+
+/// Generate a corpus like a large script's worth of set/if/event expressions
+static TArray<FString> MakeExpressionCorpus(int NumExpressions)
+{
+	TArray<FString> Corpus;
+	Corpus.Reserve(NumExpressions);
+	for (int i = 0; i < NumExpressions; ++i)
+	{
+		switch (i % 5)
+		{
+		default:
+		case 0:
+			Corpus.Add(FString::Printf(TEXT("{Var%d} + %d * ({Other%d} - 3.5)"), i, i, i % 100));
+			break;
+		case 1:
+			Corpus.Add(FString::Printf(TEXT("{HasQuest%d} and {QuestStage%d} > %d"), i, i, i % 100));
+			break;
+		case 2:
+			Corpus.Add(FString::Printf(TEXT("not {Flag%d} or {Count%d} <= %d"), i, i, i % 100));
+			break;
+		case 3:
+			Corpus.Add(FString::Printf(TEXT("{Name%d} == `SomeName` && {Gender%d} != feminine"), i, i));
+			break;
+		case 4:
+			Corpus.Add(FString::Printf(TEXT("\"Some text %d\" == {Text%d} || %d >= 10"), i, i, i % 100));
+			break;
+		}
+	}
+	return Corpus;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestExpressionLexer,
+								 "SUDSTest.TestExpressionLexer",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestExpressionLexer::RunTest(const FString& Parameters)
+{
+	// The lexer must split expressions into exactly the tokens the regex did
+	TArray<FString> Inputs = MakeExpressionCorpus(500);
+	Inputs.Append({
+		TEXT("5 -3"),
+		TEXT("5-3"),
+		TEXT("{a.b}"),
+		TEXT("{}"),
+		TEXT("{Unterminated"),
+		TEXT("<>"),
+		TEXT("<= >= < > == = != !"),
+		TEXT("sandwich"),
+		TEXT("TRUE True true fALSE"),
+		TEXT("Masculine neuter Feminine"),
+		TEXT("\"unterminated and"),
+		TEXT("`unterminated or"),
+		TEXT("\"\" ``"),
+		TEXT("1."),
+		TEXT("-1.25"),
+		TEXT("a & b | c"),
+		TEXT(""),
+	});
+
+	for (const FString& Input : Inputs)
+	{
+		const TArray<FString> Expected = LegacyTokenise(Input);
+		TArray<FString> Actual;
+		FSUDSExpressionLexer Lexer(Input);
+		ESUDSExpressionItemType Type;
+		FSUDSValue Operand;
+		while (Lexer.Next(Type, Operand))
+		{
+			const FString Token(Lexer.GetTokenText());
+			if (Type != ESUDSExpressionItemType::Operand)
+			{
+				TestTrue(FString::Printf(TEXT("Operator '%s' in '%s'"), *Token, *Input),
+				         FSUDSExpression::ParseOperator(Token) == Type);
+			}
+			Actual.Add(Token);
+		}
+
+		if (TestEqual(FString::Printf(TEXT("Token count for '%s'"), *Input), Actual.Num(), Expected.Num()))
+		{
+			for (int i = 0; i < Expected.Num(); ++i)
+			{
+				TestEqual(FString::Printf(TEXT("Token %d of '%s'"), i, *Input), Actual[i], Expected[i]);
+			}
+		}
+	}
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestExpressionParsingBenchmark,
+								 "SUDSTest.TestExpressionParsingBenchmark",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestExpressionParsingBenchmark::RunTest(const FString& Parameters)
+{
+	const int NumExpressions = 5000;
+	const TArray<FString> Corpus = MakeExpressionCorpus(NumExpressions);
+
+	// Time the same work both ways: splitting into tokens and producing operand values. The rest of ParseFromString
+	// (shunting-yard, byte code) is unchanged so isn't included. Only reported, since timings depend too much on the
+	// machine to assert on
+	int LegacyTokens = 0;
+	const double LegacyStart = FPlatformTime::Seconds();
+	for (auto& Str : Corpus)
+	{
+		LegacyTokens += LegacyTokenise(Str).Num();
+	}
+	const double LegacyTime = FPlatformTime::Seconds() - LegacyStart;
+
+	int LexerTokens = 0;
+	const double LexerStart = FPlatformTime::Seconds();
+	for (auto& Str : Corpus)
+	{
+		FSUDSExpressionLexer Lexer(Str);
+		ESUDSExpressionItemType Type;
+		FSUDSValue Operand;
+		while (Lexer.Next(Type, Operand))
+		{
+			++LexerTokens;
+		}
+	}
+	const double LexerTime = FPlatformTime::Seconds() - LexerStart;
+
+	TestEqual("Same number of tokens", LexerTokens, LegacyTokens);
+	AddInfo(FString::Printf(TEXT("Tokenised %d expressions (%d tokens): lexer %.2fms, regex & operand regexes %.2fms"),
+	                        NumExpressions, LexerTokens, LexerTime * 1000.0, LegacyTime * 1000.0));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestExpressionCookedSerialisation,
+								 "SUDSTest.TestExpressionCookedSerialisation",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestExpressionCookedSerialisation::RunTest(const FString& Parameters)
+{
+	const TArray<FString> Sources = {
+		"",
+		"3",
+		"`SomeName`",
+		"\"Hello\"",
+		"{Six}",
+		"({Six} + 4) * {Ten} - 1",
+		"{Six} / 4.0",
+		"{Six} > 3 and ({Ten} == 10 or {Missing})",
+		"not {IsTrue} || {Six} >= 6",
+		"{Gender} == masculine",
+	};
+
+	TMap<FName, FSUDSValue> Variables;
+	Variables.Add("Six", 6);
+	Variables.Add("Ten", 10);
+	Variables.Add("IsTrue", true);
+	Variables.Add("Gender", ETextGender::Masculine);
+
+	for (auto& Source : Sources)
+	{
+		FSUDSExpression Expr;
+		TestTrue("Parse", Expr.ParseFromString(Source, nullptr));
+
+		// Uncooked archives use tagged properties
+		TArray<uint8> Buffer;
+		FMemoryWriter UncookedWriter(Buffer);
+		TestFalse("Not compact when uncooked", Expr.Serialize(UncookedWriter));
+
+		FMemoryWriter Writer(Buffer);
+		Writer.SetFilterEditorOnly(true);
+		TestTrue("Compact when cooked", Expr.Serialize(Writer));
+
+		FSUDSExpression Loaded;
+		FMemoryReader Reader(Buffer);
+		Reader.SetFilterEditorOnly(true);
+		TestTrue("Compact load", Loaded.Serialize(Reader));
+		TestFalse("Load error", Reader.IsError());
+
+		TestTrue("Queue not loaded", Loaded.GetQueue().IsEmpty());
+		TestEqual("Valid", Loaded.IsValid(), Expr.IsValid());
+		TestEqual("Empty", Loaded.IsEmpty(), Expr.IsEmpty());
+		TestEqual("Literal", Loaded.IsLiteral(), Expr.IsLiteral());
+		TestEqual("Source", Loaded.GetSourceString(), Expr.GetSourceString());
+		TestTrue("Byte code", Loaded.GetByteCode() == Expr.GetByteCode());
+		TestEqual("Variables", Loaded.GetVariableNames().Num(), Expr.GetVariableNames().Num());
+		if (!Expr.IsEmpty())
+		{
+			const FSUDSValue Expected = Expr.Evaluate(Variables);
+			const FSUDSValue Actual = Loaded.Evaluate(Variables);
+			TestEqual(FString::Printf(TEXT("Result of '%s'"), *Source), Actual.ToString(), Expected.ToString());
+		}
+	}
+
+	return true;
+}
+
 
 
 PRAGMA_ENABLE_OPTIMIZATION
\ No newline at end of file
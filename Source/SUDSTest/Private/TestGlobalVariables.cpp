@@ -0,0 +1,139 @@
+﻿#include "SUDSDialogue.h"
+#include "SUDSLibrary.h"
+#include "SUDSMessageLogger.h"
+#include "SUDSScript.h"
+#include "SUDSScriptImporter.h"
+#include "SUDSSubsystem.h"
+#include "TestEventSub.h"
+#include "TestParticipant.h"
+#include "TestUtils.h"
+#include "Misc/AutomationTest.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+PRAGMA_DISABLE_OPTIMIZATION
+
+const FString GlobalVariablesInput = R"RAWSUD(
+===
+[set Mood 1]
+===
+NPC: Your reputation is {global.Reputation}
+[if {global.Reputation} > 10]
+	NPC: You're famous!
+[else]
+	NPC: Never heard of you
+[endif]
+[set global.Reputation {global.Reputation} + 1]
+[set global.MetNPC true]
+NPC: Bye
+)RAWSUD";
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestGlobalVariables,
+								 "SUDSTest.TestGlobalVariables",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestGlobalVariables::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(GlobalVariablesInput), GlobalVariablesInput.Len(), "GlobalVariablesInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	// Globals don't take up slots in dialogues
+	TestEqual("Only local variables have slots", Script->GetVariableSlotCount(), 1);
+	TestEqual("Global slot", Script->GetVariableSlot("global.Reputation"), SUDS_GLOBAL_VARIABLE_SLOT);
+	TestEqual("Unreferenced global slot", Script->GetVariableSlot("global.Other"), SUDS_GLOBAL_VARIABLE_SLOT);
+
+	auto Sys = NewObject<USUDSSubsystem>();
+	auto EvtSub = NewObject<UTestEventSub>();
+	EvtSub->InitGlobal(Sys);
+	// Prefix is optional from code
+	Sys->SetGlobalVariableInt("Reputation", 12);
+	TestTrue("Set with prefix", Sys->IsGlobalVariableSet("global.Reputation"));
+	TestEqual("Change from code", EvtSub->GlobalSetVarRecords.Num(), 1);
+	if (EvtSub->GlobalSetVarRecords.Num() == 1)
+	{
+		TestEqual("Change name", EvtSub->GlobalSetVarRecords[0].Name, FName("global.Reputation"));
+		TestFalse("Change not from a dialogue", EvtSub->GlobalSetVarRecords[0].bFromScript);
+	}
+
+	// Pooled dialogues are owned by the subsystem so use its globals
+	auto Participant = NewObject<UTestParticipant>();
+	auto Dlg = Sys->AcquireDialogueWithParticipants(Script, { Participant });
+	TestDialogueText(this, "Start", Dlg, "NPC", "Your reputation is 12");
+	TestEqual("Read via dialogue", Dlg->GetVariableInt("global.Reputation"), 12);
+
+	// Text reflects changes made elsewhere, even though it's cached
+	Sys->SetGlobalVariableInt("Reputation", 20);
+	TestDialogueText(this, "Changed globally", Dlg, "NPC", "Your reputation is 20");
+	TestTrue("Continue", Dlg->Continue());
+	TestDialogueText(this, "Condition", Dlg, "NPC", "You're famous!");
+	TestTrue("Continue", Dlg->Continue());
+	TestDialogueText(this, "End", Dlg, "NPC", "Bye");
+
+	// Script sets the one canonical copy
+	TestEqual("Set by script", Sys->GetGlobalVariable("Reputation").GetIntValue(), 21);
+	TestTrue("New global set by script", Sys->IsGlobalVariableSet("MetNPC"));
+	TestEqual("Changes from script", EvtSub->GlobalSetVarRecords.Num(), 4);
+	if (EvtSub->GlobalSetVarRecords.Num() == 4)
+	{
+		TestTrue("Change from dialogue", EvtSub->GlobalSetVarRecords[2].bFromScript);
+		TestEqual("Changed value", EvtSub->GlobalSetVarRecords[2].Value.GetIntValue(), 21);
+		TestEqual("Second change name", EvtSub->GlobalSetVarRecords[3].Name, FName("global.MetNPC"));
+	}
+	// Setting the same value again is not a change
+	Sys->SetGlobalVariableInt("Reputation", 21);
+	TestEqual("No change", EvtSub->GlobalSetVarRecords.Num(), 4);
+
+	// Nothing was requested from participants, and globals aren't duplicated in the dialogue
+	TestEqual("No variable requests", Participant->VariableRequestCount, 0);
+	TestFalse("Not in dialogue variables", Dlg->GetVariables().Contains("global.Reputation"));
+	TestFalse("Not in dialogue saved state", Dlg->GetSavedState().GetVariables().Contains("global.Reputation"));
+
+	// Other dialogues see the same values
+	auto Dlg2 = Sys->AcquireDialogue(Script);
+	TestDialogueText(this, "Second dialogue", Dlg2, "NPC", "Your reputation is 21");
+	Dlg2->UnSetVariable("global.MetNPC");
+	TestFalse("Unset from dialogue", Sys->IsGlobalVariableSet("MetNPC"));
+
+	// Save / restore as one block
+	FSUDSGlobalVariablesState State = Sys->GetGlobalVariablesState();
+	TArray<uint8> Buffer;
+	FMemoryWriter Writer(Buffer);
+	Writer << State;
+	Sys->ResetGlobalVariables();
+	TestFalse("Reset", Sys->IsGlobalVariableSet("Reputation"));
+	TestFalse("Reset seen by dialogue", Dlg2->IsVariableSet("global.Reputation"));
+
+	FSUDSGlobalVariablesState Loaded;
+	FMemoryReader Reader(Buffer);
+	Reader << Loaded;
+	Sys->RestoreGlobalVariablesState(Loaded);
+	TestEqual("Restored", Sys->GetGlobalVariable("Reputation").GetIntValue(), 21);
+	TestDialogueText(this, "After restore", Dlg2, "NPC", "Your reputation is 21");
+
+	// Dialogues with no subsystem keep their own copy, supplied the usual way
+	auto Participant2 = NewObject<UTestParticipant>();
+	auto Standalone = USUDSLibrary::CreateDialogueWithParticipants(Script, Script, { Participant2 }, false);
+	Standalone->SetVariableInt("global.Reputation", 3);
+	Standalone->Start();
+	TestDialogueText(this, "Standalone", Standalone, "NPC", "Your reputation is 3");
+	TestTrue("Continue", Standalone->Continue());
+	TestDialogueText(this, "Standalone condition", Standalone, "NPC", "Never heard of you");
+	TestTrue("Standalone requests", Participant2->VariableRequestCount > 0);
+	TestEqual("Subsystem unaffected", Sys->GetGlobalVariable("Reputation").GetIntValue(), 21);
+
+	Sys->ReleaseDialogue(Dlg);
+	Sys->ReleaseDialogue(Dlg2);
+	Script->MarkAsGarbage();
+	return true;
+}
+
+PRAGMA_ENABLE_OPTIMIZATION
@@ -41,6 +41,7 @@ NPC: Yep, sure is
 :goodbye
 NPC: Bye!
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(GotoGosubInput)
 
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestGotoGosub,
 								 "SUDSTest.TestGotoGosub",
@@ -164,6 +165,7 @@ Player: This is level 3
 :goodbye
 NPC: Bye!
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(NestedGosubInput)
 
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestNestedGosub,
 								 "SUDSTest.TestNestedGosub",
@@ -223,6 +225,7 @@ Player: Hello there
 * Option A
 * Option B
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(GotoBetweenSpeakerAndChoiceInput)
 
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestGotoBetweenSpeakerAndChoice1,
 	"SUDSTest.TestGotoBetweenSpeakerAndChoice1",
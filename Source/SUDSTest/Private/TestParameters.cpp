@@ -3,6 +3,7 @@
 #include "SUDSMessageLogger.h"
 #include "SUDSScript.h"
 #include "SUDSScriptImporter.h"
+#include "SUDSScriptNodeText.h"
 #include "TestParticipant.h"
 #include "TestUtils.h"
 #include "Misc/AutomationTest.h"
@@ -19,6 +20,7 @@ Player: Boolean test {BoolVal}?
 	* Is {NumCats} {NumCats}|plural(one=cat,other=cats) too many?
 		NPC: No, {numcats} is fine
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(ParamsInput)
 
 
 
@@ -40,6 +42,12 @@ bool FTestParameters::RunTest(const FString& Parameters)
 	const ScopedStringTableHolder StringTableHolder;
 	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
 
+	// Every parameter should have a variable slot, shared regardless of case
+	TestEqual("Variable slots", Script->GetVariableSlotCount(), 7);
+	TestNotEqual("NumCats slot", Script->GetVariableSlot("NumCats"), INDEX_NONE);
+	TestEqual("NumCats slot case insensitive", Script->GetVariableSlot("numcats"), Script->GetVariableSlot("NumCats"));
+	TestEqual("Unknown slot", Script->GetVariableSlot("SomethingUnknown"), INDEX_NONE);
+
 	// Script shouldn't be the owner of the dialogue but it's the only UObject we've got right now so why not
 	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
 	auto Participant = NewObject<UTestParticipant>();
@@ -121,9 +129,161 @@ bool FTestParametersPriority::RunTest(const FString& Parameters)
 
 	// Check that there's a variable from Participant2 which no-one else set
 	TestEqual("Participant3 should have set something", Dlg->GetVariableInt("SomethingUniqueTo3"), 120);
+	// Not referenced by the script so not in a slot, but should still be visible everywhere
+	TestTrue("Unslotted variable set", Dlg->IsVariableSet("SomethingUniqueTo3"));
+	TestTrue("Unslotted variable in all variables", Dlg->GetVariables().Contains("SomethingUniqueTo3"));
+	TestTrue("Slotted variable in all variables", Dlg->GetVariables().Contains("NumCats"));
 
 	Script->MarkAsGarbage();
 	return true;	
 }
 
+const FString TextCacheInput = R"RAWSUD(
+NPC: You have {NumCats} cats
+	* Adopt another {Pet}
+	* Stop at {NumCats}
+)RAWSUD";
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestResolvedTextCache,
+								 "SUDSTest.TestResolvedTextCache",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestResolvedTextCache::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(TextCacheInput), TextCacheInput.Len(), "TextCacheInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script, false);
+	auto Participant = NewObject<UTestParticipant>();
+	Dlg->AddParticipant(Participant);
+	Dlg->SetVariableInt("NumCats", 3);
+	Dlg->SetVariableName("Pet", "cat");
+	Dlg->Start();
+
+	// Off by default, so every call requests variables
+	TestFalse("Not caching by default", Dlg->IsResolvedTextCaching());
+	Dlg->GetText();
+	Dlg->GetText();
+	TestEqual("Requests without caching", Participant->VariableRequestCount, 2);
+	Participant->VariableRequestCount = 0;
+
+	Dlg->SetResolvedTextCaching(true);
+	TestEqual("Text", Dlg->GetText().ToString(), "You have 3 cats");
+	TestEqual("Variable requested", Participant->VariableRequestCount, 1);
+	TestEqual("Cached text", Dlg->GetText().ToString(), "You have 3 cats");
+	TestEqual("No request when cached", Participant->VariableRequestCount, 1);
+
+	TestEqual("Choice text", Dlg->GetChoiceText(0).ToString(), "Adopt another cat");
+	TestEqual("Choice text", Dlg->GetChoiceText(1).ToString(), "Stop at 3");
+	TestEqual("Choice variables requested", Participant->VariableRequestCount, 3);
+	Dlg->GetChoiceText(0);
+	Dlg->GetChoiceText(1);
+	TestEqual("No request for cached choices", Participant->VariableRequestCount, 3);
+
+	// Changing a variable only invalidates text which uses it
+	Dlg->SetVariableInt("NumCats", 4);
+	TestEqual("Updated text", Dlg->GetText().ToString(), "You have 4 cats");
+	TestEqual("Updated choice text", Dlg->GetChoiceText(1).ToString(), "Stop at 4");
+	TestEqual("Unaffected choice text", Dlg->GetChoiceText(0).ToString(), "Adopt another cat");
+	TestEqual("Requests after change", Participant->VariableRequestCount, 5);
+
+	// Setting to the same value isn't a change
+	Dlg->SetVariableInt("NumCats", 4);
+	Dlg->GetText();
+	TestEqual("No request when value unchanged", Participant->VariableRequestCount, 5);
+
+	// Without caching, every call requests variables again
+	Dlg->SetResolvedTextCaching(false);
+	Dlg->GetText();
+	Dlg->GetText();
+	TestEqual("Requests without caching", Participant->VariableRequestCount, 7);
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
+const FString FormatBenchmarkInput = R"RAWSUD(
+NPC: {Name} has {Seconds} seconds to find {Count} {Item} in {Place}
+)RAWSUD";
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestTextFormatBenchmark,
+								 "SUDSTest.TestTextFormatBenchmark",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestTextFormatBenchmark::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(FormatBenchmarkInput), FormatBenchmarkInput.Len(), "FormatBenchmarkInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script, false);
+	Dlg->SetVariableText("Name", FText::FromString("Bob"));
+	Dlg->SetVariableInt("Count", 3);
+	Dlg->SetVariableText("Item", FText::FromString("keys"));
+	Dlg->SetVariableName("Place", "Cellar");
+	Dlg->SetVariableInt("Seconds", 0);
+	Dlg->Start();
+	TestEqual("Text", Dlg->GetText().ToString(), "Bob has 0 seconds to find 3 keys in Cellar");
+
+	// A countdown ticking inside the line means it has to be reformatted every time
+	const int Iterations = 100000;
+	const double StartTime = FPlatformTime::Seconds();
+	for (int i = 0; i < Iterations; ++i)
+	{
+		Dlg->SetVariableInt("Seconds", i);
+		Dlg->GetText();
+	}
+	const double Elapsed = FPlatformTime::Seconds() - StartTime;
+	TestEqual("Final text", Dlg->GetText().ToString(), FString::Printf(TEXT("Bob has %d seconds to find 3 keys in Cellar"), Iterations - 1));
+
+	// For comparison, build the arguments from scratch each time as we used to
+	const USUDSScriptNodeText* TextNode = nullptr;
+	for (auto Node : Script->GetNodes())
+	{
+		if (!TextNode)
+		{
+			TextNode = Cast<USUDSScriptNodeText>(Node);
+		}
+	}
+	if (TestNotNull("Text node", TextNode))
+	{
+		const TMap<FName, FSUDSValue> Vars = Dlg->GetVariables();
+		const double PrevStartTime = FPlatformTime::Seconds();
+		for (int i = 0; i < Iterations; ++i)
+		{
+			FFormatNamedArguments Args;
+			for (auto& Name : TextNode->GetParameterNames())
+			{
+				Args.Add(Name.ToString(), Vars[Name].ToFormatArg());
+			}
+			FText::Format(TextNode->GetTextFormat(), Args);
+		}
+		const double PrevElapsed = FPlatformTime::Seconds() - PrevStartTime;
+		AddInfo(FString::Printf(TEXT("Reformatting a line with 5 parameters %d times: %.1fms, building arguments each time: %.1fms"),
+		                        Iterations,
+		                        Elapsed * 1000.0,
+		                        PrevElapsed * 1000.0));
+	}
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
 PRAGMA_ENABLE_OPTIMIZATION
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "Misc/AutomationTest.h"
 #include "SUDSScriptImporter.h"
 #include "SUDSScriptNode.h"
+#include "SUDSScriptNodeText.h"
 #include "TestUtils.h"
 
 PRAGMA_DISABLE_OPTIMIZATION
@@ -848,11 +849,36 @@ bool FTestConversionToRuntime::RunTest(const FString& Parameters)
 	GotoNode = Asset->GetNodeByLabel("goodbye");
 	TestTextNode(this, "Goto goodbye", GotoNode, "NPC", "Bye!");
 
+	// Edge indexes used at runtime must lead to the same place as the target nodes
+	for (auto Node : Asset->GetNodes())
+	{
+		for (auto& Edge : Node->GetEdges())
+		{
+			TestTrue("Edge target index", Asset->GetEdgeTargetNode(Edge) == Edge.GetTargetNode().Get());
+		}
+	}
+
 	// Test speakers
 	TestEqual("Num speakers", Asset->GetSpeakers().Num(), 2);
 	TestTrue("Speaker 1", Asset->GetSpeakers().Contains("Player"));
 	TestTrue("Speaker 2", Asset->GetSpeakers().Contains("NPC"));
 
+	// Text nodes should index the speaker table
+	for (auto Node : Asset->GetNodes())
+	{
+		if (auto TextNode = Cast<USUDSScriptNodeText>(Node))
+		{
+			const int SpeakerIndex = TextNode->GetSpeakerIndex();
+			if (TestTrue("Speaker index valid", Asset->GetSpeakers().IsValidIndex(SpeakerIndex)))
+			{
+				TestEqual("Speaker index", Asset->GetSpeakers()[SpeakerIndex], TextNode->GetSpeakerID());
+				TestEqual("Speaker display name key",
+				          Asset->GetSpeakerDisplayNameKey(SpeakerIndex),
+				          FName("SpeakerName." + TextNode->GetSpeakerID()));
+			}
+		}
+	}
+
 	return true;
 }
 
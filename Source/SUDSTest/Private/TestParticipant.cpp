@@ -66,3 +66,8 @@ void UTestParticipant::OnDialogueVariableChanged_Implementation(USUDSDialogue* D
 	SetVarRecords.Add(FSetVarRecord { VariableName, Value, bFromScript });
 }
 
+void UTestParticipant::OnDialogueVariableRequested_Implementation(USUDSDialogue* Dialogue, FName VariableName)
+{
+	++VariableRequestCount;
+}
+
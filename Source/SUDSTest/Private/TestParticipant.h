@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include "CoreMinimal.h"
+#include "SUDSNativeParticipant.h"
 #include "SUDSParticipant.h"
 #include "SUDSValue.h"
 #include "UObject/Object.h"
@@ -16,6 +17,7 @@ class SUDSTEST_API UTestParticipant : public UObject, public ISUDSParticipant
 
 public:
 	int TestNumber = 0;
+	int VariableRequestCount = 0;
 
 	struct FEventRecord
 	{
@@ -42,4 +44,45 @@ public:
 		FName VariableName,
 		const FSUDSValue& Value,
 		bool bFromScript) override;
+	virtual void OnDialogueVariableRequested_Implementation(USUDSDialogue* Dialogue, FName VariableName) override;
+};
+
+/**
+ * Participant using the native interface
+ */
+UCLASS()
+class SUDSTEST_API UTestNativeParticipant : public UObject, public ISUDSNativeParticipant
+{
+	GENERATED_BODY()
+
+public:
+	int Priority = 0;
+	ESUDSParticipantCallback HandledCallbacks = ESUDSParticipantCallback::All;
+
+	int StartingCount = 0;
+	int FinishedCount = 0;
+	int SpeakerLineCount = 0;
+	int ProceedingCount = 0;
+	TArray<UTestParticipant::FEventRecord> EventRecords;
+	TArray<UTestParticipant::FSetVarRecord> SetVarRecords;
+
+	virtual void NativeOnDialogueStarting(USUDSDialogue* Dialogue, FName AtLabel) override { ++StartingCount; }
+	virtual void NativeOnDialogueFinished(USUDSDialogue* Dialogue) override { ++FinishedCount; }
+	virtual void NativeOnDialogueSpeakerLine(USUDSDialogue* Dialogue) override { ++SpeakerLineCount; }
+	virtual void NativeOnDialogueChoiceMade(USUDSDialogue* Dialogue, int ChoiceIndex) override {}
+	virtual void NativeOnDialogueProceeding(USUDSDialogue* Dialogue) override { ++ProceedingCount; }
+	virtual void NativeOnDialogueEvent(USUDSDialogue* Dialogue, FName EventName, const TArray<FSUDSValue>& Arguments) override
+	{
+		EventRecords.Add(UTestParticipant::FEventRecord { EventName, Arguments });
+	}
+	virtual void NativeOnDialogueVariableChanged(USUDSDialogue* Dialogue,
+	                                             FName VariableName,
+	                                             const FSUDSValue& Value,
+	                                             bool bFromScript) override
+	{
+		SetVarRecords.Add(UTestParticipant::FSetVarRecord { VariableName, Value, bFromScript });
+	}
+	virtual void NativeOnDialogueVariableRequested(USUDSDialogue* Dialogue, FName VariableName) override {}
+	virtual int GetNativeDialogueParticipantPriority() const override { return Priority; }
+	virtual ESUDSParticipantCallback GetHandledDialogueCallbacks() const override { return HandledCallbacks; }
 };
@@ -3,6 +3,7 @@
 #include "SUDSMessageLogger.h"
 #include "SUDSScript.h"
 #include "SUDSScriptImporter.h"
+#include "TestParticipant.h"
 #include "TestUtils.h"
 #include "Misc/AutomationTest.h"
 
@@ -44,6 +45,7 @@ NPC: Yep, sure is
 :goodbye
 NPC: Bye!
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(SimpleRunnerInput)
 
 const FString SetVariableRunnerInput = R"RAWSUD(
 ===
@@ -77,6 +79,7 @@ NPC: Wotcha
 Player: Well
 	
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(SetVariableRunnerInput)
 
 const FString FallthroughEdgeCaseInput = R"RAWSUD(
 NPC: First line
@@ -94,6 +97,7 @@ NPC: First line
   * Fallthrough 2
 	NPC: text 2
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(FallthroughEdgeCaseInput)
 
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestSimpleRunning,
 								 "SUDSTest.TestSimpleRunning",
@@ -426,6 +430,7 @@ NPC: Here's some choices
   * Option 2
 	NPC: This is option 2
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(LinesBetweenTextAndChoiceInput)
 
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestLinesBetweenTextAndChoice,
 								 "SUDSTest.TestLinesBetweenTextAndChoiceInput",
@@ -458,4 +463,85 @@ bool FTestLinesBetweenTextAndChoice::RunTest(const FString& Parameters)
 	return true;
 }
 
+const FString NonLiteralHeaderInput = R"RAWSUD(
+===
+[set Mood 1]
+[set DoubleMood {Mood} * 2]
+===
+NPC: Hello
+)RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(NonLiteralHeaderInput)
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestLiteralHeader,
+								 "SUDSTest.TestLiteralHeader",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+bool FTestLiteralHeader::RunTest(const FString& Parameters)
+{
+	const ScopedStringTableHolder StringTableHolder;
+	auto ImportScript = [this, &StringTableHolder](const FString& Input, const FName& Name)
+	{
+		FSUDSMessageLogger Logger(false);
+		FSUDSScriptImporter Importer;
+		TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(Input), Input.Len(), Name.ToString(), &Logger, true));
+		auto Script = NewObject<USUDSScript>(GetTransientPackage(), Name);
+		Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+		return Script;
+	};
+
+	auto Script = ImportScript(SpeakerNamesInput, "LiteralHeader");
+	auto NonLiteralScript = ImportScript(NonLiteralHeaderInput, "NonLiteralHeader");
+
+	TestTrue("Literal header detected", Script->HasLiteralHeader());
+	TestEqual("Literal header sets", Script->GetLiteralHeaderSets().Num(), 2);
+	const int PlayerSlot = Script->GetVariableSlot("SpeakerName.Player");
+	if (TestTrue("Default slot", Script->GetHeaderDefaultSlots()->IsValidIndex(PlayerSlot)))
+	{
+		TestEqual("Default value", (*Script->GetHeaderDefaultSlots())[PlayerSlot].GetTextValue().ToString(), "Protagonist");
+	}
+	TestFalse("Header referencing variables isn't literal", NonLiteralScript->HasLiteralHeader());
+
+	// No listeners, so the defaults are just copied
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+	TestEqual("Copied player name", Dlg->GetVariableText("SpeakerName.Player").ToString(), "Protagonist");
+	TestEqual("Copied NPC name", Dlg->GetVariableText("SpeakerName.NPC").ToString(), "Just Some Guy");
+	TestDialogueText(this, "Line 1", Dlg, "Player", "Hello there");
+
+	// Participants still hear about header variables being set
+	auto Participant = NewObject<UTestParticipant>();
+	Participant->TestNumber = 0;
+	auto ListenedDlg = USUDSLibrary::CreateDialogueWithParticipant(Script, Script, Participant, false);
+	if (TestEqual("Header var changes raised", Participant->SetVarRecords.Num(), 2))
+	{
+		TestEqual("Header var name", Participant->SetVarRecords[0].Name, FName("SpeakerName.Player"));
+		TestTrue("Header var from script", Participant->SetVarRecords[0].bFromScript);
+	}
+	TestEqual("Listened player name", ListenedDlg->GetVariableText("SpeakerName.Player").ToString(), "Protagonist");
+
+	// Re-running the header resets variables it sets, and only raises changes for those which were different
+	ListenedDlg->SetVariableText("SpeakerName.NPC", FText::FromString("Someone Else"));
+	Participant->SetVarRecords.Empty();
+	ListenedDlg->Restart(false);
+	TestEqual("Header re-run", ListenedDlg->GetVariableText("SpeakerName.NPC").ToString(), "Just Some Guy");
+	int HeaderChanges = 0;
+	for (auto& Rec : Participant->SetVarRecords)
+	{
+		if (Rec.bFromScript && Rec.Name.ToString().StartsWith("SpeakerName."))
+		{
+			++HeaderChanges;
+		}
+	}
+	TestEqual("Only changed header var raised", HeaderChanges, 1);
+
+	// Headers which aren't literal still run
+	auto NonLiteralDlg = USUDSLibrary::CreateDialogue(NonLiteralScript, NonLiteralScript);
+	TestEqual("Calculated header var", NonLiteralDlg->GetVariableInt("DoubleMood"), 2);
+
+	Script->MarkAsGarbage();
+	NonLiteralScript->MarkAsGarbage();
+	return true;
+}
+
 PRAGMA_ENABLE_OPTIMIZATION
\ No newline at end of file
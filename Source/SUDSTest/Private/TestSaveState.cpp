@@ -5,6 +5,8 @@
 #include "SUDSScriptImporter.h"
 #include "TestUtils.h"
 #include "Misc/AutomationTest.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
 
 PRAGMA_DISABLE_OPTIMIZATION
 
@@ -75,6 +77,7 @@ Player: This is some fallthrough text
 :goodbye
 NPC: Bye
 )RAWSUD";
+SUDS_REGISTER_TEST_FIXTURE(SaveStateInput)
 
 
 IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestSaveState,
@@ -143,4 +146,244 @@ bool FTestSaveState::RunTest(const FString& Parameters)
 	return true;
 }
 
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestSaveStateManyRestores,
+								 "SUDSTest.TestSaveStateManyRestores",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestSaveStateManyRestores::RunTest(const FString& Parameters)
+{
+	// Large script, with a gosub so that the return stack is saved too
+	const int NumLines = 2000;
+	FString Input = "[gosub sub]\n";
+	for (int i = 0; i < NumLines; ++i)
+	{
+		Input.Appendf(TEXT("NPC: Line %d\n"), i);
+	}
+	Input.Append("[goto end]\n:sub\nNPC: In the sub\n[return]\n:end\nNPC: Bye\n");
+
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(Input), Input.Len(), "ManyRestoresInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+	Dlg->Start();
+	TestDialogueText(this, "Text node", Dlg, "NPC", "In the sub");
+	const auto SubState = Dlg->GetSavedState();
+	if (!TestEqual("Return stack", SubState.GetReturnStack().Num(), 1))
+		return true;
+	TestNotNull("Gosub lookup", Script->GetNodeByGosubID(SubState.GetReturnStack()[0]));
+
+	Dlg->Continue();
+	for (int i = 0; i < NumLines - 1; ++i)
+	{
+		Dlg->Continue();
+	}
+	TestDialogueText(this, "Text node", Dlg, "NPC", FString::Printf(TEXT("Line %d"), NumLines - 1));
+	const auto LastLineState = Dlg->GetSavedState();
+
+	// Restore a lot of dialogues from these states, as when loading a save with many NPCs
+	const int NumRestores = 2000;
+	const double Start = FPlatformTime::Seconds();
+	for (int i = 0; i < NumRestores; ++i)
+	{
+		auto Dlg2 = USUDSLibrary::CreateDialogue(Script, Script);
+		if (i % 2)
+		{
+			Dlg2->RestoreSavedState(SubState);
+			TestEqual("Restored text", Dlg2->GetText().ToString(), "In the sub");
+			// Returning from the gosub relies on the gosub node having been found
+			Dlg2->Continue();
+			TestEqual("After return", Dlg2->GetText().ToString(), "Line 0");
+		}
+		else
+		{
+			Dlg2->RestoreSavedState(LastLineState);
+			TestEqual("Restored text", Dlg2->GetText().ToString(), FString::Printf(TEXT("Line %d"), NumLines - 1));
+		}
+	}
+	AddInfo(FString::Printf(TEXT("Restored %d dialogues in %.2fms"), NumRestores, (FPlatformTime::Seconds() - Start) * 1000.0));
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
+const FString VisitedInput = R"RAWSUD(
+:start
+NPC: Hello @1@
+    * Weather @2@
+        NPC: Sunny @3@
+        [goto start]
+    * Leave @4@
+NPC: Bye @5@
+)RAWSUD";
+
+// Same IDs, with a line & choice added
+const FString VisitedEditedInput = R"RAWSUD(
+NPC: Welcome @10@
+:start
+NPC: Hello @1@
+    * Shop @11@
+        NPC: Closed @12@
+    * Weather @2@
+        NPC: Sunny @3@
+        [goto start]
+    * Leave @4@
+NPC: Bye @5@
+)RAWSUD";
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestSaveStateVisited,
+								 "SUDSTest.TestSaveStateVisited",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestSaveStateVisited::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(VisitedInput), VisitedInput.Len(), "VisitedInput", &Logger, true));
+	FSUDSScriptImporter EditedImporter;
+	TestTrue("Import should succeed", EditedImporter.ImportFromBuffer(GetData(VisitedEditedInput), VisitedEditedInput.Len(), "VisitedEditedInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	auto EditedScript = NewObject<USUDSScript>(GetTransientPackage(), "TestEdited");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+	EditedImporter.PopulateAsset(EditedScript, StringTableHolder.StringTable);
+
+	// Every speaker line & choice has an ordinal
+	TestEqual("Line ordinals", Script->GetLineOrdinalCount(), 3);
+	TestEqual("Choice ordinals", Script->GetChoiceOrdinalCount(), 2);
+	TestTrue("Layouts differ", Script->GetOrdinalLayoutHash() != EditedScript->GetOrdinalLayoutHash());
+	const FString HelloID = Script->GetLineTextID(0);
+	const FString SunnyID = Script->GetLineTextID(1);
+	const FString ByeID = Script->GetLineTextID(2);
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+	Dlg->Start();
+	TestDialogueText(this, "Start", Dlg, "NPC", "Hello");
+	TestTrue("Current line seen", Dlg->HasSpeakerLineBeenSeen(HelloID));
+	TestFalse("Not seen before", Dlg->HasCurrentSpeakerLineBeenSeenBefore());
+	TestFalse("Other line not seen", Dlg->HasSpeakerLineBeenSeen(SunnyID));
+	TestFalse("Choice not taken", Dlg->HasChoiceIndexBeenTakenPreviously(0));
+	TestTrue("Choose", Dlg->Choose(0));
+	TestDialogueText(this, "Weather", Dlg, "NPC", "Sunny");
+	TestTrue("Continue", Dlg->Continue());
+	TestDialogueText(this, "Back to start", Dlg, "NPC", "Hello");
+	TestTrue("Seen before", Dlg->HasCurrentSpeakerLineBeenSeenBefore());
+	TestTrue("Choice taken", Dlg->HasChoiceIndexBeenTakenPreviously(0));
+	TestFalse("Other choice not taken", Dlg->HasChoiceIndexBeenTakenPreviously(1));
+
+	// Saved as bits, with text IDs alongside
+	FSUDSDialogueState State = Dlg->GetSavedState();
+	if (TestEqual("Choice bits", State.GetChoicesTakenBits().Num(), 1) &&
+		TestEqual("Line bits", State.GetLinesSeenBits().Num(), 1))
+	{
+		TestTrue("Choice bits value", State.GetChoicesTakenBits()[0] == 1u);
+		TestTrue("Line bits value", State.GetLinesSeenBits()[0] == 3u);
+	}
+	TestEqual("Choice IDs", State.GetChoicesTaken().Num(), 1);
+	TestEqual("Line IDs", State.GetLinesSeen().Num(), 2);
+
+	TArray<uint8> Buffer;
+	FMemoryWriter Writer(Buffer);
+	Writer << State;
+	FSUDSDialogueState Loaded;
+	FMemoryReader Reader(Buffer);
+	Reader.SetCustomVersions(Writer.GetCustomVersions());
+	Reader << Loaded;
+	TestTrue("Serialised layout", Loaded.GetOrdinalLayoutHash() == Script->GetOrdinalLayoutHash());
+
+	// Same script, restored from the bits
+	auto Dlg2 = USUDSLibrary::CreateDialogue(Script, Script);
+	Dlg2->RestoreSavedState(Loaded);
+	TestTrue("Restored seen before", Dlg2->HasCurrentSpeakerLineBeenSeenBefore());
+	TestTrue("Restored line seen", Dlg2->HasSpeakerLineBeenSeen(SunnyID));
+	TestFalse("Restored line not seen", Dlg2->HasSpeakerLineBeenSeen(ByeID));
+	TestTrue("Restored choice taken", Dlg2->HasChoiceIndexBeenTakenPreviously(0));
+	TestFalse("Restored choice not taken", Dlg2->HasChoiceIndexBeenTakenPreviously(1));
+
+	// Edited script, restored by text ID
+	auto Dlg3 = USUDSLibrary::CreateDialogue(EditedScript, EditedScript);
+	Dlg3->RestoreSavedState(Loaded);
+	TestDialogueText(this, "Migrated position", Dlg3, "NPC", "Hello");
+	TestTrue("Migrated seen before", Dlg3->HasCurrentSpeakerLineBeenSeenBefore());
+	TestTrue("Migrated line seen", Dlg3->HasSpeakerLineBeenSeen(SunnyID));
+	TestFalse("New line not seen", Dlg3->HasSpeakerLineBeenSeen(EditedScript->GetLineTextID(0)));
+	TestFalse("New choice not taken", Dlg3->HasChoiceIndexBeenTakenPreviously(0));
+	TestTrue("Migrated choice taken", Dlg3->HasChoiceIndexBeenTakenPreviously(1));
+	TestFalse("Migrated choice not taken", Dlg3->HasChoiceIndexBeenTakenPreviously(2));
+
+	// Resetting forgets it all
+	Dlg3->ResetState(false, false, true);
+	TestFalse("Reset line", Dlg3->HasSpeakerLineBeenSeen(SunnyID));
+	TestFalse("Reset choice", Dlg3->HasChoiceIndexBeenTakenPreviously(1));
+
+	Script->MarkAsGarbage();
+	EditedScript->MarkAsGarbage();
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestSaveStateOldFormat,
+								 "SUDSTest.TestSaveStateOldFormat",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestSaveStateOldFormat::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(VisitedInput), VisitedInput.Len(), "VisitedInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	// Written the way state was before it had a custom version: no lines seen, choices by text ID only
+	FString TextNodeID = Script->GetLineTextID(0);
+	TMap<FName, FSUDSValue> Variables;
+	Variables.Add("x", FSUDSValue(3));
+	TArray<FString> ChoicesTaken { Script->GetChoiceTextID(0) };
+	TArray<FString> ReturnStack;
+	TArray<uint8> Buffer;
+	FMemoryWriter Writer(Buffer);
+	Writer << TextNodeID;
+	Writer << Variables;
+	Writer << ChoicesTaken;
+	Writer << ReturnStack;
+
+	FSUDSDialogueState Loaded;
+	FMemoryReader Reader(Buffer);
+	Reader << Loaded;
+	TestFalse("Read without error", Reader.IsError());
+	TestTrue("Read whole blob", Reader.AtEnd());
+	TestEqual("Text node", Loaded.GetTextNodeID(), TextNodeID);
+	TestEqual("Choice IDs", Loaded.GetChoicesTaken().Num(), 1);
+	TestEqual("No line IDs", Loaded.GetLinesSeen().Num(), 0);
+	TestTrue("No layout", Loaded.GetOrdinalLayoutHash() == 0u);
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+	Dlg->RestoreSavedState(Loaded);
+	TestDialogueText(this, "Restored position", Dlg, "NPC", "Hello");
+	TestEqual("Restored variable", Dlg->GetVariableInt("x"), 3);
+	TestTrue("Restored choice taken", Dlg->HasChoiceIndexBeenTakenPreviously(0));
+	TestFalse("Restored choice not taken", Dlg->HasChoiceIndexBeenTakenPreviously(1));
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
 PRAGMA_ENABLE_OPTIMIZATION
\ No newline at end of file
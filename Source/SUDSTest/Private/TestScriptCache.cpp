@@ -0,0 +1,149 @@
+﻿#include "SUDSDialogue.h"
+#include "SUDSLibrary.h"
+#include "SUDSMessageLogger.h"
+#include "SUDSScript.h"
+#include "SUDSScriptImporter.h"
+#include "SUDSSubsystem.h"
+#include "TestUtils.h"
+#include "Misc/AutomationTest.h"
+
+PRAGMA_DISABLE_OPTIMIZATION
+
+const FString ScriptCacheInput = R"RAWSUD(
+NPC: Hello
+	* Hi
+		Player: Hi there
+NPC: Bye
+)RAWSUD";
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestScriptCache,
+								 "SUDSTest.TestScriptCache",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestScriptCache::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(ScriptCacheInput), ScriptCacheInput.Len(), "ScriptCacheInput", &Logger, true));
+
+	// Scripts which are already loaded resolve immediately, so we can test residency without real assets
+	const ScopedStringTableHolder StringTableHolder;
+	TArray<TSoftObjectPtr<USUDSScript>> Scripts;
+	for (int i = 0; i < 3; ++i)
+	{
+		auto Script = NewObject<USUDSScript>(GetTransientPackage(), *FString::Printf(TEXT("CacheTest%d"), i));
+		Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+		Scripts.Add(Script);
+	}
+
+	auto Sys = NewObject<USUDSSubsystem>();
+	for (auto& Script : Scripts)
+	{
+		USUDSScript* Loaded = nullptr;
+		Sys->RequestScriptAsyncWithCallback(Script, [&Loaded](USUDSScript* S) { Loaded = S; });
+		TestTrue("Loaded script", Loaded == Script.Get());
+		TestTrue("Resident", Sys->IsScriptResident(Script));
+	}
+	TestTrue("Cache memory", Sys->GetScriptCacheMemory() > 0);
+
+	// Requested scripts are never evicted
+	Sys->SetScriptCacheBudget(0);
+	for (auto& Script : Scripts)
+	{
+		TestTrue("Still resident while requested", Sys->IsScriptResident(Script));
+	}
+
+	// Requested scripts don't count towards the budget either; the scripts are the same size so one released script
+	// fits in half of the memory of all three
+	Sys->SetScriptCacheBudget(MAX_int64);
+	Sys->ReleaseScript(Scripts[2]);
+	Sys->SetScriptCacheBudget(Sys->GetScriptCacheMemory() / 2);
+	TestTrue("Released script within budget kept", Sys->IsScriptResident(Scripts[2]));
+	Sys->RequestScriptAsyncWithCallback(Scripts[2], [](USUDSScript*) {});
+
+	// Release all, then use script 0 again so that script 1 is least recently used
+	Sys->SetScriptCacheBudget(MAX_int64);
+	for (auto& Script : Scripts)
+	{
+		Sys->ReleaseScript(Script);
+	}
+	Sys->RequestScriptAsyncWithCallback(Scripts[0], [](USUDSScript*) {});
+	Sys->ReleaseScript(Scripts[0]);
+	TestTrue("Resident within budget", Sys->IsScriptResident(Scripts[1]));
+
+	Sys->SetScriptCacheBudget(Sys->GetScriptCacheMemory() - 1);
+	TestTrue("Most recent kept", Sys->IsScriptResident(Scripts[0]));
+	TestFalse("Least recent evicted", Sys->IsScriptResident(Scripts[1]));
+	TestTrue("Next least recent kept", Sys->IsScriptResident(Scripts[2]));
+
+	// Requests for loaded scripts complete straight away, so a dialogue can be created in the callback as CreateDialogueAsync does
+	USUDSDialogue* Dlg = nullptr;
+	Sys->RequestScriptAsyncWithCallback(Scripts[2], [&Dlg, Sys, &Scripts](USUDSScript* S)
+	{
+		Dlg = USUDSLibrary::CreateDialogue(Sys, S, true);
+		Sys->ReleaseScript(Scripts[2]);
+	});
+	if (TestNotNull("Dialogue created", Dlg))
+	{
+		TestDialogueText(this, "Text node", Dlg, "NPC", "Hello");
+	}
+
+	Sys->SetScriptCacheBudget(0);
+	TestEqual("All evicted", Sys->GetScriptCacheMemory(), (int64)0);
+
+	for (auto& Script : Scripts)
+	{
+		if (Script.Get())
+		{
+			Script->MarkAsGarbage();
+		}
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestScriptCachePooledEviction,
+								 "SUDSTest.TestScriptCachePooledEviction",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestScriptCachePooledEviction::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(ScriptCacheInput), ScriptCacheInput.Len(), "ScriptCacheInput", &Logger, true));
+
+	const ScopedStringTableHolder StringTableHolder;
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "PooledCacheTest");
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+	const TSoftObjectPtr<USUDSScript> SoftScript(Script);
+
+	auto Sys = NewObject<USUDSSubsystem>();
+	Sys->RequestScriptAsyncWithCallback(SoftScript, [](USUDSScript*) {});
+
+	// Pool a dialogue for the script, then stop requesting it
+	USUDSDialogue* Dlg = Sys->AcquireDialogue(Script);
+	if (TestNotNull("Dialogue acquired", Dlg))
+	{
+		TestDialogueText(this, "Text node", Dlg, "NPC", "Hello");
+		Sys->ReleaseDialogue(Dlg);
+	}
+	TestEqual("Dialogue pooled", Sys->GetNumPooledDialogues(), 1);
+	Sys->ReleaseScript(SoftScript);
+
+	// The pool must not keep the script in the cache or alive after it's evicted
+	Sys->SetScriptCacheBudget(0);
+	TestFalse("Pooled script evicted", Sys->IsScriptResident(SoftScript));
+	TestEqual("Pool for evicted script emptied", Sys->GetNumPooledDialogues(), 0);
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
+PRAGMA_ENABLE_OPTIMIZATION
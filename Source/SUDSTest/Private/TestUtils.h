@@ -266,3 +266,21 @@ public:
 	}
 	
 };
+
+// Script fixtures registered for tests which run every fixture, such as the cooked expression parity test
+struct FSUDSTestFixtures
+{
+	static TArray<TPair<FString, const FString*>>& Get()
+	{
+		static TArray<TPair<FString, const FString*>> Fixtures;
+		return Fixtures;
+	}
+
+	FSUDSTestFixtures(const TCHAR* Name, const FString& Input)
+	{
+		Get().Add(TPair<FString, const FString*>(Name, &Input));
+	}
+};
+
+// Register a fixture defined earlier in the same file, so it's initialised first
+#define SUDS_REGISTER_TEST_FIXTURE(Input) static FSUDSTestFixtures Register##Input(TEXT(#Input), Input);
@@ -0,0 +1,244 @@
+﻿#include "SUDSDialogue.h"
+#include "SUDSLibrary.h"
+#include "SUDSMessageLogger.h"
+#include "SUDSScript.h"
+#include "SUDSScriptImporter.h"
+#include "TestUtils.h"
+#include "Misc/AutomationTest.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+PRAGMA_DISABLE_OPTIMIZATION
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestValueSerialisation,
+								 "SUDSTest.TestValueSerialisation",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestValueSerialisation::RunTest(const FString& Parameters)
+{
+	TArray<FSUDSValue> Values;
+	Values.Add(FSUDSValue(42));
+	Values.Add(FSUDSValue(-3.5f));
+	Values.Add(FSUDSValue(true));
+	Values.Add(FSUDSValue(ETextGender::Feminine));
+	Values.Add(FSUDSValue(FText::FromString("Hello")));
+	Values.Add(FSUDSValue(FName("SomeName"), false));
+	Values.Add(FSUDSValue(FName("SomeVar"), true));
+	Values.Add(FSUDSValue());
+
+	TArray<uint8> Buffer;
+	FMemoryWriter Writer(Buffer);
+	Writer << Values;
+
+	TArray<FSUDSValue> Loaded;
+	// Pre-populate with text so that loading over an existing value is covered
+	Loaded.Init(FSUDSValue(FText::FromString("Overwritten")), 2);
+	FMemoryReader Reader(Buffer);
+	Reader << Loaded;
+
+	if (TestEqual("Num values", Loaded.Num(), Values.Num()))
+	{
+		TestEqual("Int", Loaded[0].GetIntValue(), 42);
+		TestEqual("Float", Loaded[1].GetFloatValue(), -3.5f);
+		TestTrue("Boolean", Loaded[2].GetBooleanValue());
+		TestEqual("Gender", Loaded[3].GetGenderValue(), ETextGender::Feminine);
+		TestEqual("Text", Loaded[4].GetTextValue().ToString(), "Hello");
+		TestEqual("Name", Loaded[5].GetNameValue(), FName("SomeName"));
+		TestEqual("Variable", Loaded[6].GetVariableNameValue(), FName("SomeVar"));
+		TestTrue("Empty", Loaded[7].IsEmpty());
+		for (int i = 0; i < Values.Num(); ++i)
+		{
+			TestEqual("Type", Loaded[i].GetType(), Values[i].GetType());
+		}
+	}
+
+	// Text is shared between copies, make sure copies are independent when reassigned
+	FSUDSValue Original(FText::FromString("Original"));
+	FSUDSValue Copy = Original;
+	TestEqual("Copied text", Copy.GetTextValue().ToString(), "Original");
+	Copy = FSUDSValue(7);
+	TestEqual("Original text retained", Original.GetTextValue().ToString(), "Original");
+	FSUDSValue Moved = MoveTemp(Original);
+	TestEqual("Moved text", Moved.GetTextValue().ToString(), "Original");
+	Copy = Moved;
+	Moved = FSUDSValue(FName("Other"), false);
+	TestEqual("Text survives reassignment of source", Copy.GetTextValue().ToString(), "Original");
+	TestEqual("Name after text", Moved.GetNameValue(), FName("Other"));
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestValueMemory,
+								 "SUDSTest.TestValueMemory",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestValueMemory::RunTest(const FString& Parameters)
+{
+	// Same members as FSUDSValue had before it was made compact
+	struct FPreviousValueLayout
+	{
+		ESUDSValueType Type;
+		union
+		{
+			int32 IntValue;
+			float FloatValue;
+		};
+		TOptional<FText> TextValue;
+		TOptional<FName> Name;
+	};
+
+	TestEqual("Value size", (int)sizeof(FSUDSValue), 16);
+
+	// Script with lots of variables of mixed types
+	const int NumVars = 1000;
+	FString Input = "===\n";
+	for (int i = 0; i < NumVars; ++i)
+	{
+		switch (i % 4)
+		{
+		default:
+		case 0:
+			Input.Appendf(TEXT("[set IntVar%d = %d]\n"), i, i);
+			break;
+		case 1:
+			Input.Appendf(TEXT("[set FloatVar%d = %d.5]\n"), i, i);
+			break;
+		case 2:
+			Input.Appendf(TEXT("[set BoolVar%d = true]\n"), i);
+			break;
+		case 3:
+			Input.Appendf(TEXT("[set NameVar%d = `Name%d`]\n"), i, i);
+			break;
+		}
+	}
+	Input.Append("===\nNPC: Hello\n");
+
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(Input), Input.Len(), "ValueMemoryInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+	const TMap<FName, FSUDSValue> Vars = Dlg->GetVariables();
+	TestEqual("Num variables", Vars.Num(), NumVars);
+	TestEqual("Variable value", Dlg->GetVariableInt("IntVar500"), 500);
+
+	const SIZE_T CurrentBytes = Vars.Num() * sizeof(FSUDSValue);
+	const SIZE_T PreviousBytes = Vars.Num() * sizeof(FPreviousValueLayout);
+	AddInfo(FString::Printf(TEXT("%d variable values: %llu bytes, previously %llu bytes (%d vs %d bytes each)"),
+	                        Vars.Num(),
+	                        (uint64)CurrentBytes,
+	                        (uint64)PreviousBytes,
+	                        (int)sizeof(FSUDSValue),
+	                        (int)sizeof(FPreviousValueLayout)));
+	TestTrue("Values should be smaller", CurrentBytes < PreviousBytes);
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestSharedVariableState,
+								 "SUDSTest.TestSharedVariableState",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestSharedVariableState::RunTest(const FString& Parameters)
+{
+	// Ambient script with a lot of defaults, of which each instance only changes one or two
+	const int NumVars = 32;
+	FString Input = "===\n";
+	for (int i = 0; i < NumVars; ++i)
+	{
+		Input.Appendf(TEXT("[set Var%d = %d]\n"), i, i);
+	}
+	Input.Append("===\nNPC: Hello\n[set Var0 = {Var0} + 100]\nNPC: Bye\n");
+
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(Input), Input.Len(), "SharedVariableInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+	TestTrue("Literal header", Script->HasLiteralHeader());
+
+	const int NumInstances = 10000;
+	TArray<USUDSDialogue*> Dialogues;
+	Dialogues.Reserve(NumInstances);
+	SIZE_T StartBytes = 0;
+	SIZE_T ChangedBytes = 0;
+	for (int i = 0; i < NumInstances; ++i)
+	{
+		auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+		StartBytes += Dlg->GetVariablesAllocatedSize();
+		Dlg->SetVariableInt(FName(FString::Printf(TEXT("Var%d"), i % NumVars)), -i);
+		Dlg->Continue();
+		ChangedBytes += Dlg->GetVariablesAllocatedSize();
+		Dialogues.Add(Dlg);
+	}
+
+	// Instances see the shared defaults merged with their own changes, without affecting each other
+	bool bAllCorrect = true;
+	for (int i = 0; i < NumInstances && bAllCorrect; ++i)
+	{
+		const int Changed = i % NumVars;
+		const int Expected0 = Changed == 0 ? -i + 100 : 100;
+		bAllCorrect = Dialogues[i]->GetVariableInt("Var0") == Expected0 &&
+			Dialogues[i]->GetVariableInt(FName(FString::Printf(TEXT("Var%d"), Changed))) == (Changed == 0 ? Expected0 : -i) &&
+			Dialogues[i]->GetVariableInt(FName(FString::Printf(TEXT("Var%d"), (Changed + 1) % NumVars))) == ((Changed + 1) % NumVars == 0 ? 100 : (Changed + 1) % NumVars);
+		if (!bAllCorrect)
+		{
+			AddError(FString::Printf(TEXT("Incorrect variables in instance %d"), i));
+		}
+	}
+	TestEqual("Merged view", Dialogues[5]->GetVariables().Num(), NumVars);
+	TestEqual("Saved state", Dialogues[5]->GetSavedState().GetVariables().Num(), NumVars);
+	TestEqual("Script defaults untouched", (*Script->GetHeaderDefaultSlots())[5].GetIntValue(), 5);
+
+	// A dialogue which changes everything gets its own copy, and still works
+	auto Busy = Dialogues[0];
+	for (int i = 0; i < NumVars; ++i)
+	{
+		Busy->SetVariableInt(FName(FString::Printf(TEXT("Var%d"), i)), i * 2);
+	}
+	TestEqual("Busy var", Busy->GetVariableInt("Var31"), 62);
+	TestEqual("Other instance unaffected", Dialogues[1]->GetVariableInt("Var31"), 31);
+	const SIZE_T FlatBytes = Busy->GetVariablesAllocatedSize();
+
+	// Restoring saved state only takes copies of values which differ from the defaults
+	auto Restored = USUDSLibrary::CreateDialogue(Script, Script, false);
+	Restored->RestoreSavedState(Dialogues[3]->GetSavedState());
+	TestEqual("Restored var", Restored->GetVariableInt("Var3"), -3);
+	TestEqual("Restored default", Restored->GetVariableInt("Var4"), 4);
+	TestTrue("Restored state is small", Restored->GetVariablesAllocatedSize() < FlatBytes);
+
+	const SIZE_T UnsharedBytes = NumVars * sizeof(FSUDSValue) + NumVars * sizeof(uint32);
+	AddInfo(FString::Printf(TEXT("%d instances of %d variables: %.1f bytes each initially, %.1f bytes after changes, %llu bytes with a full copy (%llu previously)"),
+	                        NumInstances,
+	                        NumVars,
+	                        (double)StartBytes / NumInstances,
+	                        (double)ChangedBytes / NumInstances,
+	                        (uint64)FlatBytes,
+	                        (uint64)UnsharedBytes));
+	TestTrue("Nothing allocated until changed", StartBytes == 0);
+	TestTrue("Changed instances are smaller than a full copy", ChangedBytes / NumInstances < UnsharedBytes);
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
+PRAGMA_ENABLE_OPTIMIZATION
@@ -0,0 +1,137 @@
+﻿#include "SUDSDialogue.h"
+#include "SUDSLibrary.h"
+#include "SUDSMessageLogger.h"
+#include "SUDSScript.h"
+#include "SUDSScriptImporter.h"
+#include "SUDSScriptNodeText.h"
+#include "TestUtils.h"
+#include "Misc/AutomationTest.h"
+#include "Sound/DialogueVoice.h"
+#include "Sound/DialogueWave.h"
+
+PRAGMA_DISABLE_OPTIMIZATION
+
+const FString VoicePrefetchInput = R"RAWSUD(
+NPC: Hello
+	* Choice A
+		NPC: Line A
+	* Choice B
+		NPC: Line B
+NPC: The end
+)RAWSUD";
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestVoicePrefetch,
+								 "SUDSTest.TestVoicePrefetch",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestVoicePrefetch::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(VoicePrefetchInput), VoicePrefetchInput.Len(), "VoicePrefetchInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	// Give every line a wave; these are already in memory so prefetches complete immediately
+	for (auto Node : Script->GetNodes())
+	{
+		if (auto TextNode = Cast<USUDSScriptNodeText>(Node))
+		{
+			TextNode->SetWave(NewObject<UDialogueWave>(GetTransientPackage()));
+		}
+	}
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script, false);
+	Dlg->SetVoicePrefetchDepth(1);
+	Dlg->Start();
+
+	TestDialogueText(this, "Start", Dlg, "NPC", "Hello");
+	TestEqual("First line not prefetched", Dlg->GetVoicePrefetchStats().Misses, 1);
+	TestEqual("No hits yet", Dlg->GetVoicePrefetchStats().Hits, 0);
+
+	// Changing depth only requests more lines, it doesn't count the current one again
+	Dlg->SetVoicePrefetchDepth(2);
+	TestEqual("Depth change not counted as a miss", Dlg->GetVoicePrefetchStats().Misses, 1);
+	TestEqual("Depth change not counted as waste", Dlg->GetVoicePrefetchStats().Wasted, 0);
+
+	TestTrue("Choose", Dlg->Choose(0));
+	TestDialogueText(this, "Choice A", Dlg, "NPC", "Line A");
+	TestEqual("Line A prefetched", Dlg->GetVoicePrefetchStats().Hits, 1);
+	TestEqual("Line B wasted", Dlg->GetVoicePrefetchStats().Wasted, 1);
+
+	TestTrue("Continue", Dlg->Continue());
+	TestDialogueText(this, "End", Dlg, "NPC", "The end");
+	TestEqual("End prefetched", Dlg->GetVoicePrefetchStats().Hits, 2);
+	TestEqual("Misses", Dlg->GetVoicePrefetchStats().Misses, 1);
+	TestEqual("Wasted", Dlg->GetVoicePrefetchStats().Wasted, 1);
+
+	Dlg->ResetVoicePrefetchStats();
+	TestEqual("Reset", Dlg->GetVoicePrefetchStats().Hits, 0);
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FTestVoiceSoftReferences,
+								 "SUDSTest.TestVoiceSoftReferences",
+								 EAutomationTestFlags::EditorContext |
+								 EAutomationTestFlags::ClientContext |
+								 EAutomationTestFlags::ProductFilter)
+
+
+
+bool FTestVoiceSoftReferences::RunTest(const FString& Parameters)
+{
+	FSUDSMessageLogger Logger(false);
+	FSUDSScriptImporter Importer;
+	TestTrue("Import should succeed", Importer.ImportFromBuffer(GetData(VoicePrefetchInput), VoicePrefetchInput.Len(), "VoicePrefetchInput", &Logger, true));
+
+	auto Script = NewObject<USUDSScript>(GetTransientPackage(), "Test");
+	const ScopedStringTableHolder StringTableHolder;
+	Importer.PopulateAsset(Script, StringTableHolder.StringTable);
+
+	// Only link the first line, by path, as an imported asset would be
+	auto Wave = NewObject<UDialogueWave>(GetTransientPackage(), "TestSoftWave");
+	auto Voice = NewObject<UDialogueVoice>(GetTransientPackage(), "TestSoftVoice");
+	USUDSScriptNodeText* FirstLine = nullptr;
+	for (auto Node : Script->GetNodes())
+	{
+		if (auto TextNode = Cast<USUDSScriptNodeText>(Node))
+		{
+			FirstLine = TextNode;
+			break;
+		}
+	}
+	if (!TestNotNull("First line", FirstLine))
+	{
+		return false;
+	}
+	FirstLine->SetWave(TSoftObjectPtr<UDialogueWave>(FSoftObjectPath(Wave)));
+	Script->SetSpeakerVoice("NPC", TSoftObjectPtr<UDialogueVoice>(FSoftObjectPath(Voice)));
+
+	auto Dlg = USUDSLibrary::CreateDialogue(Script, Script);
+	TestDialogueText(this, "Start", Dlg, "NPC", "Hello");
+	TestTrue("First line voiced", Dlg->IsCurrentLineVoiced());
+	TestEqual("Wave resolved", Dlg->GetWave(), Wave);
+	TestEqual("Speaker voice resolved", Dlg->GetSpeakerVoice(), Voice);
+	TestEqual("Named voice resolved", Dlg->GetVoice("NPC"), Voice);
+	TestNull("Unknown voice", Dlg->GetVoice("Nobody"));
+
+	TestTrue("Choose", Dlg->Choose(0));
+	TestDialogueText(this, "Choice A", Dlg, "NPC", "Line A");
+	TestFalse("Second line not voiced", Dlg->IsCurrentLineVoiced());
+	TestNull("No wave", Dlg->GetWave());
+	TestNull("No sound without a wave", Dlg->GetSound());
+	TestEqual("Speaker voice still resolved", Dlg->GetSpeakerVoice(), Voice);
+
+	Script->MarkAsGarbage();
+	return true;
+}
+
+PRAGMA_ENABLE_OPTIMIZATION